@@ -0,0 +1,328 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _GNU_SOURCE
+#include "pherror.h" /* before system headers, which raise _XOPEN_SOURCE */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <zlib.h>
+#include "bgzf.h"
+#include "fileio.h"
+
+static unsigned char bgzf_eof[28] = {
+	31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 66, 67, 2, 0,
+	27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static unsigned bgzf_get16(unsigned char *buff) {
+	return buff[0] | (buff[1] << 8);
+}
+
+static unsigned bgzf_get32(unsigned char *buff) {
+	return buff[0] | (buff[1] << 8) | (buff[2] << 16) | ((unsigned)(buff[3]) << 24);
+}
+
+static void bgzf_put32(unsigned char *buff, unsigned num) {
+	buff[0] = num;
+	buff[1] = num >> 8;
+	buff[2] = num >> 16;
+	buff[3] = num >> 24;
+}
+
+long bgzf_extra(unsigned char *buff, long len) {
+	
+	unsigned xlen, slen;
+	unsigned char *extra, *end;
+	
+	/* size of block from the "BC" subfield, 0 if it is not there */
+	if(len < 12 || buff[0] != 31 || buff[1] != 139 || buff[2] != 8 || !(buff[3] & 4)) {
+		return 0;
+	}
+	xlen = bgzf_get16(buff + 10);
+	if(len < 12 + xlen) {
+		return 0;
+	}
+	extra = buff + 12;
+	end = extra + xlen;
+	while(extra + 4 <= end) {
+		slen = bgzf_get16(extra + 2);
+		if(extra[0] == 'B' && extra[1] == 'C' && slen == 2 && extra + 6 <= end) {
+			return bgzf_get16(extra + 4) + 1;
+		}
+		extra += 4 + slen;
+	}
+	
+	return 0;
+}
+
+int bgzf_check(unsigned char *buff, long len) {
+	return 0 < bgzf_extra(buff, len);
+}
+
+long bgzf_bsize(unsigned char *buff, long len) {
+	
+	long bsize;
+	
+	/* size of next block, 0 when it is incomplete and -1 when it is not bgzf */
+	if(len < 18) {
+		return (len && (buff[0] != 31 || (1 < len && buff[1] != 139))) ? -1 : 0;
+	} else if(!(bsize = bgzf_extra(buff, len))) {
+		return (len < 12 + bgzf_get16(buff + 10) && buff[0] == 31 && buff[1] == 139) ? 0 : -1;
+	} else if(bsize < 12 + bgzf_get16(buff + 10) + 8) {
+		return -1;
+	}
+	
+	return bsize <= len ? bsize : 0;
+}
+
+Bgzf * bgzf_init(int size, int thread_num) {
+	
+	int i;
+	Bgzf *dest;
+	z_stream *strm;
+	
+	dest = smalloc(sizeof(Bgzf));
+	dest->n = 0;
+	dest->size = size;
+	dest->thread_num = thread_num < size ? thread_num : size;
+	dest->next = 0;
+	dest->avail = 0;
+	dest->inSize = (long) size * BGZF_BLOCKSIZE;
+	dest->blocks = smalloc(size * sizeof(long));
+	dest->blockLen = smalloc(2 * size * sizeof(int));
+	dest->outLen = dest->blockLen + size;
+	dest->in = smalloc(dest->inSize);
+	dest->dest = 0;
+	dest->threads = smalloc(dest->thread_num * sizeof(BgzfThread));
+	for(i = 0; i < dest->thread_num; ++i) {
+		dest->threads[i].src = dest;
+		strm = &dest->threads[i].strm;
+		strm->zalloc = Z_NULL;
+		strm->zfree = Z_NULL;
+		strm->opaque = Z_NULL;
+		strm->next_in = Z_NULL;
+		strm->avail_in = 0;
+		if(inflateInit2(strm, -15) != Z_OK) {
+			ERROR();
+		}
+	}
+	
+	return dest;
+}
+
+int bgzf_cut(Bgzf *src) {
+	
+	long pos, bsize;
+	
+	/* cut complete blocks from the compressed buffer */
+	src->n = 0;
+	pos = 0;
+	bsize = 0;
+	while(src->n < src->size && 0 < (bsize = bgzf_bsize(src->in + pos, src->avail - pos))) {
+		src->blocks[src->n] = pos;
+		src->blockLen[src->n] = bsize;
+		++src->n;
+		pos += bsize;
+	}
+	
+	return bsize < 0 && src->n == 0 ? -1 : src->n;
+}
+
+static void * bgzf_worker(void *arg) {
+	
+	int i, len;
+	unsigned char *block, *out;
+	z_stream *strm;
+	Bgzf *src;
+	BgzfThread *thread;
+	
+	thread = arg;
+	src = thread->src;
+	strm = &thread->strm;
+	while((i = __sync_fetch_and_add(&src->next, 1)) < src->n) {
+		/* inflate raw deflate data between header and trailer */
+		block = src->in + src->blocks[i];
+		len = src->blockLen[i];
+		out = src->dest + (long) i * BGZF_BLOCKSIZE;
+		inflateReset(strm);
+		strm->next_in = block + 12 + bgzf_get16(block + 10);
+		strm->avail_in = block + len - 8 - strm->next_in;
+		strm->next_out = out;
+		strm->avail_out = BGZF_BLOCKSIZE;
+		if(inflate(strm, Z_FINISH) != Z_STREAM_END || strm->total_out != bgzf_get32(block + len - 4) || crc32(0, out, strm->total_out) != bgzf_get32(block + len - 8)) {
+			src->outLen[i] = -1;
+		} else {
+			src->outLen[i] = strm->total_out;
+		}
+	}
+	
+	return NULL;
+}
+
+long bgzf_inflate(Bgzf *src, unsigned char *dest) {
+	
+	int i, thread_num, errcode;
+	long len, pos;
+	
+	/* inflate cut blocks in parallel */
+	src->next = 0;
+	src->dest = dest;
+	thread_num = src->n < src->thread_num ? src->n : src->thread_num;
+	for(i = 1; i < thread_num; ++i) {
+		if((errcode = pthread_create(&src->threads[i].id, NULL, &bgzf_worker, src->threads + i))) {
+			fprintf(stderr, "Error %d (%s)\n", errcode, strerror(errcode));
+			thread_num = i;
+			break;
+		}
+	}
+	bgzf_worker(src->threads);
+	for(i = 1; i < thread_num; ++i) {
+		pthread_join(src->threads[i].id, NULL);
+	}
+	
+	/* move blocks together, and drop them from the compressed buffer */
+	len = 0;
+	pos = 0;
+	for(i = 0; i < src->n; ++i) {
+		if(src->outLen[i] < 0) {
+			return -1;
+		}
+		memmove(dest + len, dest + (long) i * BGZF_BLOCKSIZE, src->outLen[i]);
+		len += src->outLen[i];
+		pos += src->blockLen[i];
+	}
+	src->avail -= pos;
+	memmove(src->in, src->in + pos, src->avail);
+	src->n = 0;
+	
+	return len;
+}
+
+void bgzf_destroy(Bgzf *dest) {
+	
+	int i;
+	
+	for(i = 0; i < dest->thread_num; ++i) {
+		inflateEnd(&dest->threads[i].strm);
+	}
+	free(dest->blocks);
+	free(dest->blockLen);
+	free(dest->in);
+	free(dest->threads);
+	free(dest);
+}
+
+static int bgzf_deflate(BgzfWriter *dest) {
+	
+	int len;
+	unsigned char *block;
+	z_stream *strm;
+	
+	/* compress buffer into one block, stored if it does not shrink */
+	block = dest->block;
+	strm = &dest->strm;
+	deflateReset(strm);
+	strm->next_in = dest->buffer;
+	strm->avail_in = dest->len;
+	strm->next_out = block + 18;
+	strm->avail_out = BGZF_BLOCKSIZE - 26;
+	if(deflate(strm, Z_FINISH) == Z_STREAM_END) {
+		len = strm->total_out;
+	} else {
+		block[18] = 1;
+		block[19] = dest->len;
+		block[20] = dest->len >> 8;
+		block[21] = ~dest->len;
+		block[22] = ~dest->len >> 8;
+		memcpy(block + 23, dest->buffer, dest->len);
+		len = dest->len + 5;
+	}
+	memcpy(block, bgzf_eof, 16);
+	len += 26;
+	block[16] = (len - 1);
+	block[17] = (len - 1) >> 8;
+	bgzf_put32(block + len - 8, crc32(0, dest->buffer, dest->len));
+	bgzf_put32(block + len - 4, dest->len);
+	dest->len = 0;
+	
+	return fwrite(block, 1, len, dest->file) != len;
+}
+
+static ssize_t bgzf_write(void *cookie, const char *buf, size_t size) {
+	
+	size_t len, left;
+	BgzfWriter *dest;
+	
+	dest = cookie;
+	left = size;
+	while(left) {
+		len = BGZF_MAXDATA - dest->len;
+		len = left < len ? left : len;
+		memcpy(dest->buffer + dest->len, buf, len);
+		dest->len += len;
+		buf += len;
+		left -= len;
+		if(dest->len == BGZF_MAXDATA && bgzf_deflate(dest)) {
+			return -1;
+		}
+	}
+	
+	return size;
+}
+
+static int bgzf_close(void *cookie) {
+	
+	int err;
+	BgzfWriter *dest;
+	
+	/* flush last block and mark end of file */
+	dest = cookie;
+	err = dest->len ? bgzf_deflate(dest) : 0;
+	err |= fwrite(bgzf_eof, 1, sizeof(bgzf_eof), dest->file) != sizeof(bgzf_eof);
+	deflateEnd(&dest->strm);
+	if(dest->file == stdout) {
+		err |= fflush(stdout);
+	} else {
+		err |= fclose(dest->file);
+	}
+	free(dest);
+	
+	return err ? EOF : 0;
+}
+
+FILE * bgzf_open(FILE *file, int level) {
+	
+	BgzfWriter *writer;
+	
+	/* bgzf compressing stream on top of file */
+	writer = smalloc(sizeof(BgzfWriter));
+	writer->len = 0;
+	writer->file = file;
+	writer->strm.zalloc = Z_NULL;
+	writer->strm.zfree = Z_NULL;
+	writer->strm.opaque = Z_NULL;
+	if(deflateInit2(&writer->strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		ERROR();
+	}
+	
+	return fileio_writer(writer, &bgzf_write, &bgzf_close);
+}
@@ -0,0 +1,67 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <zlib.h>
+
+#ifndef BGZF
+#define BGZF_BLOCKSIZE 65536
+#define BGZF_MAXDATA 65280
+typedef struct bgzf Bgzf;
+typedef struct bgzfThread BgzfThread;
+typedef struct bgzfWriter BgzfWriter;
+struct bgzfThread {
+	struct bgzf *src;
+	z_stream strm;
+	pthread_t id;
+};
+struct bgzf {
+	int n; /* blocks cut from "in" */
+	int size; /* max blocks per refill */
+	int thread_num;
+	volatile int next; /* next block to inflate */
+	long avail; /* compressed bytes in "in" */
+	long inSize;
+	long *blocks; /* offsets of blocks in "in" */
+	int *blockLen;
+	int *outLen;
+	unsigned char *in;
+	unsigned char *dest; /* block i inflates to dest + i * BGZF_BLOCKSIZE */
+	BgzfThread *threads;
+};
+struct bgzfWriter {
+	int len;
+	FILE *file;
+	z_stream strm;
+	unsigned char buffer[BGZF_MAXDATA];
+	unsigned char block[BGZF_BLOCKSIZE];
+};
+#define BGZF 1
+#endif
+
+/* blocked gzip, as used by bam */
+long bgzf_extra(unsigned char *buff, long len);
+int bgzf_check(unsigned char *buff, long len);
+long bgzf_bsize(unsigned char *buff, long len);
+Bgzf * bgzf_init(int size, int thread_num);
+int bgzf_cut(Bgzf *src);
+long bgzf_inflate(Bgzf *src, unsigned char *dest);
+void bgzf_destroy(Bgzf *dest);
+FILE * bgzf_open(FILE *file, int level);
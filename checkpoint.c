@@ -0,0 +1,230 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "checkpoint.h"
+#include "gzindex.h"
+#include "pherror.h"
+
+static const char checkpoint_magic[8] = {'f', 'q', 'c', 'k', 'p', 't', 0, 1};
+
+static int checkpoint_load(Checkpoint *dest, FILE *infile) {
+	
+	int k, has;
+	char magic[sizeof(checkpoint_magic)];
+	uLongf zlen, len;
+	unsigned char *zwindow;
+	GzPoint *point;
+	
+	if(fread(magic, 1, sizeof(magic), infile) != sizeof(magic) || memcmp(magic, checkpoint_magic, sizeof(magic))
+		|| fread(&dest->id, sizeof(unsigned long), 1, infile) != 1
+		|| fread(&dest->set, sizeof(int), 1, infile) != 1
+		|| fread(&dest->file, sizeof(int), 1, infile) != 1
+		|| fread(&dest->count, sizeof(long), 1, infile) != 1
+		|| fread(dest->size, sizeof(long long), 4, infile) != 4) {
+		return 1;
+	}
+	
+	/* inputs, with their inflate windows */
+	zwindow = smalloc(compressBound(WINSIZE));
+	for(k = 0, point = dest->point; k < 2; ++k, ++point) {
+		len = WINSIZE;
+		point->window = 0;
+		if(fread(dest->pos + k, sizeof(long long), 1, infile) != 1
+			|| fread(&point->out, sizeof(long long), 1, infile) != 1
+			|| fread(&point->in, sizeof(long long), 1, infile) != 1
+			|| fread(&point->bits, sizeof(int), 1, infile) != 1
+			|| fread(&has, sizeof(int), 1, infile) != 1) {
+			break;
+		} else if(has && (fread(&zlen, sizeof(uLongf), 1, infile) != 1 || compressBound(WINSIZE) < zlen
+			|| fread(zwindow, 1, zlen, infile) != zlen
+			|| uncompress(dest->window + k * WINSIZE, &len, zwindow, zlen) != Z_OK || len != WINSIZE)) {
+			break;
+		} else if(has) {
+			point->window = dest->window + k * WINSIZE;
+		}
+	}
+	free(zwindow);
+	
+	return k != 2;
+}
+
+Checkpoint * checkpoint_init(char *filename, int interval, unsigned long id) {
+	
+	FILE *infile;
+	Checkpoint *dest;
+	
+	dest = smalloc(sizeof(Checkpoint));
+	memset(dest, 0, sizeof(Checkpoint));
+	dest->interval = interval;
+	dest->last = time(NULL);
+	dest->window = smalloc(2 * WINSIZE);
+	dest->filename = filename;
+	dest->tmpname = smalloc(strlen(filename) + strlen(CHECKPOINT_EXT) + 1);
+	sprintf(dest->tmpname, "%s%s", filename, CHECKPOINT_EXT);
+	
+	/* resume from an earlier run of the same command */
+	if((infile = fopen(filename, "rb"))) {
+		if(checkpoint_load(dest, infile)) {
+			fprintf(stderr, "Invalid checkpoint:\t%s\n", filename);
+			exit(1);
+		} else if(dest->id != id) {
+			fprintf(stderr, "Checkpoint belongs to another command:\t%s\n", filename);
+			exit(1);
+		}
+		fclose(infile);
+		dest->resume = 1;
+		fprintf(stderr, "# Resuming from checkpoint:\t%s\n", filename);
+	}
+	dest->id = id;
+	
+	return dest;
+}
+
+int checkpoint_skip(Checkpoint *src, int set, int file) {
+	
+	/* inputs fully covered by the checkpoint */
+	if(!src || !src->resume) {
+		return 0;
+	} else if(src->set < set) {
+		src->resume = 0;
+		return 0;
+	}
+	
+	return set < src->set || file < src->file;
+}
+
+int checkpoint_due(Checkpoint *src) {
+	return src && src->interval <= time(NULL) - src->last;
+}
+
+void checkpoint_input(Checkpoint *dest, int k, long long pos, GzPoint *point) {
+	
+	dest->pos[k] = pos;
+	if(point) {
+		dest->point[k] = *point;
+	} else {
+		memset(dest->point + k, 0, sizeof(GzPoint));
+	}
+}
+
+static long long checkpoint_flush(FILE *file) {
+	
+	/* output on disk up to the checkpoint */
+	if(!file) {
+		return -1;
+	} else if(fflush(file) || fsync(fileno(file))) {
+		ERROR();
+	}
+	
+	return ftello(file);
+}
+
+int checkpoint_save(Checkpoint *dest, int set, int file, long count, FILE *out, FILE *out2, FILE *uout, FILE *uout2) {
+	
+	int k, has;
+	uLongf zlen;
+	unsigned char *zwindow;
+	FILE *outfile;
+	GzPoint *point;
+	
+	dest->set = set;
+	dest->file = file;
+	dest->count = count;
+	dest->size[0] = checkpoint_flush(out);
+	dest->size[1] = checkpoint_flush(out2);
+	dest->size[2] = checkpoint_flush(uout);
+	dest->size[3] = checkpoint_flush(uout2);
+	
+	/* write new checkpoint aside, and replace the old one */
+	if(!(outfile = fopen(dest->tmpname, "wb"))) {
+		fprintf(stderr, "Cannot write checkpoint:\t%s\n", dest->tmpname);
+		return 1;
+	}
+	zwindow = smalloc(compressBound(WINSIZE));
+	sfwrite(checkpoint_magic, 1, sizeof(checkpoint_magic), outfile);
+	sfwrite(&dest->id, sizeof(unsigned long), 1, outfile);
+	sfwrite(&dest->set, sizeof(int), 1, outfile);
+	sfwrite(&dest->file, sizeof(int), 1, outfile);
+	sfwrite(&dest->count, sizeof(long), 1, outfile);
+	sfwrite(dest->size, sizeof(long long), 4, outfile);
+	for(k = 0, point = dest->point; k < 2; ++k, ++point) {
+		has = point->window != 0;
+		sfwrite(dest->pos + k, sizeof(long long), 1, outfile);
+		sfwrite(&point->out, sizeof(long long), 1, outfile);
+		sfwrite(&point->in, sizeof(long long), 1, outfile);
+		sfwrite(&point->bits, sizeof(int), 1, outfile);
+		sfwrite(&has, sizeof(int), 1, outfile);
+		if(has) {
+			zlen = compressBound(WINSIZE);
+			if(compress(zwindow, &zlen, point->window, WINSIZE) != Z_OK) {
+				fprintf(stderr, "Gzip error while compressing checkpoint window\n");
+				exit(1);
+			}
+			sfwrite(&zlen, sizeof(uLongf), 1, outfile);
+			sfwrite(zwindow, 1, zlen, outfile);
+		}
+	}
+	free(zwindow);
+	if(fflush(outfile) || fsync(fileno(outfile))) {
+		ERROR();
+	}
+	fclose(outfile);
+	if(rename(dest->tmpname, dest->filename)) {
+		ERROR();
+	}
+	dest->last = time(NULL);
+	
+	return 0;
+}
+
+int checkpoint_truncate(FILE *file, long long size) {
+	
+	struct stat st;
+	
+	/* drop output written after the checkpoint */
+	if(size < 0) {
+		return 0;
+	} else if(fflush(file) || fstat(fileno(file), &st) || st.st_size < size || ftruncate(fileno(file), size)) {
+		return 1;
+	}
+	
+	return fseeko(file, 0, SEEK_END) != 0;
+}
+
+void checkpoint_done(Checkpoint *src) {
+	
+	/* finished, next run starts over */
+	unlink(src->filename);
+	checkpoint_destroy(src);
+}
+
+void checkpoint_destroy(Checkpoint *src) {
+	
+	free(src->window);
+	free(src->tmpname);
+	free(src);
+}
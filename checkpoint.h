@@ -0,0 +1,58 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "gzindex.h"
+
+#ifndef CHECKPOINT
+typedef struct checkpoint Checkpoint;
+struct checkpoint {
+	int resume; /* position below is yet to be reached */
+	int interval;
+	time_t last;
+	unsigned long id; /* crc of the command line */
+	int set; /* single end, interleaved or paired end inputs */
+	int file;
+	long count;
+	long long pos[2]; /* uncompressed input offsets */
+	GzPoint point[2]; /* inflate state before pos, no window on plain input */
+	long long size[4]; /* out, out2, uout and uout2 */
+	unsigned char *window;
+	char *filename;
+	char *tmpname;
+};
+#define CHECKPOINT 1
+#define CHECKPOINT_INTERVAL 60
+#define CHECKPOINT_GZSPAN 67108864
+#define CHECKPOINT_EXT ".tmp"
+#define SET_SE 0
+#define SET_INT 1
+#define SET_PE 2
+#endif
+
+/* periodic resume points of a grep */
+Checkpoint * checkpoint_init(char *filename, int interval, unsigned long id);
+int checkpoint_skip(Checkpoint *src, int set, int file);
+int checkpoint_due(Checkpoint *src);
+void checkpoint_input(Checkpoint *dest, int k, long long pos, GzPoint *point);
+int checkpoint_save(Checkpoint *dest, int set, int file, long count, FILE *out, FILE *out2, FILE *uout, FILE *uout2);
+int checkpoint_truncate(FILE *file, long long size);
+void checkpoint_done(Checkpoint *src);
+void checkpoint_destroy(Checkpoint *src);
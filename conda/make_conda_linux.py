@@ -18,8 +18,8 @@ build['noarch'] = 'generic'
 
 requirements = yaml.comments.CommentedMap()
 requirements['build'] = ['make', '{{ compiler(\'c\') }}']
-requirements['host'] = ['zlib']
-requirements['run'] = ['zlib']
+requirements['host'] = ['zlib', 'zstd']
+requirements['run'] = ['zlib', 'zstd']
 
 about = yaml.comments.CommentedMap()
 about['home'] = 'https://bitbucket.org/genomicepidemiology/fqgrep'
@@ -0,0 +1,339 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _XOPEN_SOURCE 600
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "demux.h"
+#include "pherror.h"
+
+static int demux_code(int c) {
+	
+	switch(c) {
+		case 'A':
+		case 'a':
+			return 0;
+		case 'C':
+		case 'c':
+			return 1;
+		case 'G':
+		case 'g':
+			return 2;
+		case 'T':
+		case 't':
+			return 3;
+	}
+	
+	return -1;
+}
+
+static unsigned demux_hash(Demux *src, unsigned long long key) {
+	return (key * 0x9E3779B97F4A7C15ULL) >> 32 & src->mask;
+}
+
+static int demux_get(Demux *src, unsigned long long key) {
+	
+	unsigned i;
+	
+	/* linear probing in a flat table */
+	for(i = demux_hash(src, key); src->values[i] != -1; i = (i + 1) & src->mask) {
+		if(src->keys[i] == key) {
+			return src->values[i];
+		}
+	}
+	
+	return -1;
+}
+
+static int demux_popcount(int mism) {
+	return (mism & 1) + (mism >> 1 & 1);
+}
+
+static void demux_put(Demux *dest, unsigned long long key, int sample, int mism) {
+	
+	unsigned i;
+	
+	for(i = demux_hash(dest, key); dest->values[i] != -1; i = (i + 1) & dest->mask) {
+		if(dest->keys[i] == key) {
+			if((dest->values[i] >> 2) != sample) {
+				fprintf(stderr, "Barcodes of %s and %s cannot be told apart with one mismatch.\n", dest->names[dest->values[i] >> 2], dest->names[sample]);
+				exit(1);
+			} else if(demux_popcount(mism) < demux_popcount(dest->values[i] & 3)) {
+				dest->values[i] = sample << 2 | mism;
+			}
+			return;
+		}
+	}
+	dest->keys[i] = key;
+	dest->values[i] = sample << 2 | mism;
+	++dest->entries;
+}
+
+static unsigned long long demux_pack(char *seq, int len) {
+	
+	unsigned long long key;
+	
+	key = 0;
+	while(len--) {
+		key = key << 2 | demux_code(*seq++);
+	}
+	
+	return key;
+}
+
+static int demux_base(unsigned long long key, int total, int i) {
+	return key >> 2 * (total - 1 - i) & 3;
+}
+
+static unsigned long long demux_subst(unsigned long long key, int total, int i, int base) {
+	
+	int shift;
+	
+	shift = 2 * (total - 1 - i);
+	
+	return (key & ~(3ULL << shift)) | ((unsigned long long)(base) << shift);
+}
+
+static void demux_expand(Demux *dest, int sample, char *barcode) {
+	
+	int i, j, k, l, total;
+	unsigned long long key, key1;
+	
+	/* the barcode and its substitutions, with each index on its own */
+	total = dest->len[0] + dest->len[1];
+	key = demux_pack(barcode, total);
+	for(i = -1; i < dest->len[0]; ++i) {
+		for(j = 0; j < 4; ++j) {
+			if(i < 0 ? j : demux_base(key, total, i) == j) {
+				continue;
+			}
+			key1 = i < 0 ? key : demux_subst(key, total, i, j);
+			for(k = -1; k < dest->len[1]; ++k) {
+				for(l = 0; l < 4; ++l) {
+					if(k < 0 ? l : demux_base(key1, total, dest->len[0] + k) == l) {
+						continue;
+					}
+					demux_put(dest, k < 0 ? key1 : demux_subst(key1, total, dest->len[0] + k, l), sample, (0 <= i) | (0 <= k) << 1);
+				}
+			}
+		}
+	}
+}
+
+static int demux_barcode(char *barcode, int *len) {
+	
+	int k;
+	char *next;
+	
+	/* ACGT bases, with the two indexes of dual barcodes split by '+' or '-' */
+	for(k = 0, next = barcode; k < 2; ++k) {
+		len[k] = 0;
+		while(0 <= demux_code(next[len[k]])) {
+			++len[k];
+		}
+		if(!len[k] && (k == 0 || next[len[k]])) {
+			return 1;
+		}
+		next += len[k];
+		if(k == 0 && *next != '+' && *next != '-') {
+			len[1] = 0;
+			return *next != 0;
+		}
+		memmove(next, next + 1, strlen(next));
+	}
+	
+	return *next != 0;
+}
+
+Demux * demux_init(char *filename) {
+	
+	int i, n, size, lines, sample, len[2], *samples;
+	char *line, *name, *barcode, *index2, **barcodes;
+	FILE *infile;
+	Demux *dest;
+	
+	dest = smalloc(sizeof(Demux));
+	dest->n = 0;
+	dest->size = 32;
+	dest->len[0] = 0;
+	dest->len[1] = 0;
+	dest->entries = 0;
+	dest->names = smalloc(dest->size * sizeof(char *));
+	
+	/* sample, barcode and optionally the second index per line */
+	infile = sfopen(filename, "rb");
+	line = smalloc(DEMUX_LINE);
+	size = 32;
+	barcodes = smalloc(size * sizeof(char *));
+	samples = smalloc(size * sizeof(int));
+	n = 0;
+	lines = 0;
+	while(fgets(line, DEMUX_LINE, infile)) {
+		++lines;
+		if(*line == '#' || !(name = strtok(line, "\t, \r\n"))) {
+			continue;
+		} else if(!(barcode = strtok(0, "\t, \r\n"))) {
+			fprintf(stderr, "Missing barcode in sample sheet at line %d.\n", lines);
+			exit(1);
+		}
+		if((index2 = strtok(0, "\t, \r\n"))) {
+			i = strlen(barcode);
+			barcode[i] = '+';
+			memmove(barcode + i + 1, index2, strlen(index2) + 1);
+		}
+		if(demux_barcode(barcode, len)) {
+			if(n == 0 && dest->n == 0) {
+				/* column names */
+				continue;
+			}
+			fprintf(stderr, "Invalid barcode in sample sheet at line %d.\n", lines);
+			exit(1);
+		} else if(n == 0) {
+			dest->len[0] = len[0];
+			dest->len[1] = len[1];
+			if(DEMUX_MAXLEN < len[0] + len[1]) {
+				fprintf(stderr, "Barcodes are limited to %d bases.\n", DEMUX_MAXLEN);
+				exit(1);
+			}
+		} else if(len[0] != dest->len[0] || len[1] != dest->len[1]) {
+			fprintf(stderr, "Barcodes of different length in sample sheet at line %d.\n", lines);
+			exit(1);
+		}
+		
+		/* samples may have several barcodes */
+		for(sample = 0; sample < dest->n && strcmp(dest->names[sample], name); ++sample);
+		if(sample == dest->n) {
+			if(dest->n == dest->size) {
+				dest->size <<= 1;
+				if(!(dest->names = realloc(dest->names, dest->size * sizeof(char *)))) {
+					ERROR();
+				}
+			}
+			dest->names[dest->n] = smalloc(strlen(name) + 1);
+			strcpy(dest->names[dest->n++], name);
+		}
+		if(n == size) {
+			size <<= 1;
+			barcodes = realloc(barcodes, size * sizeof(char *));
+			samples = realloc(samples, size * sizeof(int));
+			if(!barcodes || !samples) {
+				ERROR();
+			}
+		}
+		barcodes[n] = smalloc(strlen(barcode) + 1);
+		strcpy(barcodes[n], barcode);
+		samples[n++] = sample;
+	}
+	fclose(infile);
+	free(line);
+	if(!n) {
+		fprintf(stderr, "No barcodes in sample sheet:\t%s\n", filename);
+		exit(1);
+	}
+	
+	/* flat table at most half full of the whole neighbourhood */
+	size = n * (1 + 3 * dest->len[0]) * (1 + 3 * dest->len[1]);
+	for(dest->mask = 1023; dest->mask < 2 * size; dest->mask = dest->mask << 1 | 1);
+	dest->keys = smalloc((dest->mask + 1) * sizeof(unsigned long long));
+	dest->values = smalloc((dest->mask + 1) * sizeof(int));
+	memset(dest->values, -1, (dest->mask + 1) * sizeof(int));
+	for(i = 0; i < n; ++i) {
+		demux_expand(dest, samples[i], barcodes[i]);
+		free(barcodes[i]);
+	}
+	free(barcodes);
+	free(samples);
+	
+	return dest;
+}
+
+int demux_sample(Demux *src, char *header) {
+	
+	int i, k, c, n, total, nmask, sample, value, pos[2];
+	unsigned long long key, key1;
+	
+	/* index read is the last field of the comment, as in 1:N:0:ACGTACGT+TTGGCCAA */
+	while(*header && !isspace(*header)) {
+		++header;
+	}
+	if(!*header || !(header = strrchr(header, ':'))) {
+		return -1;
+	}
+	++header;
+	total = src->len[0] + src->len[1];
+	key = 0;
+	n = 0;
+	nmask = 0;
+	for(k = 0; k < 2 && src->len[k]; ++k) {
+		if(k && *header++ != '+' && header[-1] != '-') {
+			return -1;
+		}
+		for(i = 0; i < src->len[k]; ++i, ++header) {
+			if((c = demux_code(*header)) < 0) {
+				/* one N per index takes its mismatch */
+				if(!*header || isspace(*header) || (nmask & (1 << k))) {
+					return -1;
+				}
+				nmask |= 1 << k;
+				pos[n++] = k * src->len[0] + i;
+				c = 0;
+			}
+			key = key << 2 | c;
+		}
+	}
+	if(*header && !isspace(*header) && (src->len[1] || (*header != '+' && *header != '-'))) {
+		return -1;
+	} else if(!n) {
+		return (value = demux_get(src, key)) < 0 ? -1 : value >> 2;
+	}
+	
+	/* try all bases at the Ns, the rest must be in reach */
+	sample = -1;
+	for(i = 0; i < (1 << 2 * n); ++i) {
+		key1 = demux_subst(key, total, pos[0], i & 3);
+		if(n == 2) {
+			key1 = demux_subst(key1, total, pos[1], i >> 2);
+		}
+		if(0 <= (value = demux_get(src, key1)) && !(value & nmask)) {
+			if(0 <= sample && sample != value >> 2) {
+				return -1;
+			}
+			sample = value >> 2;
+		}
+	}
+	
+	return sample;
+}
+
+void demux_destroy(Demux *dest) {
+	
+	int i;
+	
+	if(dest) {
+		for(i = 0; i < dest->n; ++i) {
+			free(dest->names[i]);
+		}
+		free(dest->names);
+		free(dest->keys);
+		free(dest->values);
+		free(dest);
+	}
+}
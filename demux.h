@@ -0,0 +1,40 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef DEMUX
+typedef struct demux Demux;
+struct demux {
+	int n; /* samples */
+	int size;
+	int len[2]; /* index lengths, len[1] is 0 for single indexes */
+	int entries;
+	unsigned mask; /* table size - 1 */
+	unsigned long long *keys; /* packed 2-bit barcodes */
+	int *values; /* sample << 2 | indexes with a mismatch, -1 if empty */
+	char **names;
+};
+#define DEMUX 1
+#define DEMUX_MAXLEN 32
+#define DEMUX_LINE 4096
+#endif
+
+/* sample sheet expanded to all barcodes within one mismatch per index */
+Demux * demux_init(char *filename);
+int demux_sample(Demux *src, char *header);
+void demux_destroy(Demux *dest);
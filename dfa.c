@@ -0,0 +1,709 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _XOPEN_SOURCE 600
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dfa.h"
+#include "filebuff.h"
+#include "pherror.h"
+
+#define setbit(set, c) ((set)[(c) >> 5] |= 1U << ((c) & 31))
+#define hasbit(set, c) (((set)[(c) >> 5] >> ((c) & 31)) & 1)
+
+Nfa * nfa_init(void) {
+	
+	Nfa *dest;
+	
+	dest = smalloc(sizeof(Nfa));
+	dest->n = 0;
+	dest->size = 256;
+	dest->nsets = 0;
+	dest->setSize = 64;
+	dest->start = -1;
+	dest->states = smalloc(dest->size * sizeof(NfaState));
+	dest->sets = smalloc(dest->setSize * 8 * sizeof(unsigned));
+	dest->pattern = 0;
+	dest->ptr = 0;
+	
+	return dest;
+}
+
+void nfa_destroy(Nfa *src) {
+	free(src->states);
+	free(src->sets);
+	free(src);
+}
+
+static void nfa_invalid(Nfa *src) {
+	fprintf(stderr, "Invalid pattern:\t%s\n", src->pattern);
+	exit(1);
+}
+
+static int nfa_state(Nfa *dest, int type, int out, int out1, int set) {
+	
+	NfaState *state;
+	
+	if(dest->n == dest->size) {
+		dest->size <<= 1;
+		if(!(dest->states = realloc(dest->states, dest->size * sizeof(NfaState)))) {
+			ERROR();
+		}
+	}
+	state = dest->states + dest->n;
+	state->type = type;
+	state->out = out;
+	state->out1 = out1;
+	state->set = set;
+	
+	return dest->n++;
+}
+
+static unsigned * nfa_set(Nfa *dest) {
+	
+	unsigned *set;
+	
+	if(dest->nsets == dest->setSize) {
+		dest->setSize <<= 1;
+		if(!(dest->sets = realloc(dest->sets, dest->setSize * 8 * sizeof(unsigned)))) {
+			ERROR();
+		}
+	}
+	set = dest->sets + 8 * dest->nsets++;
+	memset(set, 0, 8 * sizeof(unsigned));
+	
+	return set;
+}
+
+static void nfa_patch(Nfa *dest, int end, int to) {
+	dest->states[end].out = to;
+}
+
+static int nfa_byteset(Nfa *dest, int *end) {
+	
+	/* matches the last set made */
+	*end = nfa_state(dest, NFA_EPS, -1, -1, -1);
+	return nfa_state(dest, NFA_SET, *end, -1, dest->nsets - 1);
+}
+
+static int nfa_literal(Nfa *dest, int c, int *end) {
+	
+	setbit(nfa_set(dest), (unsigned char)(c));
+	
+	return nfa_byteset(dest, end);
+}
+
+static int nfa_any(Nfa *dest, int *end) {
+	
+	memset(nfa_set(dest), 255, 8 * sizeof(unsigned));
+	
+	return nfa_byteset(dest, end);
+}
+
+static int nfa_star(Nfa *dest, int start, int *end) {
+	
+	int e, split;
+	
+	e = nfa_state(dest, NFA_EPS, -1, -1, -1);
+	split = nfa_state(dest, NFA_SPLIT, start, e, -1);
+	nfa_patch(dest, *end, split);
+	*end = e;
+	
+	return split;
+}
+
+static int nfa_plus(Nfa *dest, int start, int *end) {
+	
+	int e, split;
+	
+	e = nfa_state(dest, NFA_EPS, -1, -1, -1);
+	split = nfa_state(dest, NFA_SPLIT, start, e, -1);
+	nfa_patch(dest, *end, split);
+	*end = e;
+	
+	return start;
+}
+
+static int nfa_quest(Nfa *dest, int start, int *end) {
+	
+	int e, split;
+	
+	e = nfa_state(dest, NFA_EPS, -1, -1, -1);
+	split = nfa_state(dest, NFA_SPLIT, start, e, -1);
+	nfa_patch(dest, *end, e);
+	*end = e;
+	
+	return split;
+}
+
+static void nfa_escape(Nfa *dest, unsigned *set, int c) {
+	
+	int i;
+	
+	/* shorthand classes, other escapes are literal */
+	for(i = 0; i < 256; ++i) {
+		if((c == 'd' && isdigit(i)) || (c == 'w' && (isalnum(i) || i == '_')) || (c == 's' && isspace(i))
+			|| (c == 'D' && !isdigit(i)) || (c == 'W' && !(isalnum(i) || i == '_')) || (c == 'S' && !isspace(i))) {
+			setbit(set, i);
+		}
+	}
+	if(!strchr("dwsDWS", c)) {
+		setbit(set, (unsigned char)(c));
+	}
+}
+
+static int nfa_class(Nfa *dest, int glob, int *end) {
+	
+	int i, c, neg;
+	unsigned *set;
+	char *ptr;
+	
+	/* bracket expression, ptr is past '[' */
+	set = nfa_set(dest);
+	ptr = dest->ptr;
+	neg = (*ptr == '^' || (glob && *ptr == '!'));
+	ptr += neg;
+	if(*ptr == ']') {
+		setbit(set, ']');
+		++ptr;
+	}
+	while(*ptr && *ptr != ']') {
+		if(*ptr == '\\' && ptr[1]) {
+			nfa_escape(dest, set, ptr[1]);
+			ptr += 2;
+			continue;
+		}
+		c = (unsigned char)(*ptr++);
+		if(*ptr == '-' && ptr[1] && ptr[1] != ']') {
+			if((unsigned char)(ptr[1]) < c) {
+				nfa_invalid(dest);
+			}
+			for(i = c; i <= (unsigned char)(ptr[1]); ++i) {
+				setbit(set, i);
+			}
+			ptr += 2;
+		} else {
+			setbit(set, c);
+		}
+	}
+	if(*ptr++ != ']') {
+		nfa_invalid(dest);
+	}
+	if(neg) {
+		for(i = 0; i < 8; ++i) {
+			set[i] = ~set[i];
+		}
+	}
+	dest->ptr = ptr;
+	
+	return nfa_byteset(dest, end);
+}
+
+static int re_alt(Nfa *dest, int *end);
+
+static int re_atom(Nfa *dest, int *end) {
+	
+	int c, start;
+	
+	c = *dest->ptr++;
+	if(c == '(') {
+		if(*dest->ptr == '?' && dest->ptr[1] == ':') {
+			dest->ptr += 2;
+		}
+		start = re_alt(dest, end);
+		if(*dest->ptr++ != ')') {
+			nfa_invalid(dest);
+		}
+		return start;
+	} else if(c == '[') {
+		return nfa_class(dest, 0, end);
+	} else if(c == '.') {
+		return nfa_any(dest, end);
+	} else if(c == '^' || c == '$') {
+		/* anchors are zero width */
+		*end = nfa_state(dest, NFA_EPS, -1, -1, -1);
+		return nfa_state(dest, c == '^' ? NFA_BOL : NFA_EOL, *end, -1, -1);
+	} else if(c == '\\') {
+		if(!(c = *dest->ptr++)) {
+			nfa_invalid(dest);
+		}
+		nfa_escape(dest, nfa_set(dest), c);
+		return nfa_byteset(dest, end);
+	} else if(!c || strchr("*+?{", c)) {
+		nfa_invalid(dest);
+	}
+	
+	return nfa_literal(dest, c, end);
+}
+
+static int re_repeat(Nfa *dest, int *end) {
+	
+	int i, m, n, start, s, t;
+	char *atom, *next;
+	
+	atom = dest->ptr;
+	start = re_atom(dest, end);
+	
+	/* {m,n} repeats the text of the atom */
+	if(*dest->ptr == '{') {
+		next = dest->ptr + 1;
+		m = strtol(next, &next, 10);
+		n = m;
+		if(*next == ',') {
+			n = isdigit(*++next) ? strtol(next, &next, 10) : -1;
+		}
+		if(*next++ != '}' || !isdigit(dest->ptr[1]) || 255 < m || 255 < n || (0 <= n && n < m)) {
+			nfa_invalid(dest);
+		}
+		start = nfa_state(dest, NFA_EPS, -1, -1, -1);
+		*end = start;
+		for(i = 0; i < m || (i == m && n < 0) || i < n; ++i) {
+			dest->ptr = atom;
+			s = re_atom(dest, &t);
+			if(n < 0 && i == m) {
+				s = nfa_star(dest, s, &t);
+			} else if(m <= i) {
+				s = nfa_quest(dest, s, &t);
+			}
+			nfa_patch(dest, *end, s);
+			*end = t;
+		}
+		dest->ptr = next;
+	}
+	
+	while(*dest->ptr == '*' || *dest->ptr == '+' || *dest->ptr == '?') {
+		if(*dest->ptr == '*') {
+			start = nfa_star(dest, start, end);
+		} else if(*dest->ptr == '+') {
+			start = nfa_plus(dest, start, end);
+		} else {
+			start = nfa_quest(dest, start, end);
+		}
+		++dest->ptr;
+	}
+	
+	return start;
+}
+
+static int re_concat(Nfa *dest, int *end) {
+	
+	int start, s, t;
+	
+	start = nfa_state(dest, NFA_EPS, -1, -1, -1);
+	*end = start;
+	while(*dest->ptr && *dest->ptr != '|' && *dest->ptr != ')') {
+		s = re_repeat(dest, &t);
+		nfa_patch(dest, *end, s);
+		*end = t;
+	}
+	
+	return start;
+}
+
+static int re_alt(Nfa *dest, int *end) {
+	
+	int start, s, t, e;
+	
+	start = re_concat(dest, end);
+	while(*dest->ptr == '|') {
+		++dest->ptr;
+		s = re_concat(dest, &t);
+		e = nfa_state(dest, NFA_EPS, -1, -1, -1);
+		start = nfa_state(dest, NFA_SPLIT, start, s, -1);
+		nfa_patch(dest, *end, e);
+		nfa_patch(dest, t, e);
+		*end = e;
+	}
+	
+	return start;
+}
+
+static void nfa_add(Nfa *dest, int start, int end) {
+	
+	/* all patterns hang off one start */
+	nfa_patch(dest, end, nfa_state(dest, NFA_MATCH, -1, -1, -1));
+	if(dest->start < 0) {
+		dest->start = start;
+	} else {
+		dest->start = nfa_state(dest, NFA_SPLIT, dest->start, start, -1);
+	}
+}
+
+int nfa_addRegex(Nfa *dest, char *pattern) {
+	
+	int start, end, s, t;
+	
+	/* search anywhere in the id, as .*(pattern).* */
+	dest->pattern = pattern;
+	dest->ptr = pattern;
+	start = re_alt(dest, &end);
+	if(*dest->ptr) {
+		nfa_invalid(dest);
+	}
+	s = nfa_any(dest, &t);
+	s = nfa_star(dest, s, &t);
+	nfa_patch(dest, t, start);
+	start = s;
+	s = nfa_any(dest, &t);
+	s = nfa_star(dest, s, &t);
+	nfa_patch(dest, end, s);
+	nfa_add(dest, start, t);
+	
+	return 0;
+}
+
+int nfa_addGlob(Nfa *dest, char *pattern) {
+	
+	int c, start, end, s, t;
+	
+	/* globs match the whole id */
+	dest->pattern = pattern;
+	dest->ptr = pattern;
+	start = nfa_state(dest, NFA_EPS, -1, -1, -1);
+	end = start;
+	while((c = *dest->ptr++)) {
+		if(c == '*') {
+			s = nfa_any(dest, &t);
+			s = nfa_star(dest, s, &t);
+		} else if(c == '?') {
+			s = nfa_any(dest, &t);
+		} else if(c == '[') {
+			s = nfa_class(dest, 1, &t);
+		} else if(c == '\\' && *dest->ptr) {
+			s = nfa_literal(dest, *dest->ptr++, &t);
+		} else {
+			s = nfa_literal(dest, c, &t);
+		}
+		nfa_patch(dest, end, s);
+		end = t;
+	}
+	nfa_add(dest, start, end);
+	
+	return 0;
+}
+
+static int intcmp(const void *a, const void *b) {
+	return *((const int *)(a)) - *((const int *)(b));
+}
+
+static int nfa_closure(Nfa *src, int *list, int n, int *stack, int *mark, int gen, int anchors) {
+	
+	int i, s, m;
+	NfaState *state;
+	
+	/* keep byte sets, matches and unpassed anchors reachable through epsilons */
+	m = 0;
+	for(i = 0; i < n; ++i) {
+		if(mark[list[i]] != gen) {
+			mark[list[i]] = gen;
+			stack[m++] = list[i];
+		}
+	}
+	n = 0;
+	while(m) {
+		state = src->states + (s = stack[--m]);
+		if(state->type == NFA_SET || state->type == NFA_MATCH || (state->type == NFA_EOL && !(anchors & 2))) {
+			list[n++] = s;
+		} else if(state->type != NFA_BOL || (anchors & 1)) {
+			if(0 <= state->out && mark[state->out] != gen) {
+				mark[state->out] = gen;
+				stack[m++] = state->out;
+			}
+			if(state->type == NFA_SPLIT && 0 <= state->out1 && mark[state->out1] != gen) {
+				mark[state->out1] = gen;
+				stack[m++] = state->out1;
+			}
+		}
+	}
+	qsort(list, n, sizeof(int), intcmp);
+	
+	return n;
+}
+
+static unsigned dfa_hash(int *list, int n) {
+	
+	unsigned hash;
+	
+	hash = 2166136261U;
+	while(n--) {
+		hash = (hash ^ *list++) * 16777619U;
+	}
+	
+	return hash;
+}
+
+typedef struct dfaSets DfaSets;
+struct dfaSets {
+	int len;
+	int size;
+	int *lists; /* nfa states of all dfa states back to back */
+	int *starts;
+	unsigned hashSize;
+	unsigned *hash;
+};
+
+static void dfa_rehash(Dfa *dest, DfaSets *sets) {
+	
+	int i;
+	unsigned pos, mask;
+	
+	/* keep hash at most half full */
+	free(sets->hash);
+	sets->hashSize = sets->hashSize ? sets->hashSize << 1 : 128;
+	sets->hash = smalloc(sets->hashSize * sizeof(unsigned));
+	memset(sets->hash, 0, sets->hashSize * sizeof(unsigned));
+	mask = sets->hashSize - 1;
+	for(i = 0; i < dest->n; ++i) {
+		pos = dfa_hash(sets->lists + sets->starts[i], sets->starts[i + 1] - sets->starts[i]) & mask;
+		while(sets->hash[pos]) {
+			pos = (pos + 1) & mask;
+		}
+		sets->hash[pos] = i + 1;
+	}
+}
+
+static int dfa_state(Dfa *dest, DfaSets *sets, int *list, int n) {
+	
+	int state;
+	unsigned pos, mask;
+	
+	/* look up state */
+	mask = sets->hashSize - 1;
+	pos = dfa_hash(list, n) & mask;
+	while((state = sets->hash[pos])) {
+		--state;
+		if(sets->starts[state + 1] - sets->starts[state] == n && memcmp(sets->lists + sets->starts[state], list, n * sizeof(int)) == 0) {
+			return state;
+		}
+		pos = (pos + 1) & mask;
+	}
+	
+	/* add new state */
+	if(DFA_MAXSTATES <= (state = dest->n)) {
+		fprintf(stderr, "Patterns need more than %d DFA states.\n", DFA_MAXSTATES);
+		exit(1);
+	} else if(state == dest->size) {
+		dest->size <<= 1;
+		sets->starts = realloc(sets->starts, (dest->size + 1) * sizeof(int));
+		dest->trans = realloc(dest->trans, dest->size * dest->nclass * sizeof(int));
+		dest->accept = realloc(dest->accept, dest->size);
+		if(!sets->starts || !dest->trans || !dest->accept) {
+			ERROR();
+		}
+	}
+	while(sets->size < sets->len + n) {
+		sets->size <<= 1;
+		if(!(sets->lists = realloc(sets->lists, sets->size * sizeof(int)))) {
+			ERROR();
+		}
+	}
+	memcpy(sets->lists + sets->len, list, n * sizeof(int));
+	sets->len += n;
+	sets->starts[++dest->n] = sets->len;
+	sets->hash[pos] = state + 1;
+	if(sets->hashSize <= (unsigned)(dest->n) << 1) {
+		dfa_rehash(dest, sets);
+	}
+	
+	return state;
+}
+
+Dfa * dfa_compile(Nfa *src) {
+	
+	int i, c, d, n, nc, gen, *list, *stack, *mark, *remap;
+	unsigned char rep[256], classes[256];
+	NfaState *state;
+	DfaSets sets;
+	Dfa *dest;
+	
+	dest = smalloc(sizeof(Dfa));
+	
+	/* bytes that no set tells apart share a class */
+	memset(dest->classes, 0, 256);
+	dest->nclass = 1;
+	remap = smalloc(512 * sizeof(int));
+	for(i = 0; i < src->nsets; ++i) {
+		for(c = 0; c < 512; ++c) {
+			remap[c] = -1;
+		}
+		nc = 0;
+		for(c = 0; c < 256; ++c) {
+			d = (dest->classes[c] << 1) | hasbit(src->sets + 8 * i, c);
+			if(remap[d] < 0) {
+				remap[d] = nc++;
+			}
+			classes[c] = remap[d];
+		}
+		memcpy(dest->classes, classes, 256);
+		dest->nclass = nc;
+	}
+	free(remap);
+	for(c = 255; 0 <= c; --c) {
+		rep[dest->classes[c]] = c;
+	}
+	
+	/* init, dfa states are sorted lists of nfa states */
+	list = smalloc((src->n + 1) * sizeof(int));
+	stack = smalloc((src->n + 1) * sizeof(int));
+	mark = smalloc((src->n + 1) * sizeof(int));
+	memset(mark, 0, (src->n + 1) * sizeof(int));
+	gen = 0;
+	dest->n = 0;
+	dest->size = 64;
+	dest->trans = smalloc(dest->size * dest->nclass * sizeof(int));
+	dest->accept = smalloc(dest->size);
+	sets.len = 0;
+	sets.size = 1024;
+	sets.lists = smalloc(sets.size * sizeof(int));
+	sets.starts = smalloc((dest->size + 1) * sizeof(int));
+	*sets.starts = 0;
+	sets.hashSize = 0;
+	sets.hash = 0;
+	dfa_rehash(dest, &sets);
+	
+	/* zero is the dead state */
+	dfa_state(dest, &sets, list, 0);
+	n = 0;
+	if(0 <= src->start) {
+		list[n++] = src->start;
+	}
+	n = nfa_closure(src, list, n, stack, mark, ++gen, 1);
+	dest->start = dfa_state(dest, &sets, list, n);
+	
+	/* breadth first subset construction */
+	for(d = 0; d < dest->n; ++d) {
+		for(c = 0; c < dest->nclass; ++c) {
+			n = 0;
+			for(i = sets.starts[d]; i < sets.starts[d + 1]; ++i) {
+				state = src->states + sets.lists[i];
+				if(state->type == NFA_SET && hasbit(src->sets + 8 * state->set, rep[c])) {
+					list[n++] = state->out;
+				}
+			}
+			n = nfa_closure(src, list, n, stack, mark, ++gen, 0);
+			n = dfa_state(dest, &sets, list, n);
+			dest->trans[d * dest->nclass + c] = n;
+		}
+	}
+	
+	/* accepting states, where the id may end */
+	for(d = 0; d < dest->n; ++d) {
+		n = sets.starts[d + 1] - sets.starts[d];
+		memcpy(list, sets.lists + sets.starts[d], n * sizeof(int));
+		n = nfa_closure(src, list, n, stack, mark, ++gen, 2);
+		dest->accept[d] = 0;
+		for(i = 0; i < n; ++i) {
+			if(src->states[list[i]].type == NFA_MATCH) {
+				dest->accept[d] = 1;
+			}
+		}
+	}
+	
+	/* clean up */
+	free(list);
+	free(stack);
+	free(mark);
+	free(sets.lists);
+	free(sets.starts);
+	free(sets.hash);
+	
+	return dest;
+}
+
+int dfa_match(Dfa *src, char *entry) {
+	
+	int state;
+	
+	/* run over the id, stop when dead */
+	state = src->start;
+	while(state && *entry && !isspace(*entry)) {
+		state = src->trans[state * src->nclass + src->classes[(unsigned char)(*entry++)]];
+	}
+	
+	return src->accept[state];
+}
+
+void dfa_destroy(Dfa *src) {
+	free(src->trans);
+	free(src->accept);
+	free(src);
+}
+
+Dfa * getPatterns(char *patternfilename) {
+	
+	long len, size;
+	char *buff, *line, *next;
+	FileBuff *inputfile;
+	Nfa *nfa;
+	Dfa *dest;
+	
+	/* read pattern file */
+	inputfile = setFileBuff(CHUNK);
+	openAndDetermine(inputfile, patternfilename);
+	len = 0;
+	size = 1048576;
+	buff = smalloc(size);
+	do {
+		if(size <= len + inputfile->bytes) {
+			while(size <= len + inputfile->bytes) {
+				size <<= 1;
+			}
+			if(!(buff = realloc(buff, size))) {
+				ERROR();
+			}
+		}
+		memcpy(buff + len, inputfile->buffer, inputfile->bytes);
+		len += inputfile->bytes;
+	} while(inputfile->buffFileBuff(inputfile));
+	buff[len] = 0;
+	closeFileBuff(inputfile);
+	destroyFileBuff(inputfile);
+	
+	/* one pattern per line, re: marks a regex and glob: is optional */
+	nfa = nfa_init();
+	for(line = buff; *line; line = next) {
+		if((next = strchr(line, '\n'))) {
+			*next++ = 0;
+		} else {
+			next = line + strlen(line);
+		}
+		len = strlen(line);
+		if(len && line[len - 1] == '\r') {
+			line[--len] = 0;
+		}
+		if(!len) {
+			continue;
+		} else if(strncmp(line, "re:", 3) == 0) {
+			nfa_addRegex(nfa, line + 3);
+		} else if(strncmp(line, "glob:", 5) == 0) {
+			nfa_addGlob(nfa, line + 5);
+		} else {
+			nfa_addGlob(nfa, line);
+		}
+	}
+	dest = dfa_compile(nfa);
+	
+	/* clean up */
+	nfa_destroy(nfa);
+	free(buff);
+	
+	return dest;
+}
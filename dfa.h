@@ -0,0 +1,68 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef DFA
+typedef struct nfaState NfaState;
+typedef struct nfa Nfa;
+typedef struct dfa Dfa;
+struct nfaState {
+	int type;
+	int out;
+	int out1;
+	int set;
+};
+struct nfa {
+	int n;
+	int size;
+	int nsets;
+	int setSize;
+	int start;
+	NfaState *states;
+	unsigned *sets; /* 256 bit byte sets */
+	char *pattern; /* pattern under parsing */
+	char *ptr;
+};
+struct dfa {
+	int n;
+	int size;
+	int start;
+	int nclass;
+	unsigned char classes[256]; /* bytes with identical transitions */
+	int *trans; /* state * nclass + class, zero is dead */
+	unsigned char *accept;
+};
+#define DFA 1
+#define NFA_EPS 0
+#define NFA_SPLIT 1
+#define NFA_SET 2
+#define NFA_MATCH 3
+#define NFA_BOL 4
+#define NFA_EOL 5
+#define DFA_MAXSTATES 65536
+#endif
+
+/* glob and regex patterns over read ids, compiled into one dfa */
+Nfa * nfa_init(void);
+void nfa_destroy(Nfa *src);
+int nfa_addGlob(Nfa *dest, char *pattern);
+int nfa_addRegex(Nfa *dest, char *pattern);
+Dfa * dfa_compile(Nfa *src);
+int dfa_match(Dfa *src, char *entry);
+void dfa_destroy(Dfa *src);
+Dfa * getPatterns(char *patternfilename);
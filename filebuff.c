@@ -16,12 +16,20 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
-
+#define _XOPEN_SOURCE 600
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <zlib.h>
+#include "bgzf.h"
+#include "fileio.h"
 #include "filebuff.h"
+#include "gzindex.h"
+#include "gzpar.h"
 #include "pherror.h"
+#include "zstdio.h"
 
 int fileExist(FileBuff *inputfile, char *filename) {
 	
@@ -70,10 +78,71 @@ unsigned char openAndDetermine(FileBuff *inputfile, char *filename) {
 	return *(inputfile->buffer);
 }
 
+static void dropFileBuff(FileBuff *dest, int all) {
+	
+#ifdef POSIX_FADV_DONTNEED
+	long long pos;
+	
+	/* release page cache behind the read cursor */
+	if(!(dest->ioflags & FILEBUFF_DROPCACHE) || (pos = ftello(dest->file)) < 0) {
+		return;
+	} else if(all) {
+		posix_fadvise(fileno(dest->file), dest->dropped, 0, POSIX_FADV_DONTNEED);
+	} else if(dest->dropped + DROPSPAN <= pos) {
+		pos &= ~((long long)(DROPSPAN) - 1);
+		posix_fadvise(fileno(dest->file), dest->dropped, pos - dest->dropped, POSIX_FADV_DONTNEED);
+		dest->dropped = pos;
+	}
+#endif
+}
+
+static void skipgzTrailer(FileBuff *dest) {
+	
+	unsigned skip;
+	z_stream *strm;
+	
+	/* raw inflate leaves the member trailer in the input */
+	strm = dest->strm;
+	skip = 8;
+	while(skip) {
+		if(strm->avail_in == 0) {
+			strm->avail_in = fread(dest->inBuffer, 1, dest->buffSize, dest->file);
+			strm->next_in = (unsigned char*) dest->inBuffer;
+			if(strm->avail_in == 0) {
+				return;
+			}
+		}
+		if(strm->avail_in < skip) {
+			skip -= strm->avail_in;
+			strm->avail_in = 0;
+		} else {
+			strm->next_in += skip;
+			strm->avail_in -= skip;
+			skip = 0;
+		}
+	}
+}
+
+void endFileBuff(FileBuff *dest, long long end) {
+	
+	long long start;
+	
+	/* readers of a shard stop where the next one starts, 0 for no end */
+	dest->end = end;
+	if(end && end < dest->pos) {
+		start = dest->pos - dest->bytes;
+		dest->bytes = start < dest->end ? dest->end - start : 0;
+		dest->pos = start + dest->bytes;
+		dest->z_err = Z_STREAM_END;
+	}
+}
+
 int BuffgzFileBuff(FileBuff *dest) {
 	
 	int status;
+	unsigned char *out;
 	z_stream *strm;
+	GzIndex *index;
 	
 	/* check compressed buffer, and load it */
 	strm = dest->strm;
@@ -85,6 +154,7 @@ int BuffgzFileBuff(FileBuff *dest) {
 			dest->next = dest->buffer;
 			return 0;
 		}
+		dropFileBuff(dest, 0);
 	}
 	
 	/* reset uncompressed buffer */
@@ -92,11 +162,36 @@ int BuffgzFileBuff(FileBuff *dest) {
 	strm->next_out = (unsigned char*) dest->buffer;
 	
 	/* uncompress buffer */
-	status = inflate(strm, Z_NO_FLUSH);
+	if((index = dest->index) && index->window) {
+		/* stop at block boundaries to take checkpoints */
+		do {
+			out = strm->next_out;
+			status = inflate(strm, Z_BLOCK);
+			gzindex_window(index, out, strm->next_out - out);
+			if(status == Z_OK) {
+				gzindex_addpoint(index, strm);
+			}
+		} while(status == Z_OK && strm->avail_out && strm->avail_in);
+	} else {
+		status = inflate(strm, Z_NO_FLUSH);
+	}
 	dest->z_err = status;
 	
 	/* concatenated file */
 	if(status == Z_STREAM_END && strm->avail_out == dest->buffSize) {
+		if(index && index->window) {
+			gzindex_reset(index, strm);
+		}
+		if(index && index->raw) {
+			/* back to gzip wrapper for the next member */
+			index->raw = 0;
+			skipgzTrailer(dest);
+			if(index->window) {
+				index->inbase += 8;
+			}
+			inflateReset2(strm, 15 | ENABLE_ZLIB_GZIP);
+			return BuffgzFileBuff(dest);
+		}
 		inflateReset(strm);
 		return BuffgzFileBuff(dest);
 	}
@@ -104,6 +199,7 @@ int BuffgzFileBuff(FileBuff *dest) {
 	if(status == Z_OK || status == Z_STREAM_END) {
 		dest->bytes = dest->buffSize - strm->avail_out;
 		dest->next = dest->buffer;
+		dest->pos += dest->bytes;
 		if(status == Z_OK && dest->bytes == 0) {
 			return BuffgzFileBuff(dest);
 		}
@@ -112,6 +208,7 @@ int BuffgzFileBuff(FileBuff *dest) {
 		dest->next = dest->buffer;
 		fprintf(stderr, "Gzip error %d\n", status);
 	}
+	endFileBuff(dest, dest->end);
 	
 	return dest->bytes;
 }
@@ -129,7 +226,7 @@ void init_gzFile(FileBuff *inputfile) {
 		inputfile->inBuffer = tmp;
 	} else {
 		inputfile->inBuffer = inputfile->buffer;
-		inputfile->buffer = smalloc(inputfile->buffSize + 1);
+		inputfile->buffer = fileio_alloc(inputfile->buffSize + 1, inputfile->ioflags & FILEBUFF_HUGEPAGES);
 		inputfile->buffer[inputfile->buffSize] = 0;
 	}
 	inputfile->next = inputfile->buffer;
@@ -152,10 +249,320 @@ void init_gzFile(FileBuff *inputfile) {
 	strm->avail_out = 0;
 	inputfile->strm = strm;
 	inputfile->z_err = Z_OK;
+	inputfile->pos = 0;
 	
 	inputfile->bytes = BuffgzFileBuff(inputfile);
 }
 
+int BuffbgzfFileBuff(FileBuff *dest) {
+	
+	int n;
+	Bgzf *bgzf;
+	
+	/* inflate as many whole blocks as fits the buffer */
+	bgzf = dest->bgzf;
+	do {
+		if(bgzf->avail < bgzf->inSize) {
+			bgzf->avail += fread(bgzf->in + bgzf->avail, 1, bgzf->inSize - bgzf->avail, dest->file);
+			dropFileBuff(dest, 0);
+		}
+		if((n = bgzf_cut(bgzf)) < 0 || (n == 0 && bgzf->avail)) {
+			dest->z_err = Z_DATA_ERROR;
+		} else if(0 <= (dest->bytes = bgzf_inflate(bgzf, dest->buffer))) {
+			dest->z_err = (n == 0) ? Z_STREAM_END : Z_OK;
+			dest->pos += dest->bytes;
+			continue;
+		}
+		fprintf(stderr, "Gzip error %d\n", Z_DATA_ERROR);
+		dest->bytes = 0;
+		n = 0;
+	} while(dest->bytes == 0 && n);
+	dest->next = dest->buffer;
+	endFileBuff(dest, dest->end);
+	
+	return dest->bytes;
+}
+
+int seekbgzfFileBuff(FileBuff *dest, long long in, long long out) {
+	
+	/* restart at the block at "in", which inflates to "out" onwards */
+	if(dest->buffFileBuff != &BuffbgzfFileBuff || fseeko(dest->file, in, SEEK_SET)) {
+		return 1;
+	}
+	dest->bgzf->avail = 0;
+	dest->bgzf->n = 0;
+	dest->z_err = Z_OK;
+	dest->pos = out;
+	dest->bytes = 0;
+	dest->next = dest->buffer;
+	
+	return 0;
+}
+
+void init_bgzfFile(FileBuff *inputfile) {
+	
+	Bgzf *bgzf;
+	
+	/* independent blocks, inflated by several threads */
+	bgzf = bgzf_init(inputfile->buffSize / BGZF_BLOCKSIZE, inputfile->thread_num);
+	memcpy(bgzf->in, inputfile->buffer, inputfile->bytes);
+	bgzf->avail = inputfile->bytes;
+	inputfile->bgzf = bgzf;
+	inputfile->buffFileBuff = &BuffbgzfFileBuff;
+	inputfile->pos = 0;
+	if(!(inputfile->bytes = BuffbgzfFileBuff(inputfile))) {
+		inputfile->buffer[0] = 0;
+	}
+}
+
+int BuffzstdFileBuff(FileBuff *dest) {
+	
+	Zstd *zstd;
+	
+	/* decompress until output is made, or the input is used */
+	zstd = dest->zstd;
+	do {
+		if(zstd->avail < zstd->inSize) {
+			zstd->avail += fread(zstd->in + zstd->avail, 1, zstd->inSize - zstd->avail, dest->file);
+			dropFileBuff(dest, 0);
+		}
+		if((dest->bytes = zstd_decompress(zstd, dest->buffer, dest->buffSize)) < 0) {
+			dest->z_err = Z_DATA_ERROR;
+			dest->bytes = 0;
+			break;
+		}
+		dest->pos += dest->bytes;
+	} while(dest->bytes == 0 && (zstd->avail || !(feof(dest->file) || ferror(dest->file))));
+	if(dest->bytes) {
+		dest->z_err = Z_OK;
+	} else if(dest->z_err != Z_DATA_ERROR) {
+		dest->z_err = zstd->hint ? Z_BUF_ERROR : Z_STREAM_END;
+	}
+	dest->next = dest->buffer;
+	
+	return dest->bytes;
+}
+
+void init_zstdFile(FileBuff *inputfile) {
+	
+	Zstd *zstd;
+	
+	/* compressed input is kept apart, like bgzf */
+	zstd = zstd_init(inputfile->buffSize, inputfile->thread_num);
+	memcpy(zstd->in, inputfile->buffer, inputfile->bytes);
+	zstd->avail = inputfile->bytes;
+	inputfile->zstd = zstd;
+	inputfile->buffFileBuff = &BuffzstdFileBuff;
+	inputfile->z_err = Z_OK;
+	inputfile->pos = 0;
+	if(!(inputfile->bytes = BuffzstdFileBuff(inputfile))) {
+		inputfile->buffer[0] = 0;
+	}
+}
+
+int BuffgzparFileBuff(FileBuff *dest) {
+	
+	/* chunks inflated ahead by several threads, see gzpar.c */
+	if(dest->z_err == Z_DATA_ERROR) {
+		dest->bytes = 0;
+	} else if((dest->bytes = gzpar_read(dest->gzpar, dest->buffer, dest->buffSize)) < 0) {
+		fprintf(stderr, "Gzip error %d\n", Z_DATA_ERROR);
+		dest->z_err = Z_DATA_ERROR;
+		dest->bytes = 0;
+	} else {
+		dest->z_err = dest->bytes ? Z_OK : Z_STREAM_END;
+	}
+	dest->pos += dest->bytes;
+	dest->next = dest->buffer;
+	
+	/* keep the file offset on the compressed progress */
+	fseeko(dest->file, dest->gzpar->in, SEEK_SET);
+	dropFileBuff(dest, 0);
+	
+	return dest->bytes;
+}
+
+void init_gzparFile(FileBuff *inputfile) {
+	
+	/* plain gzip in a regular file, read by pread from its start */
+	inputfile->gzpar = gzpar_init(fileno(inputfile->file), inputfile->thread_num);
+	inputfile->buffFileBuff = &BuffgzparFileBuff;
+	inputfile->z_err = Z_OK;
+	inputfile->pos = 0;
+	if(!(inputfile->bytes = BuffgzparFileBuff(inputfile))) {
+		inputfile->buffer[0] = 0;
+	}
+}
+
+int BuffrangeFileBuff(FileBuff *dest) {
+	
+	long long len;
+	
+	/* pread up to the end of the range, the file offset is shared */
+	len = dest->end - dest->pos;
+	len = len < dest->buffSize ? len : dest->buffSize;
+	if(len <= 0 || (dest->bytes = pread(fileno(dest->file), dest->buffer, len, dest->pos)) < 0) {
+		dest->bytes = 0;
+	}
+	dest->pos += dest->bytes;
+	dest->next = dest->buffer;
+	
+	return dest->bytes;
+}
+
+void rangeFileBuff(FileBuff *dest, FILE *file, long long start, long long end) {
+	
+	/* read [start, end) of a file opened elsewhere, by threads of their own */
+	dest->file = file;
+	dest->pos = start;
+	dest->end = end;
+	dest->bytes = 0;
+	dest->next = dest->buffer;
+	dest->buffFileBuff = &BuffrangeFileBuff;
+}
+
+void sharegzFileBuff(FileBuff *dest, char *filename, GzIndex *index) {
+	
+	/* read gzip input by a thread of its own, seeking from the complete index of another reader */
+	openFileBuff(dest, filename, "rb");
+	dest->bytes = 0;
+	init_gzFile(dest);
+	dest->buffFileBuff = &BuffgzFileBuff;
+	dest->index = gzindex_share(index);
+}
+
+void gzindexFileBuff(FileBuff *dest, char *filename) {
+	
+	/* use stored checkpoints, or take them while reading */
+	if(dest->index) {
+		gzindex_destroy(dest->index);
+	}
+	if(!(dest->index = gzindex_load(filename, dest->gzspan))) {
+		dest->index = gzindex_init(filename, dest->gzspan);
+	}
+}
+
+static int restoregzFileBuff(FileBuff *dest, GzPoint *point) {
+	
+	int c;
+	z_stream *strm;
+	
+	if(fseeko(dest->file, point->in - (point->bits ? 1 : 0), SEEK_SET)) {
+		return 1;
+	}
+	
+	/* restore inflate state */
+	strm = dest->strm;
+	strm->avail_in = 0;
+	inflateReset2(strm, -15);
+	if(point->bits) {
+		if((c = getc(dest->file)) == EOF) {
+			return 1;
+		}
+		inflatePrime(strm, point->bits, c >> (8 - point->bits));
+	}
+	inflateSetDictionary(strm, point->window, WINSIZE);
+	if(dest->index->window) {
+		/* keep indexing from the access point */
+		gzindex_rebase(dest->index, point);
+	}
+	dest->index->raw = 1;
+	dest->z_err = Z_OK;
+	dest->pos = point->out;
+	dest->bytes = 0;
+	dest->next = dest->buffer;
+	
+	return 0;
+}
+
+static int skipFileBuff(FileBuff *dest, long long offset) {
+	
+	/* read forward up to offset */
+	if((offset -= dest->pos - dest->bytes) < 0) {
+		return 1;
+	}
+	while(dest->bytes <= offset) {
+		offset -= dest->bytes;
+		if(dest->buffFileBuff(dest) == 0) {
+			dest->bytes = 0;
+			return offset != 0;
+		}
+	}
+	dest->next += offset;
+	dest->bytes -= offset;
+	
+	return 0;
+}
+
+int indexgzFileBuff(FileBuff *dest) {
+	
+	GzIndex *index;
+	
+	/* finish the index by reading all of the file, and start over */
+	if(dest->buffFileBuff != &BuffgzFileBuff || !(index = dest->index)) {
+		return 1;
+	} else if(index->window) {
+		while(BuffgzFileBuff(dest));
+		if(dest->z_err != Z_STREAM_END || !feof(dest->file) || index->partial) {
+			return 1;
+		}
+		if(!(dest->ioflags & FILEBUFF_GZMEMORY)) {
+			gzindex_save(index);
+		}
+		free(index->window);
+		index->window = 0;
+	}
+	if(fseeko(dest->file, 0, SEEK_SET)) {
+		return 1;
+	}
+	inflateReset2(dest->strm, 15 | ENABLE_ZLIB_GZIP);
+	dest->strm->avail_in = 0;
+	index->raw = 0;
+	dest->z_err = Z_OK;
+	dest->pos = 0;
+	dest->bytes = BuffgzFileBuff(dest);
+	
+	return 0;
+}
+
+long long tellFileBuff(FileBuff *src, GzPoint *point) {
+	
+	long long offset;
+	GzPoint *last;
+	
+	/* offset of next, and the last access point before it */
+	offset = src->pos - src->bytes;
+	if(point) {
+		if(src->buffFileBuff == &BuffgzFileBuff && src->index && (last = gzindex_point(src->index, offset))) {
+			*point = *last;
+		} else {
+			memset(point, 0, sizeof(GzPoint));
+		}
+	}
+	
+	return offset;
+}
+
+int seekFileBuff(FileBuff *dest, long long offset, GzPoint *point) {
+	
+	/* plain files seek directly, gzip from the access point before offset */
+	if(dest->buffFileBuff == &buff_FileBuff) {
+		if(fseeko(dest->file, offset, SEEK_SET)) {
+			return 1;
+		}
+		dest->pos = offset;
+		dest->bytes = 0;
+		dest->next = dest->buffer;
+		return 0;
+	} else if(point && point->window && dest->buffFileBuff == &BuffgzFileBuff && dest->index && dest->pos - dest->bytes <= point->out) {
+		if(restoregzFileBuff(dest, point)) {
+			return 1;
+		}
+	}
+	
+	return skipFileBuff(dest, offset);
+}
+
 FileBuff * setFileBuff(int buffSize) {
 	
 	FileBuff *dest;
@@ -163,26 +570,66 @@ FileBuff * setFileBuff(int buffSize) {
 	dest = smalloc(sizeof(FileBuff));
 	dest->bytes = 0;
 	dest->buffSize = buffSize;
+	dest->pos = 0;
 	dest->buffer = smalloc(buffSize);
 	dest->inBuffer = 0;
 	dest->next = dest->buffer;
 	dest->file = 0;
 	dest->strm = 0;
 	dest->z_err = 0;
+	dest->gzspan = 0;
+	dest->index = 0;
+	dest->thread_num = 1;
+	dest->ioflags = 0;
+	dest->ioSize = 0;
+	dest->dropped = 0;
+	dest->end = 0;
+	dest->bgzf = 0;
+	dest->zstd = 0;
+	dest->gzpar = 0;
 	dest->buffFileBuff = &buff_FileBuff;
 	
 	return dest;
 }
 
+void ioFileBuff(FileBuff *dest, int ioflags, int ioSize) {
+	
+	/* applies to files opened from here on */
+	dest->ioflags = ioflags;
+	dest->ioSize = ioSize;
+	if(ioflags & FILEBUFF_HUGEPAGES) {
+		free(dest->buffer);
+		dest->buffer = fileio_alloc(dest->buffSize, 1);
+		dest->next = dest->buffer;
+	}
+}
+
 void openFileBuff(FileBuff *dest, char *filename, char *mode) {
+	
+	dest->dropped = 0;
+	dest->end = 0;
 	if(*filename == '-' && filename[1] == 0) {
 		if(*mode == 'r') {
 			dest->file = stdin;
 		} else {
 			dest->file = stdout;
 		}
+	} else if(*mode == 'r' && (dest->ioflags & FILEBUFF_DIRECT) && (dest->file = fileio_direct(filename, dest->ioSize ? dest->ioSize : CHUNK))) {
+		return;
 	} else {
 		dest->file = sfopen(filename, mode);
+		if(dest->ioSize) {
+			setvbuf(dest->file, NULL, _IOFBF, dest->ioSize);
+		}
+#ifdef POSIX_FADV_SEQUENTIAL
+		if(*mode == 'r') {
+			/* read ahead, and keep other jobs cached on request */
+			posix_fadvise(fileno(dest->file), 0, 0, POSIX_FADV_SEQUENTIAL);
+			if(dest->ioflags & FILEBUFF_DROPCACHE) {
+				posix_fadvise(fileno(dest->file), 0, 0, POSIX_FADV_NOREUSE);
+			}
+		}
+#endif
 	}
 }
 
@@ -198,8 +645,35 @@ void closeFileBuff(FileBuff *dest) {
 			fprintf(stderr, "Unexpected end of file\n");
 		}
 		dest->strm->avail_out = 0;
+		if(dest->index) {
+			/* store checkpoints of completely read file */
+			if(dest->index->window && !dest->index->partial && !(dest->ioflags & FILEBUFF_GZMEMORY) && dest->z_err == Z_STREAM_END && feof(dest->file)) {
+				gzindex_save(dest->index);
+			}
+			gzindex_destroy(dest->index);
+			dest->index = 0;
+		}
+	} else if(dest->bgzf) {
+		if(dest->z_err != Z_STREAM_END && dest->bytes == 0) {
+			fprintf(stderr, "Unexpected end of file\n");
+		}
+		bgzf_destroy(dest->bgzf);
+		dest->bgzf = 0;
+	} else if(dest->zstd) {
+		if(dest->z_err != Z_STREAM_END && dest->bytes == 0) {
+			fprintf(stderr, "Unexpected end of file\n");
+		}
+		zstd_destroy(dest->zstd);
+		dest->zstd = 0;
+	} else if(dest->gzpar) {
+		if(dest->z_err != Z_STREAM_END && dest->bytes == 0) {
+			fprintf(stderr, "Unexpected end of file\n");
+		}
+		gzpar_destroy(dest->gzpar);
+		dest->gzpar = 0;
 	}
 	
+	dropFileBuff(dest, 1);
 	fclose(dest->file);
 	dest->file = 0;
 }
@@ -220,6 +694,18 @@ void gzcloseFileBuff(FileBuff *dest) {
 }
 
 void destroyFileBuff(FileBuff *dest) {
+	if(dest->index) {
+		gzindex_destroy(dest->index);
+	}
+	if(dest->bgzf) {
+		bgzf_destroy(dest->bgzf);
+	}
+	if(dest->zstd) {
+		zstd_destroy(dest->zstd);
+	}
+	if(dest->gzpar) {
+		gzpar_destroy(dest->gzpar);
+	}
 	free(dest->buffer);
 	free(dest->inBuffer);
 	free(dest->strm);
@@ -230,6 +716,8 @@ int buff_FileBuff(FileBuff *dest) {
 	
 	dest->bytes = fread(dest->buffer, 1, dest->buffSize, dest->file);
 	dest->next = dest->buffer;
+	dest->pos += dest->bytes;
+	dropFileBuff(dest, 0);
 	return dest->bytes;
 }
 
@@ -260,10 +748,21 @@ FileBuff * gzInitFileBuff(int size) {
 	dest->file = 0;
 	dest->bytes = size;
 	dest->buffSize = size;
+	dest->pos = 0;
 	dest->strm = strm_init();
 	dest->buffer = smalloc(size);
 	dest->inBuffer = smalloc(size);
 	dest->next = dest->buffer;
+	dest->gzspan = 0;
+	dest->index = 0;
+	dest->thread_num = 1;
+	dest->ioflags = 0;
+	dest->ioSize = 0;
+	dest->dropped = 0;
+	dest->end = 0;
+	dest->bgzf = 0;
+	dest->zstd = 0;
+	dest->gzpar = 0;
 	
 	return dest;
 }
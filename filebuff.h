@@ -19,22 +19,42 @@
 
 #include <stdio.h>
 #include <zlib.h>
+#include "bgzf.h"
+#include "gzindex.h"
+#include "gzpar.h"
+#include "zstdio.h"
 
 #ifndef FILEBUFF
 typedef struct fileBuff FileBuff;
 struct fileBuff {
 	int bytes;
 	int buffSize;
+	long long pos; /* uncompressed offset of the end of buffer */
 	unsigned char *buffer;
 	unsigned char *inBuffer;
 	unsigned char *next;
 	FILE *file;
 	z_stream *strm;
 	int z_err;
+	long long gzspan;
+	GzIndex *index;
+	int thread_num;
+	int ioflags;
+	int ioSize;
+	long long dropped; /* page cache is released up to here */
+	long long end; /* byte ranges and shards are read up to here */
+	Bgzf *bgzf;
+	Zstd *zstd;
+	GzPar *gzpar;
 	int (*buffFileBuff)(FileBuff *);
 };
 #define FILEBUFF 1
 #define CHUNK 1048576
+#define FILEBUFF_DIRECT 1
+#define FILEBUFF_DROPCACHE 2
+#define FILEBUFF_HUGEPAGES 4
+#define FILEBUFF_GZMEMORY 8 /* gzip index is kept in memory, not stored with the input */
+#define DROPSPAN 16777216
 #define GZIP_ENCODING 16
 #define ENABLE_ZLIB_GZIP 32
 #endif
@@ -43,7 +63,23 @@ int fileExist(FileBuff *inputfile, char *filename);
 unsigned char openAndDetermine(FileBuff *inputfile, char *filename);
 int BuffgzFileBuff(FileBuff *dest);
 void init_gzFile(FileBuff *inputfile);
+void gzindexFileBuff(FileBuff *dest, char *filename);
+void sharegzFileBuff(FileBuff *dest, char *filename, GzIndex *index);
+int BuffrangeFileBuff(FileBuff *dest);
+void rangeFileBuff(FileBuff *dest, FILE *file, long long start, long long end);
+void endFileBuff(FileBuff *dest, long long end);
+int BuffbgzfFileBuff(FileBuff *dest);
+void init_bgzfFile(FileBuff *inputfile);
+int seekbgzfFileBuff(FileBuff *dest, long long in, long long out);
+int BuffzstdFileBuff(FileBuff *dest);
+void init_zstdFile(FileBuff *inputfile);
+int BuffgzparFileBuff(FileBuff *dest);
+void init_gzparFile(FileBuff *inputfile);
+int indexgzFileBuff(FileBuff *dest);
+long long tellFileBuff(FileBuff *src, GzPoint *point);
+int seekFileBuff(FileBuff *dest, long long offset, GzPoint *point);
 FileBuff * setFileBuff(int buffSize);
+void ioFileBuff(FileBuff *dest, int ioflags, int ioSize);
 void openFileBuff(FileBuff *dest, char *filename, char *mode);
 void closeFileBuff(FileBuff *dest);
 void gzcloseFileBuff(FileBuff *dest);
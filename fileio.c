@@ -0,0 +1,229 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _GNU_SOURCE
+#define _DARWIN_C_SOURCE
+#include "pherror.h" /* before system headers, which raise _XOPEN_SOURCE */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "fileio.h"
+
+#ifdef __linux__
+static ssize_t direct_fill(DirectFile *src) {
+	
+	ssize_t n;
+	
+	/* aligned read into the bounce buffer */
+	src->pos += src->avail;
+	src->next = 0;
+	while((n = read(src->fd, src->buffer, src->size)) < 0 && errno == EINTR);
+	if(n < 0 && errno == EINVAL) {
+		/* unaligned offset after a short read, continue buffered */
+		fcntl(src->fd, F_SETFL, fcntl(src->fd, F_GETFL) & ~O_DIRECT);
+		n = read(src->fd, src->buffer, src->size);
+	}
+	src->avail = n < 0 ? 0 : n;
+	
+	return n;
+}
+
+static ssize_t direct_read(void *cookie, char *buf, size_t size) {
+	
+	size_t len, cpy;
+	DirectFile *src;
+	
+	src = cookie;
+	len = 0;
+	while(len < size) {
+		if(src->next == src->avail) {
+			if(direct_fill(src) < 0) {
+				return len ? (ssize_t) len : -1;
+			} else if(src->avail == 0) {
+				break;
+			}
+		}
+		cpy = src->avail - src->next;
+		if(size - len < cpy) {
+			cpy = size - len;
+		}
+		memcpy(buf + len, src->buffer + src->next, cpy);
+		src->next += cpy;
+		len += cpy;
+	}
+	
+	return len;
+}
+
+static int direct_seek(void *cookie, off64_t *offset, int whence) {
+	
+	long long pos;
+	struct stat st;
+	DirectFile *src;
+	
+	src = cookie;
+	if(whence == SEEK_CUR) {
+		pos = src->pos + src->next + *offset;
+		if(*offset == 0) {
+			*offset = pos;
+			return 0;
+		}
+	} else if(whence == SEEK_END) {
+		if(fstat(src->fd, &st)) {
+			return -1;
+		}
+		pos = st.st_size + *offset;
+	} else {
+		pos = *offset;
+	}
+	if(pos < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	/* reread the aligned block holding pos */
+	src->avail = 0;
+	src->pos = pos & ~((long long)(DIRECT_ALIGN) - 1);
+	if(lseek(src->fd, src->pos, SEEK_SET) < 0 || direct_fill(src) < 0) {
+		return -1;
+	}
+	src->next = pos - src->pos < src->avail ? pos - src->pos : src->avail;
+	*offset = pos;
+	
+	return 0;
+}
+
+static int direct_close(void *cookie) {
+	
+	int status;
+	DirectFile *src;
+	
+	src = cookie;
+	status = close(src->fd);
+	free(src->buffer);
+	free(src);
+	
+	return status;
+}
+
+FILE * fileio_direct(const char *filename, int size) {
+	
+	int fd;
+	FILE *dest;
+	DirectFile *src;
+	cookie_io_functions_t io = {&direct_read, NULL, &direct_seek, &direct_close};
+	
+	/* not all file systems support O_DIRECT */
+	if((fd = open(filename, O_RDONLY | O_DIRECT)) < 0) {
+		return 0;
+	}
+	src = smalloc(sizeof(DirectFile));
+	src->fd = fd;
+	src->size = size < DIRECT_ALIGN ? DIRECT_ALIGN : (size & ~(DIRECT_ALIGN - 1));
+	src->avail = 0;
+	src->next = 0;
+	src->pos = 0;
+	if((errno = posix_memalign((void **) &src->buffer, DIRECT_ALIGN, src->size))) {
+		ERROR();
+	}
+	if(!(dest = fopencookie(src, "rb", io))) {
+		ERROR();
+	}
+	
+	return dest;
+}
+#else
+FILE * fileio_direct(const char *filename, int size) {
+	
+	/* no O_DIRECT, read through stdio */
+	return 0;
+}
+#endif
+
+#ifdef FILEIO_FUNOPEN
+static int fileio_funwrite(void *cookie, const char *buf, int size) {
+	
+	FileioWriter *src;
+	
+	src = cookie;
+	
+	return src->write(src->cookie, buf, size);
+}
+
+static int fileio_funclose(void *cookie) {
+	
+	int status;
+	FileioWriter *src;
+	
+	src = cookie;
+	status = src->close(src->cookie);
+	free(src);
+	
+	return status;
+}
+#endif
+
+FILE * fileio_writer(void *cookie, ssize_t (*write)(void *, const char *, size_t), int (*close)(void *)) {
+	
+	FILE *dest;
+#ifdef FILEIO_FUNOPEN
+	FileioWriter *writer;
+	
+	/* funopen takes int sizes, so calls are passed on */
+	writer = smalloc(sizeof(FileioWriter));
+	writer->cookie = cookie;
+	writer->write = write;
+	writer->close = close;
+	if(!(dest = funopen(writer, NULL, &fileio_funwrite, NULL, &fileio_funclose))) {
+		ERROR();
+	}
+#else
+	cookie_io_functions_t io = {NULL, write, NULL, close};
+	
+	if(!(dest = fopencookie(cookie, "wb", io))) {
+		ERROR();
+	}
+#endif
+	
+	return dest;
+}
+
+void * fileio_alloc(size_t size, int huge) {
+	
+	void *dest;
+	
+	if(!huge) {
+		return smalloc(size);
+	}
+	
+	/* aligned to huge pages, and advised to be backed by transparent ones */
+	if((errno = posix_memalign(&dest, HUGEPAGE, size))) {
+		ERROR();
+	}
+#ifdef MADV_HUGEPAGE
+	madvise(dest, size, MADV_HUGEPAGE);
+#endif
+	
+	return dest;
+}
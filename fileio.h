@@ -0,0 +1,52 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#ifndef FILEIO
+typedef struct directFile DirectFile;
+typedef struct fileioWriter FileioWriter;
+struct directFile {
+	int fd;
+	int size; /* read size, multiple of DIRECT_ALIGN */
+	int avail;
+	int next;
+	long long pos; /* file offset of buffer */
+	unsigned char *buffer;
+};
+struct fileioWriter {
+	void *cookie;
+	ssize_t (*write)(void *, const char *, size_t);
+	int (*close)(void *);
+};
+#define FILEIO 1
+#define DIRECT_ALIGN 4096
+#define HUGEPAGE 2097152
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+#define FILEIO_FUNOPEN 1
+#endif
+#endif
+
+/* unbuffered O_DIRECT reads behind a stdio stream */
+FILE * fileio_direct(const char *filename, int size);
+/* write only stream calling write and close, fopencookie or funopen */
+FILE * fileio_writer(void *cookie, ssize_t (*write)(void *, const char *, size_t), int (*close)(void *));
+/* buffers, optionally aligned for transparent huge pages */
+void * fileio_alloc(size_t size, int huge);
@@ -0,0 +1,445 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _XOPEN_SOURCE 600
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fqapi.h"
+#include "qseqs.h"
+#include "ranges.h"
+#include "targets.h"
+
+FqgrepCtx * fqgrep_ctx_new(int engine, int thread_num, unsigned invert) {
+	
+	FqgrepCtx *dest;
+	
+	if(engine < TARGET_AUTO || TARGET_PACKED < engine || !(dest = malloc(sizeof(FqgrepCtx)))) {
+		return 0;
+	}
+	dest->engine = engine;
+	dest->thread_num = thread_num < 1 ? 1 : thread_num;
+	dest->invert = invert & 1;
+	dest->len = 0;
+	dest->size = 0;
+	dest->arena = 0;
+	dest->targets = 0;
+	
+	return dest;
+}
+
+static int fqapi_checkline(const char *line, long len) {
+	
+	int kind;
+	long i;
+	char *tmp;
+	
+	/* only lo..hi lines can be invalid, and the index build exits on them */
+	while(len && isspace(line[len - 1])) {
+		--len;
+	}
+	for(i = 1; i < len && !(line[i - 1] == '.' && line[i] == '.'); ++i);
+	if(len <= i) {
+		return FQGREP_OK;
+	} else if(!(tmp = malloc(len + 1))) {
+		return FQGREP_ENOMEM;
+	}
+	memcpy(tmp, line, len);
+	tmp[len] = 0;
+	kind = ranges_check(tmp);
+	free(tmp);
+	
+	return kind < 0 ? FQGREP_EINVAL : FQGREP_OK;
+}
+
+int fqgrep_add_targets(FqgrepCtx *ctx, const char *buff, long len) {
+	
+	int err;
+	long size;
+	const char *line, *next, *end;
+	char *arena;
+	
+	if(!ctx || len < 0 || (!buff && len)) {
+		return FQGREP_EINVAL;
+	} else if(ctx->targets) {
+		return FQGREP_ESTATE;
+	}
+	
+	/* newline separated ids, prefix* or lo..hi */
+	end = buff + len;
+	for(line = buff; line < end; line = next + 1) {
+		if(!(next = memchr(line, '\n', end - line))) {
+			next = end;
+		}
+		if((err = fqapi_checkline(line, next - line))) {
+			return err;
+		}
+	}
+	
+	/* copy, keeping calls on separate lines */
+	if(ctx->size <= ctx->len + len + 1) {
+		size = ctx->size ? ctx->size : 1048576;
+		while(size <= ctx->len + len + 1) {
+			size <<= 1;
+		}
+		if(!(arena = realloc(ctx->arena, size))) {
+			return FQGREP_ENOMEM;
+		}
+		ctx->arena = arena;
+		ctx->size = size;
+	}
+	if(ctx->len && ctx->arena[ctx->len - 1] != '\n') {
+		ctx->arena[ctx->len++] = '\n';
+	}
+	memcpy(ctx->arena + ctx->len, buff, len);
+	ctx->len += len;
+	
+	return FQGREP_OK;
+}
+
+int fqgrep_ctx_build(FqgrepCtx *ctx) {
+	
+	Target *targets;
+	
+	if(!ctx) {
+		return FQGREP_EINVAL;
+	} else if(ctx->targets) {
+		return FQGREP_ESTATE;
+	}
+	
+	/* the index takes over the added targets */
+	if(!(targets = target_malloc(1))) {
+		return FQGREP_ENOMEM;
+	} else if(ctx->arena) {
+		free(targets->arena);
+		targets->arena = ctx->arena;
+		targets->arenaSize = ctx->size;
+		targets->len = ctx->len;
+		ctx->arena = 0;
+		ctx->len = 0;
+		ctx->size = 0;
+	}
+	if(target_index(targets, ctx->thread_num)) {
+		target_destroy(targets);
+		return FQGREP_ENOMEM;
+	}
+	target_engine(targets, ctx->engine);
+	ctx->targets = targets;
+	
+	return FQGREP_OK;
+}
+
+long fqgrep_match(FqgrepCtx *ctx, const char *id) {
+	
+	if(!ctx || !id) {
+		return FQGREP_EINVAL;
+	} else if(!ctx->targets) {
+		return FQGREP_ESTATE;
+	}
+	
+	return target_grep(ctx->targets, (char *) id);
+}
+
+long fqgrep_match_batch(FqgrepCtx *ctx, const char **ids, long n, long *hits) {
+	
+	long i, count;
+	
+	if(!ctx || n < 0 || (n && (!ids || !hits))) {
+		return FQGREP_EINVAL;
+	} else if(!ctx->targets) {
+		return FQGREP_ESTATE;
+	}
+	
+	/* index of the matching target, or -1 */
+	target_grep_batch(ctx->targets, (char **) ids, hits, n);
+	count = 0;
+	for(i = 0; i < n; ++i) {
+		count += 0 <= hits[i];
+	}
+	
+	return count;
+}
+
+void fqgrep_ctx_free(FqgrepCtx *ctx) {
+	
+	if(ctx) {
+		if(ctx->targets) {
+			target_destroy(ctx->targets);
+		}
+		free(ctx->arena);
+		free(ctx);
+	}
+}
+
+static Qseqs * fqapi_qseqs(int size) {
+	
+	Qseqs *dest;
+	
+	if(!(dest = malloc(sizeof(Qseqs)))) {
+		return 0;
+	} else if(!(dest->seq = malloc(size))) {
+		free(dest);
+		return 0;
+	}
+	dest->len = 0;
+	dest->size = size;
+	
+	return dest;
+}
+
+static int fqapi_append(Qseqs *dest, const char *src, long len) {
+	
+	long size;
+	unsigned char *seq;
+	
+	if(dest->size < dest->len + len) {
+		size = dest->size;
+		while(size < dest->len + len) {
+			size <<= 1;
+		}
+		if(INT_MAX < size || !(seq = realloc(dest->seq, size))) {
+			return FQGREP_ENOMEM;
+		}
+		dest->seq = seq;
+		dest->size = size;
+	}
+	memcpy(dest->seq + dest->len, src, len);
+	dest->len += len;
+	
+	return FQGREP_OK;
+}
+
+FqgrepStream * fqgrep_stream_new(FqgrepCtx *ctx) {
+	
+	FqgrepStream *dest;
+	
+	if(!ctx || !(dest = calloc(1, sizeof(FqgrepStream)))) {
+		return 0;
+	}
+	dest->ctx = ctx;
+	if(!(dest->carry = fqapi_qseqs(1024)) || !(dest->tail = fqapi_qseqs(1024))) {
+		fqgrep_stream_free(dest);
+		return 0;
+	}
+	
+	return dest;
+}
+
+static int fqapi_grow(FqgrepStream *src, long m) {
+	
+	long size;
+	void *recs, *recLen, *hits, *spans, *spanLen;
+	
+	/* records and spans of one buffer */
+	if(m <= src->mSize) {
+		return FQGREP_OK;
+	}
+	size = src->mSize ? src->mSize : 1024;
+	while(size < m) {
+		size <<= 1;
+	}
+	recs = realloc(src->recs, size * sizeof(char *));
+	src->recs = recs ? recs : src->recs;
+	recLen = realloc(src->recLen, size * sizeof(long));
+	src->recLen = recLen ? recLen : src->recLen;
+	hits = realloc(src->hits, size * sizeof(long));
+	src->hits = hits ? hits : src->hits;
+	spans = realloc(src->spans, size * sizeof(char *));
+	src->spans = spans ? spans : src->spans;
+	spanLen = realloc(src->spanLen, size * sizeof(long));
+	src->spanLen = spanLen ? spanLen : src->spanLen;
+	if(!recs || !recLen || !hits || !spans || !spanLen) {
+		return FQGREP_ENOMEM;
+	}
+	src->mSize = size;
+	
+	return FQGREP_OK;
+}
+
+static int fqapi_addrecord(FqgrepStream *src, const char *rec, long len) {
+	
+	if(src->m == src->mSize && fqapi_grow(src, src->m + 1)) {
+		return FQGREP_ENOMEM;
+	}
+	src->recs[src->m] = rec;
+	src->recLen[src->m++] = len;
+	
+	return FQGREP_OK;
+}
+
+static const char * fqapi_recordEnd(const char *ptr, const char *end, int *lines) {
+	
+	const char *nl;
+	
+	/* past the fourth newline of the record, as far as the buffer goes */
+	while(*lines < 4 && ptr < end && (nl = memchr(ptr, '\n', end - ptr))) {
+		ptr = nl + 1;
+		++*lines;
+	}
+	
+	return ptr;
+}
+
+long fqgrep_push_buffer(FqgrepStream *stream, const char *buff, long len, int last) {
+	
+	int lines;
+	long i, count;
+	const char *ptr, *next, *end;
+	Qseqs *carry;
+	
+	if(!stream || len < 0 || (!buff && len)) {
+		return FQGREP_EINVAL;
+	} else if(!stream->ctx->targets) {
+		return FQGREP_ESTATE;
+	}
+	
+	/* spans of the previous buffer expire now */
+	carry = stream->tail;
+	stream->tail = stream->carry;
+	stream->carry = carry;
+	stream->tail->len = 0;
+	stream->m = 0;
+	stream->n = 0;
+	stream->next = 0;
+	ptr = buff;
+	end = buff + len;
+	
+	/* finish the record split over the previous buffer */
+	if(carry->len) {
+		lines = stream->lines;
+		next = fqapi_recordEnd(ptr, end, &lines);
+		if(lines < 4) {
+			next = end;
+		}
+		if(fqapi_append(carry, ptr, next - ptr)) {
+			return FQGREP_ENOMEM;
+		} else if(lines < 4 && !last) {
+			/* still incomplete, keep it for the next buffer */
+			stream->carry = stream->tail;
+			stream->tail = carry;
+			stream->lines = lines;
+			return 0;
+		} else if(lines < 3) {
+			return FQGREP_EFORMAT;
+		} else if(fqapi_addrecord(stream, (char *)(carry->seq), carry->len)) {
+			return FQGREP_ENOMEM;
+		}
+		ptr = next;
+	}
+	
+	/* whole records are used in place */
+	while(ptr < end) {
+		if(*ptr != '@') {
+			return FQGREP_EFORMAT;
+		}
+		lines = 0;
+		next = fqapi_recordEnd(ptr, end, &lines);
+		if(lines < 4 && !last) {
+			if(fqapi_append(stream->tail, ptr, end - ptr)) {
+				return FQGREP_ENOMEM;
+			}
+			stream->lines = lines;
+			break;
+		} else if(lines < 3) {
+			return FQGREP_EFORMAT;
+		} else if(lines < 4) {
+			next = end;
+		}
+		if(fqapi_addrecord(stream, ptr, next - ptr)) {
+			return FQGREP_ENOMEM;
+		}
+		ptr = next;
+	}
+	
+	/* look up ids, the header line ends them */
+	for(i = 0; i < stream->m; ++i) {
+		stream->spans[i] = stream->recs[i] + 1;
+	}
+	target_grep_batch(stream->ctx->targets, (char **) stream->spans, stream->hits, stream->m);
+	
+	/* matching records, neighbours in memory are joined */
+	count = 0;
+	for(i = 0; i < stream->m; ++i) {
+		if((stream->ctx->invert ^ (0 <= stream->hits[i])) & 1) {
+			if(stream->n && stream->spans[stream->n - 1] + stream->spanLen[stream->n - 1] == stream->recs[i]) {
+				stream->spanLen[stream->n - 1] += stream->recLen[i];
+			} else {
+				stream->spans[stream->n] = stream->recs[i];
+				stream->spanLen[stream->n++] = stream->recLen[i];
+			}
+			++count;
+		}
+	}
+	
+	return count;
+}
+
+int fqgrep_pull_output(FqgrepStream *stream, const char **ptr, long *len) {
+	
+	if(!stream || !ptr || !len) {
+		return FQGREP_EINVAL;
+	} else if(stream->n <= stream->next) {
+		*ptr = 0;
+		*len = 0;
+		return 0;
+	}
+	
+	/* valid until the next buffer is pushed */
+	*ptr = stream->spans[stream->next];
+	*len = stream->spanLen[stream->next++];
+	
+	return 1;
+}
+
+void fqgrep_stream_free(FqgrepStream *stream) {
+	
+	if(stream) {
+		if(stream->carry) {
+			destroyQseqs(stream->carry);
+		}
+		if(stream->tail) {
+			destroyQseqs(stream->tail);
+		}
+		free(stream->recs);
+		free(stream->recLen);
+		free(stream->hits);
+		free(stream->spans);
+		free(stream->spanLen);
+		free(stream);
+	}
+}
+
+const char * fqgrep_strerror(int err) {
+	
+	switch(err) {
+		case FQGREP_OK:
+			return "Success";
+		case FQGREP_ENOMEM:
+			return "Out of memory";
+		case FQGREP_EINVAL:
+			return "Invalid argument";
+		case FQGREP_EFORMAT:
+			return "Malformed fastq";
+		case FQGREP_ESTATE:
+			return "Context not built, or built already";
+	}
+	
+	return "Unknown error";
+}
@@ -0,0 +1,76 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include "qseqs.h"
+#include "targets.h"
+
+#ifndef FQAPI
+typedef struct fqgrepCtx FqgrepCtx;
+typedef struct fqgrepStream FqgrepStream;
+struct fqgrepCtx {
+	int engine;
+	int thread_num;
+	unsigned invert;
+	long len; /* targets added, until the context is built */
+	long size;
+	char *arena;
+	Target *targets; /* read only once built */
+};
+struct fqgrepStream {
+	FqgrepCtx *ctx;
+	int lines; /* newlines in carry */
+	long m; /* records of the last buffer */
+	long mSize;
+	long n; /* output spans of the last buffer */
+	long next;
+	long size;
+	const char **recs;
+	long *recLen;
+	long *hits;
+	const char **spans;
+	long *spanLen;
+	Qseqs *carry; /* record split over two buffers */
+	Qseqs *tail;
+};
+#define FQAPI 1
+#define FQGREP_OK 0
+#define FQGREP_ENOMEM -1
+#define FQGREP_EINVAL -2
+#define FQGREP_EFORMAT -3
+#define FQGREP_ESTATE -4
+#endif
+
+/*
+ * Embedding API: a built context is read only and may be shared by
+ * threads, while each thread feeds its own stream. Errors are returned
+ * as negative FQGREP_E* codes.
+ */
+FqgrepCtx * fqgrep_ctx_new(int engine, int thread_num, unsigned invert);
+int fqgrep_add_targets(FqgrepCtx *ctx, const char *buff, long len);
+/* a failed build drops the added targets */
+int fqgrep_ctx_build(FqgrepCtx *ctx);
+long fqgrep_match(FqgrepCtx *ctx, const char *id);
+long fqgrep_match_batch(FqgrepCtx *ctx, const char **ids, long n, long *hits);
+void fqgrep_ctx_free(FqgrepCtx *ctx);
+/* fastq in decompressed buffers, matching records out as spans of them */
+FqgrepStream * fqgrep_stream_new(FqgrepCtx *ctx);
+long fqgrep_push_buffer(FqgrepStream *stream, const char *buff, long len, int last);
+int fqgrep_pull_output(FqgrepStream *stream, const char **ptr, long *len);
+void fqgrep_stream_free(FqgrepStream *stream);
+const char * fqgrep_strerror(int err);
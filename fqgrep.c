@@ -17,23 +17,377 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "bgzf.h"
+#include "checkpoint.h"
+#include "demux.h"
 #include "filebuff.h"
 #include "fqgrep.h"
+#include "fqsplit.h"
 #include "pherror.h"
+#include "progress.h"
+#include "qbatch.h"
+#include "repair.h"
 #include "seqparse.h"
+#include "shard.h"
 #include "targets.h"
+#include "zstdio.h"
 
-int segrep(Target *targets, unsigned invert, char **inputfilenames, int se, char *outputfilename) {
+GrepOpts * grepOpts_init(void) {
+	
+	GrepOpts *dest;
+	
+	dest = smalloc(sizeof(GrepOpts));
+	dest->invert = 0;
+	dest->thread_num = 1;
+	dest->engine = TARGET_AUTO;
+	dest->gzspan = 0;
+	dest->outputfilename = (char *)("-");
+	dest->patternfilename = 0;
+	dest->mode = GREP_RECORDS;
+	dest->stream = 0;
+	dest->bamout = 0;
+	dest->socketname = 0;
+	dest->unmatchedname = 0;
+	dest->checkpointname = 0;
+	dest->checkpointinterval = CHECKPOINT_INTERVAL;
+	dest->checkpoint = 0;
+	dest->heartbeatname = 0;
+	dest->progressinterval = 0;
+	dest->progress = 0;
+	dest->buffsize = CHUNK;
+	dest->iosize = 0;
+	dest->ioflags = 0;
+	dest->zstdlevel = 0;
+	dest->zstdworkers = 0;
+	dest->shardnum = 0;
+	dest->shardtotal = 0;
+	dest->shard = 0;
+	dest->demuxname = 0;
+	dest->demux = 0;
+	dest->repair = 0;
+	dest->repairmemory = REPAIR_MEMORY;
+	
+	return dest;
+}
+
+static long * grepQBatch(Target *targets, QBatch *batch, char **headers, long *hits) {
 	
 	int i;
-	unsigned FASTQ;
+	
+	/* look up all headers of the batch at once */
+	for(i = 0; i < batch->n; ++i) {
+		headers[i] = qbatch_header(batch, i);
+	}
+	target_grep_batch(targets, headers, hits, batch->n);
+	
+	return hits;
+}
+
+static QBatch * nextBatch(FqBatchReader *reader, QBatch **batch, int *o, Target *targets, char **headers, long *hits) {
+	
+	/* keep the rest of a batch, or get and grep the next */
+	if(!*batch && (*batch = fqBatchReader_get(reader))) {
+		*o = 0;
+		if(targets) {
+			grepQBatch(targets, *batch, headers, hits);
+		}
+	}
+	
+	return *batch;
+}
+
+static void printId(char *header, FILE *out) {
+	
+	int len;
+	
+	/* id is the header up to the first whitespace */
+	len = 0;
+	while(header[len] && !isspace(header[len])) {
+		++len;
+	}
+	header[len] = '\n';
+	sfwrite(header, 1, len + 1, out);
+}
+
+static FILE * zstdOutput(FILE *out, GrepOpts *opts) {
+	
+	/* records are compressed by a pool of zstd workers, one per thread by default */
+	if(opts->zstdlevel) {
+		return zstd_open(out, opts->zstdlevel, opts->zstdworkers ? opts->zstdworkers : opts->thread_num);
+	}
+	
+	return out;
+}
+
+static FILE * openOutput(char *prefix, char *infix, unsigned FASTQ, int raw, long long size, GrepOpts *opts) {
+	
 	char *filename;
 	FILE *out;
+	
+	/* prefix, _1, _2 or _int and the format of the records */
+	if(*prefix == '-' && prefix[1] == 0) {
+		return stdout;
+	}
+	filename = smalloc(strlen(prefix) + strlen(infix) + 9);
+	sprintf(filename, "%s%s.%s%s", prefix, infix, raw ? "bam" : (FASTQ & 2) ? "fsa" : "fq", opts->zstdlevel ? ".zst" : "");
+	if(opts->shard) {
+		shard_output(opts->shard, prefix, filename);
+	}
+	if(size < 0) {
+		out = sfopen(filename, "wb");
+	} else if(checkpoint_truncate((out = sfopen(filename, "ab")), size)) {
+		fprintf(stderr, "Cannot resume output:\t%s\n", filename);
+		exit(1);
+	}
+	free(filename);
+	
+	return out;
+}
+
+static long long resumeSize(Checkpoint *ckpt, int set, int file, int k) {
+	
+	/* outputs are cut back to the checkpoint they resume from */
+	if(ckpt && ckpt->resume && ckpt->set == set && ckpt->file == file) {
+		return ckpt->size[k];
+	}
+	
+	return -1;
+}
+
+static long resumeInput(Checkpoint *ckpt, int set, int file, FileBuff *inputfile, FileBuff *inputfile2) {
+	
+	/* continue inputs from the checkpoint, with its count */
+	if(!ckpt || !ckpt->resume || ckpt->set != set || ckpt->file != file) {
+		return 0;
+	} else if(seekFileBuff(inputfile, ckpt->pos[0], ckpt->point) || (inputfile2 && seekFileBuff(inputfile2, ckpt->pos[1], ckpt->point + 1))) {
+		fprintf(stderr, "Cannot resume from checkpoint:\t%s\n", ckpt->filename);
+		exit(1);
+	}
+	ckpt->resume = 0;
+	
+	return ckpt->count;
+}
+
+static void markInput(Checkpoint *ckpt, int k, FileBuff *src) {
+	
+	GzPoint point;
+	
+	checkpoint_input(ckpt, k, tellFileBuff(src, &point), &point);
+}
+
+static void markFile(Checkpoint *ckpt, int set, int file, FILE *out, FILE *out2, FILE *uout, FILE *uout2) {
+	
+	/* inputs before file are done */
+	if(ckpt) {
+		checkpoint_input(ckpt, 0, 0, 0);
+		checkpoint_input(ckpt, 1, 0, 0);
+		checkpoint_save(ckpt, set, file, 0, out, out2, uout, uout2);
+	}
+}
+
+static FILE * openBamOutput(FILE *out, Qseqs *header) {
+	
+	/* bam records go to a bgzf stream, under the header of the first input */
+	out = bgzf_open(out, Z_DEFAULT_COMPRESSION);
+	sfwrite(header->seq, 1, header->len, out);
+	
+	return out;
+}
+
+static int (*getBatchParser(unsigned FASTQ, int mode, int raw))(FileBuff *, QBatch *) {
+	
+	/* bam records are only decoded when written as fastq */
+	if(FASTQ & 8) {
+		return (mode == GREP_RECORDS && !raw) ? &FileBuffgetBamBatch : &FileBuffgetBamRaw;
+	}
+	
+	/* only headers are parsed when no records are written */
+	if(mode == GREP_RECORDS) {
+		return &FileBuffgetFqBatch;
+	}
+	
+	return (FASTQ & 1) ? &FileBuffgetFqHeaders : &FileBuffgetFsaHeaders;
+}
+
+static void * rangegrep(void *arg) {
+	
+	int j, k, mode, pairs;
+	unsigned invert;
+	long matches, *hits;
+	long long pos, last;
+	char **headers;
+	FileBuff *inputfile;
+	QBatch *batch;
+	GrepRange *range;
+	int (*getBatch)(FileBuff *, QBatch *);
+	
+	/* grep one range into its own outputs, mates are kept together */
+	range = arg;
+	mode = range->opts->mode;
+	invert = range->opts->invert;
+	pairs = range->pairs;
+	inputfile = setFileBuff(range->opts->buffsize);
+	ioFileBuff(inputfile, range->opts->ioflags & FILEBUFF_HUGEPAGES, 0);
+	if(range->share) {
+		/* gzip shares inflate from the access points of the index, counting compressed bytes */
+		sharegzFileBuff(inputfile, range->filename, range->index);
+		shard_range(inputfile, 1, pairs, range->share, range->shares);
+		last = ftello(inputfile->file);
+	} else {
+		rangeFileBuff(inputfile, range->file, range->start, range->end);
+		last = range->start;
+	}
+	batch = qbatch_init(QBATCHSIZE, QARENASIZE);
+	headers = smalloc(QBATCHSIZE * sizeof(char *));
+	hits = smalloc(QBATCHSIZE * sizeof(long));
+	getBatch = getBatchParser(1, mode, 0);
+	while(getBatch(inputfile, batch)) {
+		grepQBatch(range->targets, batch, headers, hits);
+		matches = 0;
+		for(j = pairs; j < batch->n; j += pairs + 1) {
+			k = j - pairs;
+			if((invert ^ (0 <= hits[k] || 0 <= hits[j])) & 1) {
+				if(mode == GREP_RECORDS) {
+					for(; k <= j; ++k) {
+						qbatch_printFq(batch, k, range->out);
+					}
+				} else if(mode == GREP_IDS) {
+					printId(qbatch_header(batch, k), range->out);
+				}
+				++matches;
+			} else if(range->uout) {
+				for(; k <= j; ++k) {
+					qbatch_printFq(batch, k, range->uout);
+				}
+			}
+		}
+		__sync_fetch_and_add(range->count, matches);
+		pos = range->share ? ftello(inputfile->file) : tellFileBuff(inputfile, 0);
+		progress_read(range->opts->progress, pos - last);
+		progress_update(range->opts->progress, batch->n);
+		last = pos;
+	}
+	
+	qbatch_destroy(batch);
+	free(headers);
+	free(hits);
+	if(range->share) {
+		closeFileBuff(inputfile);
+	}
+	destroyFileBuff(inputfile);
+	
+	return NULL;
+}
+
+static void appendOutput(FILE *dest, FILE *src) {
+	
+	size_t len;
+	char *buff;
+	
+	/* output of a range goes after the ones before it */
+	buff = smalloc(CHUNK);
+	rewind(src);
+	while((len = fread(buff, 1, CHUNK, src))) {
+		sfwrite(buff, 1, len, dest);
+	}
+	free(buff);
+	fclose(src);
+}
+
+static int splitgrep(Target *targets, GrepOpts *opts, FileBuff *inputfile, char *filename, unsigned FASTQ, int pairs, FILE *out, FILE *uout, long *count) {
+	
+	int i, n, gz;
+	long long start, end, *bounds;
+	struct stat st;
+	GrepRange *ranges;
+	
+	/* plain fastq files, or shares of them, are cut in byte ranges grepped by a thread each */
+	gz = FASTQ == 5 && inputfile->buffFileBuff == &BuffgzFileBuff && inputfile->index && !inputfile->index->window && !opts->shard;
+	if(opts->thread_num < 2 || (FASTQ != 1 && !gz) || opts->checkpoint || (inputfile->buffFileBuff != &buff_FileBuff && inputfile->buffFileBuff != &BuffrangeFileBuff && !gz) || fileno(inputfile->file) < 0 || fstat(fileno(inputfile->file), &st) || !S_ISREG(st.st_mode)) {
+		return 0;
+	}
+	bounds = smalloc((opts->thread_num + 1) * sizeof(long long));
+	start = inputfile->buffFileBuff == &BuffrangeFileBuff ? inputfile->pos - inputfile->bytes : 0;
+	end = inputfile->buffFileBuff == &BuffrangeFileBuff ? inputfile->end : st.st_size;
+	if(gz) {
+		/* gzip input with a stored index is cut in shares at its access points */
+		n = opts->thread_num;
+		memset(bounds, 0, (n + 1) * sizeof(long long));
+	} else if((n = fqsplit_ranges(fileno(inputfile->file), start, end, opts->thread_num, pairs, bounds)) < 2) {
+		free(bounds);
+		return 0;
+	}
+	ranges = smalloc(n * sizeof(GrepRange));
+	for(i = 0; i < n; ++i) {
+		ranges[i].pairs = pairs;
+		ranges[i].share = gz ? i + 1 : 0;
+		ranges[i].shares = n;
+		ranges[i].start = bounds[i];
+		ranges[i].end = bounds[i + 1];
+		ranges[i].count = count;
+		ranges[i].file = inputfile->file;
+		ranges[i].filename = filename;
+		ranges[i].index = inputfile->index;
+		ranges[i].out = (i == 0 || opts->mode == GREP_COUNT) ? out : fqsplit_tmpfile();
+		ranges[i].uout = (i == 0 || !uout) ? uout : fqsplit_tmpfile();
+		ranges[i].targets = targets;
+		ranges[i].opts = opts;
+	}
+	
+	/* ranges are pread, so their progress is counted from where the file offset is */
+	progress_read(opts->progress, start - ftello(inputfile->file));
+	for(i = 1; i < n; ++i) {
+		if((errno = pthread_create(&ranges[i].id, NULL, &rangegrep, ranges + i))) {
+			ERROR();
+		}
+	}
+	rangegrep(ranges);
+	
+	/* concatenate outputs in order */
+	for(i = 1; i < n; ++i) {
+		pthread_join(ranges[i].id, NULL);
+		if(ranges[i].out != out) {
+			appendOutput(out, ranges[i].out);
+		}
+		if(ranges[i].uout != uout) {
+			appendOutput(uout, ranges[i].uout);
+		}
+	}
+	fseeko(inputfile->file, 0, SEEK_END);
+	if(gz) {
+		/* all of it was inflated by the shares */
+		inputfile->bytes = 0;
+		inputfile->next = inputfile->buffer;
+		inputfile->z_err = Z_STREAM_END;
+	}
+	free(ranges);
+	free(bounds);
+	
+	return n;
+}
+
+int segrep(Target *targets, GrepOpts *opts, char **inputfilenames, int se) {
+	
+	int i, j, mode, mark, stream, raw, bam, hash;
+	unsigned FASTQ, invert;
+	long count, *hits;
+	char *filename, *outputfilename, **headers;
+	FILE *out, *uout;
 	FileBuff *inputfile;
-	Qseqs *header, *qseq, *qual;
+	Qseqs *header;
+	QBatch *batch;
+	QBatchPool *pool;
+	FqBatchReader *reader;
+	Checkpoint *ckpt;
+	Progress *prog;
+	long (*passEntry)(FileBuff *, FILE *);
+	void (*printRecord)(QBatch *, int, FILE *);
 	
 	if(!se) {
 		return 0;
@@ -41,75 +395,158 @@ int segrep(Target *targets, unsigned invert, char **inputfilenames, int se, char
 	
 	/* init */
 	header = setQseqs(256);
-	qseq = setQseqs(1024);
-	qual = setQseqs(1024);
-	inputfile = setFileBuff(1048576);
+	pool = qbatchpool_init(6, QBATCHSIZE);
+	headers = smalloc(QBATCHSIZE * sizeof(char *));
+	hits = smalloc(QBATCHSIZE * sizeof(long));
+	inputfile = setFileBuff(opts->buffsize);
+	ioFileBuff(inputfile, opts->ioflags, opts->iosize);
+	inputfile->gzspan = opts->gzspan;
+	inputfile->thread_num = opts->thread_num;
+	invert = opts->invert;
+	mode = opts->mode;
+	stream = opts->stream;
+	ckpt = opts->checkpoint;
+	prog = opts->progress;
+	bam = 0;
+	outputfilename = opts->outputfilename;
 	if(*outputfilename == '-' && outputfilename[1] == 0) {
-		out = stdout;
+		out = mode == GREP_RECORDS ? zstdOutput(stdout, opts) : stdout;
 	} else {
 		out = 0;
 	}
+	uout = 0;
 	
 	for(i = 0; i < se; ++i) {
 		filename = inputfilenames[i];
+		if(checkpoint_skip(ckpt, SET_SE, i)) {
+			progress_skip(prog, filename);
+			continue;
+		}
 		
 		/* determine filetype and open it */
 		if((FASTQ = openAndDetermineFQ(inputfile, filename)) & 3) {
 			fprintf(stderr, "%s\t%s\n", "# Reading inputfile: ", filename);
 		}
-		if(!out) {
-			filename = smalloc(strlen(outputfilename) + 5);
-			if(FASTQ & 2) {
-				sprintf(filename, "%s.fsa", outputfilename);
-			} else {
-				sprintf(filename, "%s.fq", outputfilename);
-			}
-			out = sfopen(filename, "wb");
-			free(filename);
+		if(FASTQ & 8) {
+			FileBuffgetBamHeader(inputfile, header);
+		}
+		progress_input(prog, filename, inputfile, 0, &count);
+		raw = opts->bamout && (FASTQ & 8) && mode == GREP_RECORDS;
+		if(!out && mode) {
+			out = sfopen(outputfilename, "ab");
+		} else if(!out) {
+			out = zstdOutput(openOutput(outputfilename, "", FASTQ, raw, resumeSize(ckpt, SET_SE, i, 0), opts), opts);
 		}
+		if(!uout && opts->unmatchedname && mode == GREP_RECORDS) {
+			uout = zstdOutput(openOutput(opts->unmatchedname, "", FASTQ, raw, resumeSize(ckpt, SET_SE, i, 2), opts), opts);
+		}
+		if(i && raw != bam) {
+			fprintf(stderr, "Cannot mix bam and fastq output.\n");
+			exit(1);
+		} else if(raw && !bam) {
+			out = openBamOutput(out, header);
+			uout = uout ? openBamOutput(uout, header) : 0;
+			bam = 1;
+		}
+		printRecord = raw ? &qbatch_printRaw : &qbatch_printFq;
 		
 		/* parse entries */
-		if(FASTQ & 1) {
-			while(FileBuffgetFq(inputfile, header, qseq, qual)) {
-				if((invert ^ (0 <= target_grep(targets, (char *)(header->seq)))) & 1) {
-					fprintf(out, "@%s\n", header->seq);
-					fprintf(out, "%s\n", qseq->seq);
-					fprintf(out, "+\n");
-					fprintf(out, "%s\n", qual->seq);
+		count = resumeInput(ckpt, SET_SE, i, inputfile, 0);
+		hash = opts->shard && !shard_input(opts->shard, inputfile, FASTQ, 0);
+		if((mode || !stream) && !hash && splitgrep(targets, opts, inputfile, filename, FASTQ, 0, out, uout, &count)) {
+			if(mode == GREP_COUNT) {
+				fprintf(out, "%s\t%ld\n", filename, count);
+			}
+		} else if(mode ? (FASTQ & 3) : ((FASTQ & 1) && (!stream || (FASTQ & 8)))) {
+			reader = fqBatchReader_start(inputfile, pool, 4, getBatchParser(FASTQ, mode, raw));
+			while((batch = fqBatchReader_get(reader))) {
+				grepQBatch(targets, batch, headers, hits);
+				for(j = 0; j < batch->n; ++j) {
+					if(hash && !shard_mine(opts->shard, qbatch_header(batch, j))) {
+						continue;
+					} else if((invert ^ (0 <= hits[j])) & 1) {
+						if(mode == GREP_RECORDS) {
+							printRecord(batch, j, out);
+						} else if(mode == GREP_IDS) {
+							printId(qbatch_header(batch, j), out);
+						}
+						++count;
+					} else if(uout) {
+						printRecord(batch, j, uout);
+					}
 				}
+				progress_update(prog, batch->n);
+				if(checkpoint_due(ckpt)) {
+					checkpoint_input(ckpt, 0, batch->end, &batch->point);
+					checkpoint_save(ckpt, SET_SE, i, count, out, 0, uout, 0);
+				}
+				qbatchpool_put(pool, batch);
 			}
-		} else if(FASTQ & 2) {
-			while(FileBuffgetFsa(inputfile, header, qseq)) {
-				if((invert ^ (0 <= target_grep(targets, (char *)(header->seq)))) & 1) {
-					fprintf(out, ">%s\n", header->seq);
-					fprintf(out, "%s\n", qseq->seq);
+			fqBatchReader_stop(reader);
+			if(mode == GREP_COUNT) {
+				fprintf(out, "%s\t%ld\n", filename, count);
+			}
+		} else if(FASTQ & 3) {
+			/* stream entries, the header decides before the sequence is read */
+			mark = (FASTQ & 1) ? '@' : '>';
+			passEntry = (FASTQ & 1) ? &FileBuffpassFq : &FileBuffpassFsa;
+			while(FileBuffgetHeader(inputfile, header, mark)) {
+				if(hash && !shard_mine(opts->shard, (char *)(header->seq))) {
+					passEntry(inputfile, 0);
+				} else if((invert ^ (0 <= target_grep(targets, (char *)(header->seq)))) & 1) {
+					fprintf(out, "%c%s\n", mark, header->seq);
+					passEntry(inputfile, out);
+					++count;
+				} else {
+					if(uout) {
+						fprintf(uout, "%c%s\n", mark, header->seq);
+					}
+					passEntry(inputfile, uout);
+				}
+				progress_update(prog, 1);
+				if(checkpoint_due(ckpt)) {
+					markInput(ckpt, 0, inputfile);
+					checkpoint_save(ckpt, SET_SE, i, count, out, 0, uout, 0);
 				}
 			}
 		}
+		markFile(ckpt, SET_SE, i + 1, out, 0, uout, 0);
+		progress_close(prog);
 		
 		closeFileBuff(inputfile);
 	}
 	
 	/* clean up */
-	if(out != stdout) {
+	if(out && out != stdout) {
 		fclose(out);
 	}
+	if(uout && uout != stdout) {
+		fclose(uout);
+	}
 	destroyQseqs(header);
-	destroyQseqs(qseq);
-	destroyQseqs(qual);
+	qbatchpool_destroy(pool);
+	free(headers);
+	free(hits);
 	destroyFileBuff(inputfile);
 	
 	return 0;
 }
 
-int intgrep(Target *targets, unsigned invert, char **inputfilenames, int inter, char *outputfilename) {
+int intgrep(Target *targets, GrepOpts *opts, char **inputfilenames, int inter) {
 	
-	int i;
-	unsigned FASTQ;
-	char *filename;
-	FILE *out;
+	int i, j, mode, raw, bam, hash;
+	unsigned FASTQ, invert;
+	long count, *hits;
+	char *filename, *outputfilename, **headers;
+	FILE *out, *uout;
 	FileBuff *inputfile;
-	Qseqs *header, *header2, *qseq, *qseq2, *qual, *qual2;
+	Qseqs *header, *header2, *qseq, *qseq2;
+	QBatch *batch;
+	QBatchPool *pool;
+	FqBatchReader *reader;
+	Checkpoint *ckpt;
+	Progress *prog;
+	void (*printRecord)(QBatch *, int, FILE *);
 	
 	if(!inter) {
 		return 0;
@@ -120,84 +557,164 @@ int intgrep(Target *targets, unsigned invert, char **inputfilenames, int inter,
 	header2 = setQseqs(256);
 	qseq = setQseqs(1024);
 	qseq2 = setQseqs(1024);
-	qual = setQseqs(1024);
-	qual2 = setQseqs(1024);
-	inputfile = setFileBuff(1048576);
+	pool = qbatchpool_init(12, QBATCHSIZE);
+	headers = smalloc(QBATCHSIZE * sizeof(char *));
+	hits = smalloc(QBATCHSIZE * sizeof(long));
+	inputfile = setFileBuff(opts->buffsize);
+	ioFileBuff(inputfile, opts->ioflags, opts->iosize);
+	inputfile->gzspan = opts->gzspan;
+	inputfile->thread_num = opts->thread_num;
+	invert = opts->invert;
+	mode = opts->mode;
+	ckpt = opts->checkpoint;
+	prog = opts->progress;
+	bam = 0;
+	outputfilename = opts->outputfilename;
 	if(*outputfilename == '-' && outputfilename[1] == 0) {
-		out = stdout;
+		out = mode == GREP_RECORDS ? zstdOutput(stdout, opts) : stdout;
 	} else {
 		out = 0;
 	}
+	uout = 0;
 	
 	for(i = 0; i < inter; ++i) {
 		filename = inputfilenames[i];
+		if(checkpoint_skip(ckpt, SET_INT, i)) {
+			progress_skip(prog, filename);
+			continue;
+		}
 		
 		/* determine filetype and open it */
 		if((FASTQ = openAndDetermineFQ(inputfile, filename)) & 3) {
 			fprintf(stderr, "%s\t%s\n", "# Reading inputfile: ", filename);
 		}
-		if(!out) {
-			filename = smalloc(strlen(outputfilename) + 9);
-			if(FASTQ & 2) {
-				sprintf(filename, "%s_int.fsa", outputfilename);
-			} else {
-				sprintf(filename, "%s_int.fq", outputfilename);
-			}
-			out = sfopen(filename, "wb");
-			free(filename);
+		if(FASTQ & 8) {
+			FileBuffgetBamHeader(inputfile, header);
+		}
+		progress_input(prog, filename, inputfile, 0, &count);
+		raw = opts->bamout && (FASTQ & 8) && mode == GREP_RECORDS;
+		if(!out && mode) {
+			out = sfopen(outputfilename, "ab");
+		} else if(!out) {
+			out = zstdOutput(openOutput(outputfilename, "_int", FASTQ, raw, resumeSize(ckpt, SET_INT, i, 0), opts), opts);
+		}
+		if(!uout && opts->unmatchedname && mode == GREP_RECORDS) {
+			uout = zstdOutput(openOutput(opts->unmatchedname, "_int", FASTQ, raw, resumeSize(ckpt, SET_INT, i, 2), opts), opts);
+		}
+		if(i && raw != bam) {
+			fprintf(stderr, "Cannot mix bam and fastq output.\n");
+			exit(1);
+		} else if(raw && !bam) {
+			out = openBamOutput(out, header);
+			uout = uout ? openBamOutput(uout, header) : 0;
+			bam = 1;
 		}
+		printRecord = raw ? &qbatch_printRaw : &qbatch_printFq;
 		
 		/* parse entries */
-		if(FASTQ & 1) {
-			while(FileBuffgetFq(inputfile, header, qseq, qual) && FileBuffgetFq(inputfile, header2, qseq2, qual2)) {
-				if((invert ^ (0 <= target_grep(targets, (char *)(header->seq)) || 0 <= target_grep(targets, (char *)(header2->seq)))) & 1) {
-					fprintf(out, "@%s\n", header->seq);
-					fprintf(out, "%s\n", qseq->seq);
-					fprintf(out, "+\n");
-					fprintf(out, "%s\n", qual->seq);
-					fprintf(out, "@%s\n", header2->seq);
-					fprintf(out, "%s\n", qseq2->seq);
-					fprintf(out, "+\n");
-					fprintf(out, "%s\n", qual2->seq);
+		count = resumeInput(ckpt, SET_INT, i, inputfile, 0);
+		hash = opts->shard && !shard_input(opts->shard, inputfile, FASTQ, 1);
+		if(!hash && splitgrep(targets, opts, inputfile, filename, FASTQ, 1, out, uout, &count)) {
+			if(mode == GREP_COUNT) {
+				fprintf(out, "%s\t%ld\n", filename, count);
+			}
+		} else if((FASTQ & 1) || (mode && (FASTQ & 2))) {
+			/* mates are kept together, as the batch size is even */
+			reader = fqBatchReader_start(inputfile, pool, 4, getBatchParser(FASTQ, mode, raw));
+			while((batch = fqBatchReader_get(reader))) {
+				grepQBatch(targets, batch, headers, hits);
+				for(j = 1; j < batch->n; j += 2) {
+					if(hash && !shard_mine(opts->shard, qbatch_header(batch, j - 1))) {
+						continue;
+					} else if((invert ^ (0 <= hits[j - 1] || 0 <= hits[j])) & 1) {
+						if(mode == GREP_RECORDS) {
+							printRecord(batch, j - 1, out);
+							printRecord(batch, j, out);
+						} else if(mode == GREP_IDS) {
+							printId(qbatch_header(batch, j - 1), out);
+						}
+						++count;
+					} else if(uout) {
+						printRecord(batch, j - 1, uout);
+						printRecord(batch, j, uout);
+					}
+				}
+				progress_update(prog, batch->n);
+				if(checkpoint_due(ckpt)) {
+					checkpoint_input(ckpt, 0, batch->end, &batch->point);
+					checkpoint_save(ckpt, SET_INT, i, count, out, 0, uout, 0);
 				}
+				qbatchpool_put(pool, batch);
+			}
+			fqBatchReader_stop(reader);
+			if(mode == GREP_COUNT) {
+				fprintf(out, "%s\t%ld\n", inputfilenames[i], count);
 			}
 		} else if(FASTQ & 2) {
 			while(FileBuffgetFsa(inputfile, header, qseq) && FileBuffgetFsa(inputfile, header2, qseq2)) {
-				if((invert ^ (0 <= target_grep(targets, (char *)(header->seq)) || 0 <= target_grep(targets, (char *)(header2->seq)))) & 1) {
+				if(hash && !shard_mine(opts->shard, (char *)(header->seq))) {
+					progress_update(prog, 2);
+					continue;
+				} else if((invert ^ (0 <= target_grep(targets, (char *)(header->seq)) || 0 <= target_grep(targets, (char *)(header2->seq)))) & 1) {
 					fprintf(out, ">%s\n", header->seq);
 					fprintf(out, "%s\n", qseq->seq);
 					fprintf(out, ">%s\n", header2->seq);
 					fprintf(out, "%s\n", qseq2->seq);
+					++count;
+				} else if(uout) {
+					fprintf(uout, ">%s\n", header->seq);
+					fprintf(uout, "%s\n", qseq->seq);
+					fprintf(uout, ">%s\n", header2->seq);
+					fprintf(uout, "%s\n", qseq2->seq);
+				}
+				progress_update(prog, 2);
+				if(checkpoint_due(ckpt)) {
+					markInput(ckpt, 0, inputfile);
+					checkpoint_save(ckpt, SET_INT, i, count, out, 0, uout, 0);
 				}
 			}
 		}
+		markFile(ckpt, SET_INT, i + 1, out, 0, uout, 0);
+		progress_close(prog);
 		
 		closeFileBuff(inputfile);
 	}
 	
 	/* clean up */
-	if(out != stdout) {
+	if(out && out != stdout) {
 		fclose(out);
 	}
+	if(uout && uout != stdout) {
+		fclose(uout);
+	}
 	destroyQseqs(header);
 	destroyQseqs(header2);
 	destroyQseqs(qseq);
 	destroyQseqs(qseq2);
-	destroyQseqs(qual);
-	destroyQseqs(qual2);
+	qbatchpool_destroy(pool);
+	free(headers);
+	free(hits);
 	destroyFileBuff(inputfile);
 	
 	return 0;
 }
 
-int pegrep(Target *targets, unsigned invert, char **inputfilenames, int pe, char *outputfilename) {
+int pegrep(Target *targets, GrepOpts *opts, char **inputfilenames, int pe) {
 	
-	int i;
-	unsigned FASTQ, FASTQ2;
-	char *filename;
-	FILE *out, *out2;
+	int i, j, n, o, o2, mode, mark, stream, raw, bam;
+	unsigned FASTQ, FASTQ2, invert;
+	long count, *hits, *hits2;
+	char *outputfilename, **headers;
+	FILE *out, *out2, *uout, *uout2;
 	FileBuff *inputfile, *inputfile2;
-	Qseqs *header, *header2, *qseq, *qseq2, *qual, *qual2;
+	Qseqs *header, *header2;
+	QBatch *batch, *batch2;
+	QBatchPool *pool;
+	FqBatchReader *reader, *reader2;
+	Checkpoint *ckpt;
+	Progress *prog;
+	long (*passEntry)(FileBuff *, FILE *);
+	void (*printRecord)(QBatch *, int, FILE *);
 	
 	if(!pe) {
 		return 0;
@@ -209,111 +726,764 @@ int pegrep(Target *targets, unsigned invert, char **inputfilenames, int pe, char
 	/* init */
 	header = setQseqs(256);
 	header2 = setQseqs(256);
-	qseq = setQseqs(1024);
-	qseq2 = setQseqs(1024);
-	qual = setQseqs(1024);
-	qual2 = setQseqs(1024);
-	inputfile = setFileBuff(1048576);
-	inputfile2 = setFileBuff(1048576);
+	pool = qbatchpool_init(12, QBATCHSIZE);
+	headers = smalloc(QBATCHSIZE * sizeof(char *));
+	hits = smalloc(QBATCHSIZE * sizeof(long));
+	hits2 = smalloc(QBATCHSIZE * sizeof(long));
+	inputfile = setFileBuff(opts->buffsize);
+	inputfile2 = setFileBuff(opts->buffsize);
+	ioFileBuff(inputfile, opts->ioflags, opts->iosize);
+	ioFileBuff(inputfile2, opts->ioflags, opts->iosize);
+	inputfile->gzspan = opts->gzspan;
+	inputfile2->gzspan = opts->gzspan;
+	inputfile->thread_num = opts->thread_num;
+	inputfile2->thread_num = opts->thread_num;
+	invert = opts->invert;
+	mode = opts->mode;
+	stream = opts->stream;
+	ckpt = opts->checkpoint;
+	prog = opts->progress;
+	bam = 0;
+	outputfilename = opts->outputfilename;
 	if(*outputfilename == '-' && outputfilename[1] == 0) {
-		out = stdout;
-		out2 = stdout;
+		out = mode == GREP_RECORDS ? zstdOutput(stdout, opts) : stdout;
+		out2 = out;
 	} else {
 		out = 0;
 		out2 = 0;
 	}
+	uout = 0;
+	uout2 = 0;
 	
 	for(i = 0; i < pe; i += 2) {
+		if(checkpoint_skip(ckpt, SET_PE, i)) {
+			progress_skip(prog, inputfilenames[i]);
+			progress_skip(prog, inputfilenames[i + 1]);
+			continue;
+		}
+		
 		/* determine filetype and open it */
 		FASTQ = openAndDetermineFQ(inputfile, inputfilenames[i]);
 		FASTQ2 = openAndDetermineFQ(inputfile2, inputfilenames[i+1]);
 		if((FASTQ & 3) && (FASTQ2 & 3)) {
 			fprintf(stderr, "%s\t%s %s\n", "# Reading inputfiles: ", inputfilenames[i], inputfilenames[i+1]);
 		}
+		if(FASTQ & 8) {
+			FileBuffgetBamHeader(inputfile, header);
+		}
+		if(FASTQ2 & 8) {
+			FileBuffgetBamHeader(inputfile2, header2);
+		}
+		progress_input(prog, inputfilenames[i], inputfile, inputfile2, &count);
+		raw = opts->bamout && (FASTQ & FASTQ2 & 8) && mode == GREP_RECORDS;
 		
-		if(!out) {
-			filename = smalloc(strlen(outputfilename) + 7);
-			if(FASTQ & 2) {
-				sprintf(filename, "%s_1.fsa", outputfilename);
-				out = sfopen(filename, "wb");
-				sprintf(filename, "%s_2.fsa", outputfilename);
-				out2 = sfopen(filename, "wb");
-			} else {
-				sprintf(filename, "%s_1.fq", outputfilename);
-				out = sfopen(filename, "wb");
-				sprintf(filename, "%s_2.fq", outputfilename);
-				out2 = sfopen(filename, "wb");
+		if(!out && mode) {
+			out = sfopen(outputfilename, "ab");
+			out2 = out;
+		} else if(!out) {
+			out = zstdOutput(openOutput(outputfilename, "_1", FASTQ, raw, resumeSize(ckpt, SET_PE, i, 0), opts), opts);
+			out2 = zstdOutput(openOutput(outputfilename, "_2", FASTQ, raw, resumeSize(ckpt, SET_PE, i, 1), opts), opts);
+		}
+		if(!uout && opts->unmatchedname && mode == GREP_RECORDS) {
+			/* pairs to stdout share one stream */
+			uout = zstdOutput(openOutput(opts->unmatchedname, "_1", FASTQ, raw, resumeSize(ckpt, SET_PE, i, 2), opts), opts);
+			uout2 = openOutput(opts->unmatchedname, "_2", FASTQ, raw, resumeSize(ckpt, SET_PE, i, 3), opts);
+			uout2 = uout2 == stdout ? uout : zstdOutput(uout2, opts);
+		}
+		if(i && raw != bam) {
+			fprintf(stderr, "Cannot mix bam and fastq output.\n");
+			exit(1);
+		} else if(raw && !bam) {
+			/* pairs to stdout share one stream */
+			out = openBamOutput(out, header);
+			out2 = out2 == stdout ? out : openBamOutput(out2, header2);
+			if(uout) {
+				uout = openBamOutput(uout, header);
+				uout2 = uout2 == stdout ? uout : openBamOutput(uout2, header2);
 			}
-			free(filename);
+			bam = 1;
 		}
+		printRecord = raw ? &qbatch_printRaw : &qbatch_printFq;
 		
 		/* parse entries */
-		if((FASTQ & 1) && (FASTQ2 & 1)) {
-			while(FileBuffgetFq(inputfile, header, qseq, qual) && FileBuffgetFq(inputfile2, header2, qseq2, qual2)) {
-				if((invert ^ (0 <= target_grep(targets, (char *)(header->seq)) || 0 <= target_grep(targets, (char *)(header2->seq)))) & 1) {
-					fprintf(out, "@%s\n", header->seq);
-					fprintf(out, "%s\n", qseq->seq);
-					fprintf(out, "+\n");
-					fprintf(out, "%s\n", qual->seq);
-					fprintf(out2, "@%s\n", header2->seq);
-					fprintf(out2, "%s\n", qseq2->seq);
-					fprintf(out2, "+\n");
-					fprintf(out2, "%s\n", qual2->seq);
+		count = resumeInput(ckpt, SET_PE, i, inputfile, inputfile2);
+		if(mode ? ((FASTQ & 3) && (FASTQ & 3) == (FASTQ2 & 3)) : ((FASTQ & 1) && (FASTQ2 & 1) && (!stream || ((FASTQ | FASTQ2) & 8)))) {
+			reader = fqBatchReader_start(inputfile, pool, 4, getBatchParser(FASTQ, mode, raw));
+			reader2 = fqBatchReader_start(inputfile2, pool, 4, getBatchParser(FASTQ2, mode, raw));
+			batch = 0;
+			batch2 = 0;
+			o = 0;
+			o2 = 0;
+			while(nextBatch(reader, &batch, &o, targets, headers, hits) && nextBatch(reader2, &batch2, &o2, targets, headers, hits2)) {
+				/* batches closed by size may hold different numbers of mates */
+				n = batch->n - o < batch2->n - o2 ? batch->n - o : batch2->n - o2;
+				for(j = 0; j < n; ++j) {
+					if(opts->shard && !shard_mine(opts->shard, qbatch_header(batch, o + j))) {
+						continue;
+					} else if((invert ^ (0 <= hits[o + j] || 0 <= hits2[o2 + j])) & 1) {
+						if(mode == GREP_RECORDS) {
+							printRecord(batch, o + j, out);
+							printRecord(batch2, o2 + j, out2);
+						} else if(mode == GREP_IDS) {
+							printId(qbatch_header(batch, o + j), out);
+						}
+						++count;
+					} else if(uout) {
+						printRecord(batch, o + j, uout);
+						printRecord(batch2, o2 + j, uout2);
+					}
+				}
+				progress_update(prog, n << 1);
+				o += n;
+				o2 += n;
+				if(checkpoint_due(ckpt) && o == batch->n && o2 == batch2->n) {
+					checkpoint_input(ckpt, 0, batch->end, &batch->point);
+					checkpoint_input(ckpt, 1, batch2->end, &batch2->point);
+					checkpoint_save(ckpt, SET_PE, i, count, out, out2, uout, uout2);
+				}
+				if(o == batch->n) {
+					qbatchpool_put(pool, batch);
+					batch = 0;
+				}
+				if(o2 == batch2->n) {
+					qbatchpool_put(pool, batch2);
+					batch2 = 0;
 				}
 			}
-		} else if((FASTQ & 2) && (FASTQ2 & 2)) {
-			while(FileBuffgetFsa(inputfile, header, qseq) && FileBuffgetFsa(inputfile2, header2, qseq2)) {
-				if((invert ^ (0 <= target_grep(targets, (char *)(header->seq)) || 0 <= target_grep(targets, (char *)(header2->seq)))) & 1) {
-					fprintf(out, ">%s\n", header->seq);
-					fprintf(out, "%s\n", qseq->seq);
-					fprintf(out2, ">%s\n", header2->seq);
-					fprintf(out2, "%s\n", qseq2->seq);
+			if(batch) {
+				qbatchpool_put(pool, batch);
+			}
+			if(batch2) {
+				qbatchpool_put(pool, batch2);
+			}
+			fqBatchReader_stop(reader);
+			fqBatchReader_stop(reader2);
+			if(mode == GREP_COUNT) {
+				fprintf(out, "%s\t%s\t%ld\n", inputfilenames[i], inputfilenames[i + 1], count);
+			}
+		} else if((FASTQ & 3) && (FASTQ & 3) == (FASTQ2 & 3)) {
+			/* stream entries, the headers decide before the sequences are read */
+			mark = (FASTQ & 1) ? '@' : '>';
+			passEntry = (FASTQ & 1) ? &FileBuffpassFq : &FileBuffpassFsa;
+			while(FileBuffgetHeader(inputfile, header, mark) && FileBuffgetHeader(inputfile2, header2, mark)) {
+				if(opts->shard && !shard_mine(opts->shard, (char *)(header->seq))) {
+					passEntry(inputfile, 0);
+					passEntry(inputfile2, 0);
+				} else if((invert ^ (0 <= target_grep(targets, (char *)(header->seq)) || 0 <= target_grep(targets, (char *)(header2->seq)))) & 1) {
+					fprintf(out, "%c%s\n", mark, header->seq);
+					passEntry(inputfile, out);
+					fprintf(out2, "%c%s\n", mark, header2->seq);
+					passEntry(inputfile2, out2);
+					++count;
+				} else {
+					if(uout) {
+						fprintf(uout, "%c%s\n", mark, header->seq);
+					}
+					passEntry(inputfile, uout);
+					if(uout2) {
+						fprintf(uout2, "%c%s\n", mark, header2->seq);
+					}
+					passEntry(inputfile2, uout2);
+				}
+				progress_update(prog, 2);
+				if(checkpoint_due(ckpt)) {
+					markInput(ckpt, 0, inputfile);
+					markInput(ckpt, 1, inputfile2);
+					checkpoint_save(ckpt, SET_PE, i, count, out, out2, uout, uout2);
 				}
 			}
-		} else if(FASTQ != FASTQ2) {
+		} else if((FASTQ & 3) != (FASTQ2 & 3)) {
 			fprintf(stderr, "%s\t%s %s\n", "# Does not match format: ", inputfilenames[i], inputfilenames[i+1]);
 			exit(1);
 		}
+		markFile(ckpt, SET_PE, i + 2, out, out2, uout, uout2);
+		progress_close(prog);
 		
 		closeFileBuff(inputfile);
 		closeFileBuff(inputfile2);
 	}
 	
 	/* clean up */
-	if(out != stdout) {
+	if(out && out != stdout) {
 		fclose(out);
 	}
-	if(out2 != stdout) {
+	if(out2 != stdout && out2 != out) {
 		fclose(out2);
 	}
+	if(uout && uout != stdout) {
+		fclose(uout);
+	}
+	if(uout2 && uout2 != stdout && uout2 != uout) {
+		fclose(uout2);
+	}
 	destroyQseqs(header);
 	destroyQseqs(header2);
-	destroyQseqs(qseq);
-	destroyQseqs(qseq2);
-	destroyQseqs(qual);
-	destroyQseqs(qual2);
+	qbatchpool_destroy(pool);
+	free(headers);
+	free(hits);
+	free(hits2);
 	destroyFileBuff(inputfile);
 	destroyFileBuff(inputfile2);
 	
 	return 0;
 }
 
-int fqgrep(char *targetfilename, unsigned invert, char **inputfilenames, int se, char **intfilenames, int inter, char **pefilenames, int pe, char *outputfilename) {
+static FILE * openSample(char *sample, char *rest, char *infix, GrepOpts *opts) {
+	
+	char *prefix;
+	FILE *out;
+	
+	/* <output>_<sample>, the rest to -u or <output>_<rest> */
+	if(!sample && opts->unmatchedname) {
+		return zstdOutput(openOutput(opts->unmatchedname, infix, 1, 0, -1, opts), opts);
+	}
+	sample = sample ? sample : rest;
+	prefix = smalloc(strlen(opts->outputfilename) + strlen(sample) + 2);
+	sprintf(prefix, "%s_%s", opts->outputfilename, sample);
+	out = zstdOutput(openOutput(prefix, infix, 1, 0, -1, opts), opts);
+	free(prefix);
+	
+	return out;
+}
+
+int demuxgrep(Demux *demux, GrepOpts *opts, char **inputfilenames, int n, int set) {
+	
+	int i, j, k, m, o, o2, s, mode, pairs, hash;
+	unsigned FASTQ, FASTQ2;
+	long count, total, *counts;
+	FILE *out, **outs, **outs2;
+	FileBuff *inputfile, *inputfile2;
+	QBatch *batch, *batch2;
+	QBatchPool *pool;
+	FqBatchReader *reader, *reader2;
+	Progress *prog;
+	int (*getBatch)(FileBuff *, QBatch *);
+	
+	if(!n) {
+		return 0;
+	} else if(set == SET_PE && (n & 1)) {
+		fprintf(stderr, "Uneven number of paired end reads.\n");
+		return 1;
+	}
+	
+	/* init */
+	pool = qbatchpool_init(set == SET_PE ? 12 : 6, QBATCHSIZE);
+	counts = smalloc((demux->n + 1) * sizeof(long));
+	memset(counts, 0, (demux->n + 1) * sizeof(long));
+	inputfile = setFileBuff(opts->buffsize);
+	inputfile2 = set == SET_PE ? setFileBuff(opts->buffsize) : 0;
+	ioFileBuff(inputfile, opts->ioflags, opts->iosize);
+	inputfile->gzspan = opts->gzspan;
+	inputfile->thread_num = opts->thread_num;
+	if(inputfile2) {
+		ioFileBuff(inputfile2, opts->ioflags, opts->iosize);
+		inputfile2->gzspan = opts->gzspan;
+		inputfile2->thread_num = opts->thread_num;
+	}
+	mode = opts->mode;
+	prog = opts->progress;
+	pairs = set == SET_INT;
+	getBatch = mode == GREP_RECORDS ? &FileBuffgetFqBatch : &FileBuffgetFqHeaders;
+	out = 0;
+	outs = 0;
+	outs2 = 0;
+	if(mode == GREP_RECORDS) {
+		outs = smalloc((demux->n + 1) * sizeof(FILE *));
+		outs2 = set == SET_PE ? smalloc((demux->n + 1) * sizeof(FILE *)) : 0;
+		for(s = 0; s <= demux->n; ++s) {
+			outs[s] = openSample(s < demux->n ? demux->names[s] : 0, "undetermined", set == SET_SE ? "" : set == SET_INT ? "_int" : "_1", opts);
+			if(outs2) {
+				outs2[s] = openSample(s < demux->n ? demux->names[s] : 0, "undetermined", "_2", opts);
+			}
+		}
+	} else if(*opts->outputfilename == '-' && opts->outputfilename[1] == 0) {
+		out = stdout;
+	} else {
+		out = sfopen(opts->outputfilename, "ab");
+	}
+	
+	for(i = 0; i < n; i += 1 + (set == SET_PE)) {
+		/* determine filetype and open it */
+		FASTQ = openAndDetermineFQ(inputfile, inputfilenames[i]);
+		FASTQ2 = inputfile2 ? openAndDetermineFQ(inputfile2, inputfilenames[i + 1]) : 1;
+		if((FASTQ & 9) != 1 || (FASTQ2 & 9) != 1) {
+			fprintf(stderr, "Demultiplexing needs fastq input:\t%s\n", inputfilenames[i]);
+			exit(1);
+		}
+		fprintf(stderr, "%s\t%s\n", "# Reading inputfile: ", inputfilenames[i]);
+		count = 0;
+		progress_input(prog, inputfilenames[i], inputfile, inputfile2, &count);
+		hash = opts->shard && (inputfile2 || !shard_input(opts->shard, inputfile, FASTQ, pairs));
+		
+		/* route each record or pair by the sample of its first header */
+		reader = fqBatchReader_start(inputfile, pool, 4, getBatch);
+		reader2 = inputfile2 ? fqBatchReader_start(inputfile2, pool, 4, getBatch) : 0;
+		batch = 0;
+		batch2 = 0;
+		o = 0;
+		o2 = 0;
+		while(nextBatch(reader, &batch, &o, 0, 0, 0) && (!reader2 || nextBatch(reader2, &batch2, &o2, 0, 0, 0))) {
+			/* batches closed by size may hold different numbers of mates */
+			m = batch2 && batch2->n - o2 < batch->n - o ? batch2->n - o2 : batch->n - o;
+			for(j = pairs; j < m; j += pairs + 1) {
+				k = o + j - pairs;
+				if(hash && !shard_mine(opts->shard, qbatch_header(batch, k))) {
+					continue;
+				} else if((s = demux_sample(demux, qbatch_header(batch, k))) < 0) {
+					s = demux->n;
+				} else {
+					++count;
+				}
+				++counts[s];
+				if(mode == GREP_RECORDS) {
+					for(; k <= o + j; ++k) {
+						qbatch_printFq(batch, k, outs[s]);
+					}
+					if(batch2) {
+						qbatch_printFq(batch2, o2 + j, outs2[s]);
+					}
+				}
+			}
+			progress_update(prog, batch2 ? m << 1 : m);
+			if((o += m) == batch->n) {
+				qbatchpool_put(pool, batch);
+				batch = 0;
+			}
+			if(batch2 && (o2 += m) == batch2->n) {
+				qbatchpool_put(pool, batch2);
+				batch2 = 0;
+			}
+		}
+		if(batch) {
+			qbatchpool_put(pool, batch);
+		}
+		if(batch2) {
+			qbatchpool_put(pool, batch2);
+		}
+		fqBatchReader_stop(reader);
+		if(reader2) {
+			fqBatchReader_stop(reader2);
+		}
+		
+		/* records per sample */
+		for(s = 0, total = 0; s <= demux->n; ++s) {
+			if(out && inputfile2) {
+				fprintf(out, "%s\t%s\t%s\t%ld\n", inputfilenames[i], inputfilenames[i + 1], s < demux->n ? demux->names[s] : "undetermined", counts[s]);
+			} else if(out) {
+				fprintf(out, "%s\t%s\t%ld\n", inputfilenames[i], s < demux->n ? demux->names[s] : "undetermined", counts[s]);
+			}
+			total += counts[s];
+			counts[s] = 0;
+		}
+		fprintf(stderr, "# Demultiplexed %ld of %ld.\n", count, total);
+		progress_close(prog);
+		
+		closeFileBuff(inputfile);
+		if(inputfile2) {
+			closeFileBuff(inputfile2);
+		}
+	}
+	
+	/* clean up */
+	for(s = 0; outs && s <= demux->n; ++s) {
+		if(outs[s] != stdout) {
+			fclose(outs[s]);
+		}
+		if(outs2 && outs2[s] != stdout) {
+			fclose(outs2[s]);
+		}
+	}
+	if(out && out != stdout) {
+		fclose(out);
+	}
+	free(outs);
+	free(outs2);
+	free(counts);
+	qbatchpool_destroy(pool);
+	destroyFileBuff(inputfile);
+	if(inputfile2) {
+		destroyFileBuff(inputfile2);
+	}
+	
+	return 0;
+}
+
+static long repairProbe(Repair *table, FileBuff *inputfile, QBatchPool *pool, FILE *out, FILE *out2, FILE *uout2, Progress *prog, long *orphans) {
+	
+	int j;
+	long k, count;
+	QBatch *batch;
+	FqBatchReader *reader;
+	
+	/* second mates find their first in the table, or are orphans */
+	count = 0;
+	reader = fqBatchReader_start(inputfile, pool, 4, &FileBuffgetFqBatch);
+	while((batch = fqBatchReader_get(reader))) {
+		for(j = 0; j < batch->n; ++j) {
+			if(0 <= (k = repair_take(table, qbatch_header(batch, j)))) {
+				repair_print(table, k, out);
+				qbatch_printFq(batch, j, out2);
+				++count;
+			} else {
+				qbatch_printFq(batch, j, uout2);
+				++*orphans;
+			}
+		}
+		progress_update(prog, batch->n);
+		qbatchpool_put(pool, batch);
+	}
+	fqBatchReader_stop(reader);
+	
+	return count;
+}
+
+static int repairParts(Repair *table, FileBuff *inputfile) {
+	
+	int parts;
+	long long in;
+	struct stat st;
+	
+	/* enough partitions for each to fit the memory twice, from how far the table got */
+	parts = 64;
+	if(0 < (in = ftello(inputfile->file)) && fstat(fileno(inputfile->file), &st) == 0 && S_ISREG(st.st_mode)) {
+		parts = 2 * st.st_size / in + 1;
+	}
+	
+	return parts < REPAIR_MAXPARTS ? parts : REPAIR_MAXPARTS;
+}
+
+static void repairSplit(RepairParts *parts, int p, RepairParts *dest, FileBuff *partfile, QBatchPool *pool) {
+	
+	int j, k;
+	long long size;
+	FILE *file;
+	QBatch *batch;
+	FqBatchReader *reader;
+	
+	/* move both mates of a partition into subpartitions */
+	for(k = 0; k < 2; ++k) {
+		file = repairparts_file(parts, k, p, &size);
+		rangeFileBuff(partfile, file, 0, size);
+		reader = fqBatchReader_start(partfile, pool, 4, &FileBuffgetFqBatch);
+		while((batch = fqBatchReader_get(reader))) {
+			for(j = 0; j < batch->n; ++j) {
+				repairparts_put(dest, k, batch, j);
+			}
+			qbatchpool_put(pool, batch);
+		}
+		fqBatchReader_stop(reader);
+	}
+}
+
+static long repairJoin(Repair *table, RepairParts *parts, int p, FileBuff *partfile, QBatchPool *pool, FILE *out, FILE *out2, FILE *uout, FILE *uout2, long *orphans) {
+	
+	int j, n, over;
+	long count;
+	long long size;
+	FILE *file;
+	QBatch *batch;
+	FqBatchReader *reader;
+	RepairParts *sub;
+	
+	/* first mates of the partition into the table */
+	repair_clear(table);
+	file = repairparts_file(parts, 0, p, &size);
+	rangeFileBuff(partfile, file, 0, size);
+	over = 0;
+	reader = fqBatchReader_start(partfile, pool, 4, &FileBuffgetFqBatch);
+	while(!over && (batch = fqBatchReader_get(reader))) {
+		for(j = 0; j < batch->n && !over; ++j) {
+			/* the last level is kept whole, as names may repeat */
+			over = repair_add(table, batch, j) && parts->level < REPAIR_MAXLEVEL;
+		}
+		qbatchpool_put(pool, batch);
+	}
+	fqBatchReader_stop(reader);
+	
+	if(over) {
+		/* split a partition outgrowing the memory, and join its parts */
+		n = 2 * size / table->len + 1;
+		sub = repairparts_init(n < REPAIR_MAXSPLIT ? n : REPAIR_MAXSPLIT, parts->level + 1);
+		repair_clear(table);
+		repairSplit(parts, p, sub, partfile, pool);
+		for(j = 0, count = 0; j < sub->n; ++j) {
+			count += repairJoin(table, sub, j, partfile, pool, out, out2, uout, uout2, orphans);
+		}
+		repairparts_destroy(sub);
+		return count;
+	}
+	
+	/* second mates probe it */
+	file = repairparts_file(parts, 1, p, &size);
+	rangeFileBuff(partfile, file, 0, size);
+	count = repairProbe(table, partfile, pool, out, out2, uout2, 0, orphans);
+	*orphans += repair_orphans(table, uout);
+	
+	return count;
+}
+
+int repairgrep(GrepOpts *opts, char **inputfilenames, int pe) {
+	
+	int i, j, p;
+	unsigned FASTQ, FASTQ2;
+	long count, orphans;
+	FILE *out, *out2, *uout, *uout2;
+	FileBuff *inputfile, *inputfile2, *partfile;
+	QBatch *batch;
+	QBatchPool *pool;
+	FqBatchReader *reader;
+	Progress *prog;
+	Repair *table;
+	
+	if(!pe) {
+		return 0;
+	} else if(pe & 1) {
+		fprintf(stderr, "Uneven number of paired end reads.\n");
+		return 1;
+	}
+	
+	/* init */
+	pool = qbatchpool_init(6, QBATCHSIZE);
+	table = repair_init((long long)(opts->repairmemory) << 20);
+	inputfile = setFileBuff(opts->buffsize);
+	inputfile2 = setFileBuff(opts->buffsize);
+	partfile = setFileBuff(opts->buffsize);
+	ioFileBuff(inputfile, opts->ioflags, opts->iosize);
+	ioFileBuff(inputfile2, opts->ioflags, opts->iosize);
+	inputfile->gzspan = opts->gzspan;
+	inputfile2->gzspan = opts->gzspan;
+	inputfile->thread_num = opts->thread_num;
+	inputfile2->thread_num = opts->thread_num;
+	prog = opts->progress;
+	out = zstdOutput(openOutput(opts->outputfilename, "_1", 1, 0, -1, opts), opts);
+	out2 = zstdOutput(openOutput(opts->outputfilename, "_2", 1, 0, -1, opts), opts);
+	uout = openSample(0, "orphans", "_1", opts);
+	uout2 = openSample(0, "orphans", "_2", opts);
+	
+	for(i = 0; i < pe; i += 2) {
+		/* determine filetype and open it */
+		FASTQ = openAndDetermineFQ(inputfile, inputfilenames[i]);
+		FASTQ2 = openAndDetermineFQ(inputfile2, inputfilenames[i + 1]);
+		if((FASTQ & 9) != 1 || (FASTQ2 & 9) != 1) {
+			fprintf(stderr, "Repair needs fastq input:\t%s\t%s\n", inputfilenames[i], inputfilenames[i + 1]);
+			exit(1);
+		}
+		fprintf(stderr, "%s\t%s\t%s\n", "# Reading inputfiles: ", inputfilenames[i], inputfilenames[i + 1]);
+		count = 0;
+		orphans = 0;
+		progress_input(prog, inputfilenames[i], inputfile, inputfile2, &count);
+		
+		/* first mates go into the table, or to partitions on disk once it is full */
+		reader = fqBatchReader_start(inputfile, pool, 4, &FileBuffgetFqBatch);
+		while((batch = fqBatchReader_get(reader))) {
+			for(j = 0; j < batch->n; ++j) {
+				if(table->spill) {
+					repair_put(table, 0, batch, j);
+				} else if(repair_add(table, batch, j)) {
+					repair_spill(table, repairParts(table, inputfile));
+				}
+			}
+			progress_update(prog, batch->n);
+			qbatchpool_put(pool, batch);
+		}
+		fqBatchReader_stop(reader);
+		
+		if(!table->spill) {
+			/* join in memory */
+			count = repairProbe(table, inputfile2, pool, out, out2, uout2, prog, &orphans);
+			orphans += repair_orphans(table, uout);
+		} else {
+			/* partition second mates alike, and join one partition at a time */
+			reader = fqBatchReader_start(inputfile2, pool, 4, &FileBuffgetFqBatch);
+			while((batch = fqBatchReader_get(reader))) {
+				for(j = 0; j < batch->n; ++j) {
+					repair_put(table, 1, batch, j);
+				}
+				progress_update(prog, batch->n);
+				qbatchpool_put(pool, batch);
+			}
+			fqBatchReader_stop(reader);
+			for(p = 0; p < table->spill->n; ++p) {
+				count += repairJoin(table, table->spill, p, partfile, pool, out, out2, uout, uout2, &orphans);
+			}
+		}
+		fprintf(stderr, "# Repaired %ld pairs, with %ld orphans.\n", count, orphans);
+		progress_close(prog);
+		repair_reset(table);
+		
+		closeFileBuff(inputfile);
+		closeFileBuff(inputfile2);
+	}
+	
+	/* clean up */
+	if(out != stdout) {
+		fclose(out);
+	}
+	if(out2 != stdout) {
+		fclose(out2);
+	}
+	if(uout != stdout) {
+		fclose(uout);
+	}
+	if(uout2 != stdout) {
+		fclose(uout2);
+	}
+	qbatchpool_destroy(pool);
+	repair_destroy(table);
+	destroyFileBuff(inputfile);
+	destroyFileBuff(inputfile2);
+	destroyFileBuff(partfile);
+	
+	return 0;
+}
+
+Target * loadTargets(char *targetfilename, GrepOpts *opts) {
 	
-	int error;
 	Target *targets;
 	
 	/* get targets */
-	targets = getTargets(targetfilename);
+	if(!(targets = targetfilename ? getTargets(targetfilename, opts->thread_num) : target_malloc(1))) {
+		ERROR();
+	}
+	target_engine(targets, opts->engine);
+	if(opts->patternfilename) {
+		targets->dfa = getPatterns(opts->patternfilename);
+	}
+	
+	return targets;
+}
+
+static unsigned long grepId(GrepOpts *opts, char **inputfilenames, int se, char **intfilenames, int inter, char **pefilenames, int pe) {
+	
+	int i;
+	char num[64];
+	unsigned long crc;
 	
-	/* get single end matches */
-	error = segrep(targets, invert, inputfilenames, se, outputfilename);
+	/* identify the command a checkpoint belongs to */
+	sprintf(num, "%d %u %d %d %d", opts->mode, opts->invert, se, inter, pe);
+	crc = crc32(0, (unsigned char *)(num), strlen(num) + 1);
+	crc = crc32(crc, (unsigned char *)(opts->outputfilename), strlen(opts->outputfilename) + 1);
+	if(opts->unmatchedname) {
+		crc = crc32(crc, (unsigned char *)(opts->unmatchedname), strlen(opts->unmatchedname) + 1);
+	}
+	for(i = 0; i < se; ++i) {
+		crc = crc32(crc, (unsigned char *)(inputfilenames[i]), strlen(inputfilenames[i]) + 1);
+	}
+	for(i = 0; i < inter; ++i) {
+		crc = crc32(crc, (unsigned char *)(intfilenames[i]), strlen(intfilenames[i]) + 1);
+	}
+	for(i = 0; i < pe; ++i) {
+		crc = crc32(crc, (unsigned char *)(pefilenames[i]), strlen(pefilenames[i]) + 1);
+	}
 	
-	/* get interleaved matches */
-	error |= intgrep(targets, invert, intfilenames, inter, outputfilename);
+	return crc;
+}
+
+int targetgrep(Target *targets, GrepOpts *opts, char **inputfilenames, int se, char **intfilenames, int inter, char **pefilenames, int pe) {
 	
-	/* get paired end matches */
-	error |= pegrep(targets, invert, pefilenames, pe, outputfilename);
+	int error;
+	FILE *out;
+	Checkpoint *ckpt;
+	Progress *prog;
+	
+	/* gzip input is resumed from the access points of its index, which the checkpoint keeps unless -g asks to store it */
+	ckpt = 0;
+	if(opts->checkpointname) {
+		if(!opts->gzspan) {
+			opts->gzspan = CHECKPOINT_GZSPAN;
+			opts->ioflags |= FILEBUFF_GZMEMORY;
+		}
+		ckpt = checkpoint_init(opts->checkpointname, opts->checkpointinterval, grepId(opts, inputfilenames, se, intfilenames, inter, pefilenames, pe));
+	}
+	opts->checkpoint = ckpt;
+	
+	/* reports from counters of the grep loops */
+	prog = progress_init(opts->heartbeatname, opts->progressinterval);
+	progress_add(prog, inputfilenames, se);
+	progress_add(prog, intfilenames, inter);
+	progress_add(prog, pefilenames, pe);
+	opts->progress = prog;
+	
+	/* outputs of a shard are named after it, and merged by name */
+	if(opts->shardtotal) {
+		opts->shard = shard_init(opts->shardnum, opts->shardtotal, opts->mode == GREP_COUNT, &opts->outputfilename, &opts->unmatchedname);
+		if(opts->mode) {
+			shard_output(opts->shard, opts->outputfilename, opts->outputfilename);
+		}
+	}
+	
+	/* counts and ids of all inputs go to one file */
+	if(opts->mode && !(*opts->outputfilename == '-' && opts->outputfilename[1] == 0)) {
+		if(ckpt && ckpt->resume) {
+			if(checkpoint_truncate((out = sfopen(opts->outputfilename, "ab")), ckpt->size[0])) {
+				fprintf(stderr, "Cannot resume output:\t%s\n", opts->outputfilename);
+				exit(1);
+			}
+			fclose(out);
+		} else {
+			fclose(sfopen(opts->outputfilename, "wb"));
+		}
+	}
+	
+	if(opts->demux) {
+		/* sort records by sample instead */
+		error = demuxgrep(opts->demux, opts, inputfilenames, se, SET_SE);
+		error |= demuxgrep(opts->demux, opts, intfilenames, inter, SET_INT);
+		error |= demuxgrep(opts->demux, opts, pefilenames, pe, SET_PE);
+	} else if(opts->repair) {
+		/* resynchronise mates */
+		error = repairgrep(opts, pefilenames, pe);
+	} else {
+		/* get single end matches */
+		error = segrep(targets, opts, inputfilenames, se);
+		
+		/* get interleaved matches */
+		error |= intgrep(targets, opts, intfilenames, inter);
+		
+		/* get paired end matches */
+		error |= pegrep(targets, opts, pefilenames, pe);
+	}
+	
+	/* the manifest marks a finished shard */
+	if(opts->shard) {
+		if(!error && shard_save(opts->shard)) {
+			ERROR();
+		}
+		opts->outputfilename = opts->shard->prefix[0];
+		opts->unmatchedname = opts->shard->prefix[1];
+		shard_destroy(opts->shard);
+		opts->shard = 0;
+	}
+	
+	/* finished runs are not resumed */
+	if(ckpt && !error) {
+		checkpoint_done(ckpt);
+	} else if(ckpt) {
+		checkpoint_destroy(ckpt);
+	}
+	opts->checkpoint = 0;
+	if(opts->progressinterval) {
+		progress_report(prog, error ? "failed" : "done");
+	}
+	progress_destroy(prog);
+	opts->progress = 0;
+	
+	return error;
+}
+
+int fqgrep(char *targetfilename, GrepOpts *opts, char **inputfilenames, int se, char **intfilenames, int inter, char **pefilenames, int pe) {
+	
+	int error;
+	Target *targets;
+	
+	targets = loadTargets(targetfilename, opts);
+	if(opts->demuxname) {
+		opts->demux = demux_init(opts->demuxname);
+	}
+	error = targetgrep(targets, opts, inputfilenames, se, intfilenames, inter, pefilenames, pe);
+	target_destroy(targets);
+	demux_destroy(opts->demux);
+	opts->demux = 0;
 	
 	return error;
 }
@@ -17,10 +17,78 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <pthread.h>
+#include <stdio.h>
+#include "checkpoint.h"
+#include "demux.h"
 #include "filebuff.h"
+#include "progress.h"
+#include "repair.h"
+#include "shard.h"
 #include "targets.h"
 
-int segrep(Target *targets, unsigned invert, char **inputfilenames, int se, char *outputfilename);
-int intgrep(Target *targets, unsigned invert, char **inputfilenames, int inter, char *outputfilename);
-int pegrep(Target *targets, unsigned invert, char **inputfilenames, int pe, char *outputfilename);
-int fqgrep(char *targetfilename, unsigned invert, char **inputfilenames, int se, char **intfilenames, int inter, char **pefilenames, int pe, char *outputfilename);
+#ifndef FQGREP
+typedef struct grepOpts GrepOpts;
+typedef struct grepRange GrepRange;
+struct grepOpts {
+	unsigned invert;
+	int thread_num;
+	int engine;
+	int mode;
+	int stream;
+	int bamout;
+	long long gzspan;
+	char *outputfilename;
+	char *patternfilename;
+	char *socketname;
+	char *unmatchedname;
+	char *checkpointname;
+	int checkpointinterval;
+	Checkpoint *checkpoint;
+	char *heartbeatname;
+	int progressinterval;
+	Progress *progress;
+	int buffsize;
+	int iosize;
+	int ioflags;
+	int zstdlevel;
+	int zstdworkers;
+	int shardnum;
+	int shardtotal;
+	Shard *shard;
+	char *demuxname;
+	Demux *demux;
+	int repair;
+	int repairmemory;
+};
+struct grepRange {
+	int pairs;
+	int share; /* share of indexed gzip input, 0 for byte ranges */
+	int shares;
+	long long start;
+	long long end;
+	long *count; /* shared by the ranges of an input */
+	FILE *file;
+	char *filename;
+	GzIndex *index;
+	FILE *out;
+	FILE *uout;
+	Target *targets;
+	GrepOpts *opts;
+	pthread_t id;
+};
+#define FQGREP 1
+#define GREP_RECORDS 0
+#define GREP_COUNT 1
+#define GREP_IDS 2
+#endif
+
+GrepOpts * grepOpts_init(void);
+int segrep(Target *targets, GrepOpts *opts, char **inputfilenames, int se);
+int intgrep(Target *targets, GrepOpts *opts, char **inputfilenames, int inter);
+int pegrep(Target *targets, GrepOpts *opts, char **inputfilenames, int pe);
+int demuxgrep(Demux *demux, GrepOpts *opts, char **inputfilenames, int n, int set);
+int repairgrep(GrepOpts *opts, char **inputfilenames, int pe);
+Target * loadTargets(char *targetfilename, GrepOpts *opts);
+int targetgrep(Target *targets, GrepOpts *opts, char **inputfilenames, int se, char **intfilenames, int inter, char **pefilenames, int pe);
+int fqgrep(char *targetfilename, GrepOpts *opts, char **inputfilenames, int se, char **intfilenames, int inter, char **pefilenames, int pe);
@@ -0,0 +1,194 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _XOPEN_SOURCE 600
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "fqsplit.h"
+#include "pherror.h"
+
+static long fqsplit_line(unsigned char *buff, long len, long pos) {
+	
+	unsigned char *end;
+	
+	/* start of the next line, -1 when it is not in the buffer */
+	if(pos < 0 || len <= pos || !(end = memchr(buff + pos, '\n', len - pos))) {
+		return -1;
+	}
+	
+	return end - buff + 1;
+}
+
+static long fqsplit_record(unsigned char *buff, long len, long pos, int eof) {
+	
+	int i;
+	long line[5];
+	
+	/*
+	 * end of the record starting at pos, 0 when it does not start one
+	 * and -1 when the buffer is too short to tell. A quality line may
+	 * start with '@', but then the line after the next is sequence and
+	 * not the '+' separator.
+	 */
+	line[0] = pos;
+	for(i = 1; i < 5; ++i) {
+		if((line[i] = fqsplit_line(buff, len, line[i - 1])) < 0) {
+			return -1;
+		}
+	}
+	if(buff[line[0]] != '@' || buff[line[2]] != '+' || line[2] - line[1] != line[4] - line[3]) {
+		return 0;
+	} else if(line[4] == len) {
+		return eof ? line[4] : -1;
+	}
+	
+	return buff[line[4]] == '@' ? line[4] : 0;
+}
+
+static int fqsplit_mates(unsigned char *buff, long h1, long h2) {
+	
+	long len1, len2;
+	
+	/* ids up to the first whitespace, without /1 and /2 */
+	len1 = 0;
+	while(!isspace(buff[h1 + len1])) {
+		++len1;
+	}
+	len2 = 0;
+	while(!isspace(buff[h2 + len2])) {
+		++len2;
+	}
+	if(len1 == len2 && 2 < len1 && buff[h1 + len1 - 2] == '/' && buff[h2 + len2 - 2] == '/') {
+		len1 -= 2;
+		len2 -= 2;
+	}
+	
+	return len1 == len2 && memcmp(buff + h1, buff + h2, len1) == 0;
+}
+
+long fqsplit_search(unsigned char *buff, long len, int eof, int pairs) {
+	
+	int i;
+	long pos, rec[4];
+	
+	/* first record after the partial line at the start of buff, -2 when more is needed */
+	rec[1] = 0;
+	pos = fqsplit_line(buff, len, 0);
+	while(0 <= pos && pos < len) {
+		if((rec[1] = fqsplit_record(buff, len, pos, eof)) < 0) {
+			return eof ? -1 : -2;
+		} else if(rec[1]) {
+			break;
+		}
+		pos = fqsplit_line(buff, len, pos);
+	}
+	if(pos < 0 || len <= pos) {
+		return eof ? -1 : -2;
+	} else if(!pairs) {
+		return pos;
+	}
+	
+	/* mates of interleaved input follow each other, check which pair is one */
+	rec[0] = pos;
+	for(i = 2; i < 4; ++i) {
+		if(len <= rec[i - 1]) {
+			return -1;
+		} else if((rec[i] = fqsplit_record(buff, len, rec[i - 1], eof)) < 0) {
+			return eof ? -1 : -2;
+		} else if(rec[i] == 0) {
+			return -1;
+		}
+	}
+	if(fqsplit_mates(buff, rec[0] + 1, rec[1] + 1)) {
+		return rec[0];
+	} else if(fqsplit_mates(buff, rec[1] + 1, rec[2] + 1)) {
+		return rec[1];
+	}
+	
+	return -1;
+}
+
+long long fqsplit_sync(int fd, long long offset, long long size, int pairs) {
+	
+	long len, window, pos;
+	unsigned char *buff;
+	
+	/* read from the byte before offset, so a record starting at offset is found */
+	if(offset <= 0) {
+		return 0;
+	}
+	pos = -2;
+	for(window = FQSPLIT_WINDOW; pos == -2 && window <= FQSPLIT_MAXWINDOW; window <<= 1) {
+		buff = smalloc(window);
+		if((len = pread(fd, buff, window, offset - 1)) < 0) {
+			ERROR();
+		}
+		pos = fqsplit_search(buff, len, size <= offset - 1 + len, pairs);
+		free(buff);
+	}
+	
+	return 0 <= pos ? offset - 1 + pos : -1;
+}
+
+int fqsplit_ranges(int fd, long long start, long long end, int n, int pairs, long long *bounds) {
+	
+	int i, m;
+	long long pos, size;
+	
+	/* n ranges of at least FQSPLIT_MIN, boundaries that cannot be synced are dropped */
+	size = end - start;
+	if(size / FQSPLIT_MIN < n) {
+		n = size / FQSPLIT_MIN;
+	}
+	bounds[0] = start;
+	m = 1;
+	for(i = 1; i < n; ++i) {
+		pos = fqsplit_sync(fd, start + size * i / n, end, pairs);
+		if(bounds[m - 1] < pos && pos < end) {
+			bounds[m++] = pos;
+		}
+	}
+	bounds[m] = end;
+	
+	return m;
+}
+
+FILE * fqsplit_tmpfile(void) {
+	
+	int fd;
+	char *dir, *filename;
+	FILE *dest;
+	
+	/* unlinked file in TMPDIR, for output of a range */
+	if(!(dir = getenv("TMPDIR"))) {
+		dir = "/tmp";
+	}
+	filename = smalloc(strlen(dir) + 16);
+	sprintf(filename, "%s/fqgrepXXXXXX", dir);
+	if((fd = mkstemp(filename)) < 0 || !(dest = fdopen(fd, "w+b"))) {
+		ERROR();
+	}
+	unlink(filename);
+	free(filename);
+	
+	return dest;
+}
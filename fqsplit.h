@@ -0,0 +1,33 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdio.h>
+
+#ifndef FQSPLIT
+#define FQSPLIT 1
+#define FQSPLIT_MIN 16777216 /* smallest range worth a thread */
+#define FQSPLIT_WINDOW 1048576
+#define FQSPLIT_MAXWINDOW 67108864
+#endif
+
+/* byte ranges of plain fastq, cut at record or mate pair boundaries */
+long fqsplit_search(unsigned char *buff, long len, int eof, int pairs);
+long long fqsplit_sync(int fd, long long offset, long long size, int pairs);
+int fqsplit_ranges(int fd, long long start, long long end, int n, int pairs, long long *bounds);
+FILE * fqsplit_tmpfile(void);
@@ -0,0 +1,313 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "gzindex.h"
+#include "pherror.h"
+
+static const char gzindex_magic[8] = {'f', 'q', 'g', 'z', 'i', 'd', 'x', 2};
+
+GzIndex * gzindex_init(char *filename, long long span) {
+	
+	FILE *infile;
+	GzIndex *dest;
+	struct stat st;
+	
+	if(stat(filename, &st) || !S_ISREG(st.st_mode)) {
+		return 0;
+	}
+	
+	dest = smalloc(sizeof(GzIndex));
+	dest->mtime = st.st_mtime;
+	memset(dest->trailer, 0, sizeof(dest->trailer));
+	if((infile = fopen(filename, "rb"))) {
+		/* tells files of the same size and age apart */
+		if(fseeko(infile, -8, SEEK_END) == 0 && fread(dest->trailer, 1, sizeof(dest->trailer), infile) != sizeof(dest->trailer)) {
+			memset(dest->trailer, 0, sizeof(dest->trailer));
+		}
+		fclose(infile);
+	}
+	dest->n = 0;
+	dest->size = 8;
+	dest->raw = 0;
+	dest->partial = 0;
+	dest->shared = 0;
+	dest->span = span;
+	dest->insize = st.st_size;
+	dest->inbase = 0;
+	dest->outbase = 0;
+	dest->last = 0;
+	dest->wpos = 0;
+	dest->window = smalloc(WINSIZE);
+	memset(dest->window, 0, WINSIZE);
+	dest->list = smalloc(dest->size * sizeof(GzPoint));
+	dest->filename = smalloc(strlen(filename) + strlen(GZINDEX_EXT) + 1);
+	sprintf(dest->filename, "%s%s", filename, GZINDEX_EXT);
+	
+	return dest;
+}
+
+void gzindex_window(GzIndex *index, unsigned char *out, unsigned len) {
+	
+	unsigned cpy;
+	
+	/* keep the last WINSIZE bytes of output in the circular window */
+	if(WINSIZE <= len) {
+		memcpy(index->window, out + len - WINSIZE, WINSIZE);
+		index->wpos = 0;
+		return;
+	}
+	cpy = WINSIZE - index->wpos;
+	if(len < cpy) {
+		cpy = len;
+	}
+	memcpy(index->window + index->wpos, out, cpy);
+	if(cpy < len) {
+		memcpy(index->window, out + cpy, len - cpy);
+		index->wpos = len - cpy;
+	} else if((index->wpos += cpy) == WINSIZE) {
+		index->wpos = 0;
+	}
+}
+
+void gzindex_addpoint(GzIndex *index, z_stream *strm) {
+	
+	long long out;
+	GzPoint *point;
+	
+	/* only at block boundaries that are not the end of a member */
+	if(!(strm->data_type & 128) || (strm->data_type & 64)) {
+		return;
+	}
+	out = index->outbase + strm->total_out;
+	if(index->n && out - index->last < index->span) {
+		return;
+	}
+	
+	if(index->n == index->size) {
+		index->size <<= 1;
+		index->list = realloc(index->list, index->size * sizeof(GzPoint));
+		if(!index->list) {
+			ERROR();
+		}
+	}
+	point = index->list + index->n++;
+	point->out = out;
+	point->in = index->inbase + strm->total_in;
+	point->bits = strm->data_type & 7;
+	point->window = smalloc(WINSIZE);
+	memcpy(point->window, index->window + index->wpos, WINSIZE - index->wpos);
+	memcpy(point->window + WINSIZE - index->wpos, index->window, index->wpos);
+	index->last = out;
+}
+
+void gzindex_reset(GzIndex *index, z_stream *strm) {
+	
+	/* new member in a concatenated file */
+	index->inbase += strm->total_in;
+	index->outbase += strm->total_out;
+}
+
+void gzindex_rebase(GzIndex *index, GzPoint *point) {
+	
+	/* continue building after inflate was restored at point */
+	while(index->n && point->out <= index->list[index->n - 1].out) {
+		free(index->list[--index->n].window);
+	}
+	index->inbase = point->in;
+	index->outbase = point->out;
+	index->last = index->n ? index->list[index->n - 1].out : 0;
+	memcpy(index->window, point->window, WINSIZE);
+	index->wpos = 0;
+	index->partial = 1;
+}
+
+GzPoint * gzindex_point(GzIndex *index, long long offset) {
+	
+	int downlim, uplim, mid;
+	GzPoint *list;
+	
+	/* last access point at or before offset */
+	list = index->list;
+	if(!index->n || offset < list->out) {
+		return 0;
+	}
+	downlim = 0;
+	uplim = index->n - 1;
+	while(downlim < uplim) {
+		mid = (downlim + uplim + 1) >> 1;
+		if(list[mid].out <= offset) {
+			downlim = mid;
+		} else {
+			uplim = mid - 1;
+		}
+	}
+	
+	return list + downlim;
+}
+
+int gzindex_save(GzIndex *index) {
+	
+	int i, bits;
+	char *tmpname;
+	uLongf zlen;
+	unsigned char *zwindow;
+	FILE *outfile;
+	GzPoint *point;
+	
+	/* written aside and renamed into place, as other jobs may be reading it */
+	tmpname = smalloc(strlen(index->filename) + 32);
+	sprintf(tmpname, "%s.%ld.tmp", index->filename, (long)(getpid()));
+	if(!(outfile = fopen(tmpname, "wb"))) {
+		fprintf(stderr, "Cannot write gzip index:\t%s\n", index->filename);
+		free(tmpname);
+		return 1;
+	}
+	zwindow = smalloc(compressBound(WINSIZE));
+	
+	sfwrite(gzindex_magic, 1, sizeof(gzindex_magic), outfile);
+	sfwrite(&index->insize, sizeof(long long), 1, outfile);
+	sfwrite(&index->mtime, sizeof(long long), 1, outfile);
+	sfwrite(index->trailer, 1, sizeof(index->trailer), outfile);
+	sfwrite(&index->span, sizeof(long long), 1, outfile);
+	sfwrite(&index->n, sizeof(int), 1, outfile);
+	for(i = 0, point = index->list; i < index->n; ++i, ++point) {
+		zlen = compressBound(WINSIZE);
+		if(compress(zwindow, &zlen, point->window, WINSIZE) != Z_OK) {
+			fprintf(stderr, "Gzip error while compressing index window\n");
+			exit(1);
+		}
+		bits = point->bits;
+		sfwrite(&point->out, sizeof(long long), 1, outfile);
+		sfwrite(&point->in, sizeof(long long), 1, outfile);
+		sfwrite(&bits, sizeof(int), 1, outfile);
+		sfwrite(&zlen, sizeof(uLongf), 1, outfile);
+		sfwrite(zwindow, 1, zlen, outfile);
+	}
+	free(zwindow);
+	if(fclose(outfile) || rename(tmpname, index->filename)) {
+		fprintf(stderr, "Cannot write gzip index:\t%s\n", index->filename);
+		remove(tmpname);
+		free(tmpname);
+		return 1;
+	}
+	free(tmpname);
+	
+	return 0;
+}
+
+GzIndex * gzindex_load(char *filename, long long span) {
+	
+	int i;
+	char magic[sizeof(gzindex_magic)];
+	unsigned char trailer[8];
+	long long insize, mtime;
+	uLongf zlen, len;
+	unsigned char *zwindow;
+	FILE *infile;
+	GzIndex *dest;
+	GzPoint *point;
+	
+	/* get index and check that it belongs to the current file */
+	if(!(dest = gzindex_init(filename, 0))) {
+		return 0;
+	} else if(!(infile = fopen(dest->filename, "rb"))) {
+		gzindex_destroy(dest);
+		return 0;
+	}
+	free(dest->window);
+	dest->window = 0;
+	zwindow = smalloc(compressBound(WINSIZE));
+	if(fread(magic, 1, sizeof(magic), infile) != sizeof(magic) || memcmp(magic, gzindex_magic, sizeof(magic))
+		|| fread(&insize, sizeof(long long), 1, infile) != 1 || insize != dest->insize
+		|| fread(&mtime, sizeof(long long), 1, infile) != 1 || mtime != dest->mtime
+		|| fread(trailer, 1, sizeof(trailer), infile) != sizeof(trailer) || memcmp(trailer, dest->trailer, sizeof(trailer))
+		|| fread(&dest->span, sizeof(long long), 1, infile) != 1 || (span && dest->span != span)
+		|| fread(&dest->n, sizeof(int), 1, infile) != 1 || dest->n < 0) {
+		dest->n = 0;
+		i = -1;
+	} else {
+		dest->size = dest->n ? dest->n : 1;
+		dest->list = realloc(dest->list, dest->size * sizeof(GzPoint));
+		if(!dest->list) {
+			ERROR();
+		}
+		for(i = 0, point = dest->list; i < dest->n; ++i, ++point) {
+			point->window = 0;
+			len = WINSIZE;
+			if(fread(&point->out, sizeof(long long), 1, infile) != 1
+				|| fread(&point->in, sizeof(long long), 1, infile) != 1
+				|| fread(&point->bits, sizeof(int), 1, infile) != 1
+				|| fread(&zlen, sizeof(uLongf), 1, infile) != 1 || compressBound(WINSIZE) < zlen
+				|| fread(zwindow, 1, zlen, infile) != zlen
+				|| uncompress((point->window = smalloc(WINSIZE)), &len, zwindow, zlen) != Z_OK
+				|| len != WINSIZE) {
+				dest->n = i + (point->window != 0);
+				i = -1;
+				break;
+			}
+		}
+	}
+	fclose(infile);
+	free(zwindow);
+	
+	/* stale or truncated index */
+	if(i < 0) {
+		fprintf(stderr, "Ignoring invalid gzip index:\t%s\n", dest->filename);
+		gzindex_destroy(dest);
+		return 0;
+	}
+	
+	return dest;
+}
+
+GzIndex * gzindex_share(GzIndex *src) {
+	
+	GzIndex *dest;
+	
+	/* complete indexes are only read, so readers of their own may use the access points */
+	dest = smalloc(sizeof(GzIndex));
+	*dest = *src;
+	dest->raw = 0;
+	dest->shared = 1;
+	dest->filename = 0;
+	
+	return dest;
+}
+
+void gzindex_destroy(GzIndex *index) {
+	
+	int i;
+	
+	if(!index->shared) {
+		for(i = 0; i < index->n; ++i) {
+			free(index->list[i].window);
+		}
+		free(index->list);
+	}
+	free(index->window);
+	free(index->filename);
+	free(index);
+}
@@ -0,0 +1,64 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <zlib.h>
+
+#ifndef GZINDEX
+typedef struct gzPoint GzPoint;
+typedef struct gzIndex GzIndex;
+struct gzPoint {
+	long long out; /* offset in uncompressed data */
+	long long in; /* offset in compressed file of first full byte */
+	int bits; /* bits of the byte before "in" belonging to the point */
+	unsigned char *window; /* preceding WINSIZE uncompressed bytes */
+};
+struct gzIndex {
+	int n;
+	int size;
+	int raw; /* strm is inflating raw deflate from an access point */
+	int partial; /* built from a restored access point, not saved */
+	int shared; /* list belongs to the index it was shared from */
+	long long span;
+	long long insize;
+	long long mtime;
+	unsigned char trailer[8]; /* crc and size closing the file */
+	long long inbase;
+	long long outbase;
+	long long last;
+	unsigned wpos;
+	unsigned char *window; /* circular window, only set while building */
+	GzPoint *list;
+	char *filename;
+};
+#define GZINDEX 1
+#define WINSIZE 32768
+#define GZINDEX_EXT ".gzidx"
+#endif
+
+/* zran style checkpoint index of plain gzip files */
+GzIndex * gzindex_init(char *filename, long long span);
+void gzindex_window(GzIndex *index, unsigned char *out, unsigned len);
+void gzindex_addpoint(GzIndex *index, z_stream *strm);
+void gzindex_reset(GzIndex *index, z_stream *strm);
+void gzindex_rebase(GzIndex *index, GzPoint *point);
+GzPoint * gzindex_point(GzIndex *index, long long offset);
+int gzindex_save(GzIndex *index);
+GzIndex * gzindex_load(char *filename, long long span);
+GzIndex * gzindex_share(GzIndex *src);
+void gzindex_destroy(GzIndex *index);
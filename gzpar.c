@@ -0,0 +1,667 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _XOPEN_SOURCE 600
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "gzpar.h"
+#include "pherror.h"
+
+static const unsigned char gzpar_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static unsigned gzpar_get32(unsigned char *buff) {
+	return buff[0] | (buff[1] << 8) | (buff[2] << 16) | ((unsigned)(buff[3]) << 24);
+}
+
+static unsigned gzpar_bits(unsigned char *in, long long bit, int n) {
+	
+	unsigned char *buff;
+	
+	/* up to 16 bits, least significant first */
+	buff = in + (bit >> 3);
+	return ((buff[0] | (buff[1] << 8) | (buff[2] << 16)) >> (bit & 7)) & ((1 << n) - 1);
+}
+
+static int gzpar_code(unsigned char *lens, int n, int bits) {
+	
+	int i, left, max;
+	short count[16];
+	
+	/* 0 for complete codes, 1 for incomplete ones zlib takes and -1 otherwise */
+	memset(count, 0, sizeof(count));
+	max = 0;
+	for(i = 0; i < n; ++i) {
+		++count[lens[i]];
+		max = max < lens[i] ? lens[i] : max;
+	}
+	left = 1;
+	for(i = 1; i <= bits; ++i) {
+		left <<= 1;
+		if((left -= count[i]) < 0) {
+			return -1;
+		}
+	}
+	
+	return left == 0 ? 0 : max <= 1 ? 1 : -1;
+}
+
+static int gzpar_block(unsigned char *in, long len, long long bit) {
+	
+	int i, n, nlen, ndist, ncode, sym, rep, code, size;
+	short count[8], next[8], table[128];
+	unsigned char prev, lens[19], lengths[316];
+	
+	/* dynamic non-final block header, with valid huffman codes */
+	if(len < (bit >> 3) + 1024 || gzpar_bits(in, bit, 3) != 4) {
+		return 0;
+	}
+	nlen = gzpar_bits(in, bit + 3, 5) + 257;
+	ndist = gzpar_bits(in, bit + 8, 5) + 1;
+	ncode = gzpar_bits(in, bit + 13, 4) + 4;
+	if(286 < nlen || 30 < ndist) {
+		return 0;
+	}
+	bit += 17;
+	memset(lens, 0, sizeof(lens));
+	for(i = 0; i < ncode; ++i) {
+		lens[gzpar_order[i]] = gzpar_bits(in, bit, 3);
+		bit += 3;
+	}
+	if(gzpar_code(lens, 19, 7)) {
+		return 0;
+	}
+	
+	/* table of the code length code, indexed by the next 7 bits */
+	memset(count, 0, sizeof(count));
+	for(i = 0; i < 19; ++i) {
+		++count[lens[i]];
+	}
+	count[0] = 0;
+	code = 0;
+	for(i = 1; i < 8; ++i) {
+		code = (code + count[i - 1]) << 1;
+		next[i] = code;
+	}
+	for(sym = 0; sym < 19; ++sym) {
+		if((size = lens[sym])) {
+			code = next[size]++;
+			rep = 0;
+			for(i = 0; i < size; ++i) {
+				rep = (rep << 1) | ((code >> i) & 1);
+			}
+			for(i = rep; i < 128; i += 1 << size) {
+				table[i] = (size << 5) | sym;
+			}
+		}
+	}
+	
+	/* code lengths of literals, lengths and distances */
+	n = 0;
+	while(n < nlen + ndist) {
+		code = table[gzpar_bits(in, bit, 7)];
+		bit += code >> 5;
+		if((sym = code & 31) < 16) {
+			lengths[n++] = sym;
+			continue;
+		} else if(sym == 16) {
+			if(n == 0) {
+				return 0;
+			}
+			prev = lengths[n - 1];
+			rep = 3 + gzpar_bits(in, bit, 2);
+			bit += 2;
+		} else if(sym == 17) {
+			prev = 0;
+			rep = 3 + gzpar_bits(in, bit, 3);
+			bit += 3;
+		} else {
+			prev = 0;
+			rep = 11 + gzpar_bits(in, bit, 7);
+			bit += 7;
+		}
+		if(nlen + ndist < n + rep) {
+			return 0;
+		}
+		while(rep--) {
+			lengths[n++] = prev;
+		}
+	}
+	
+	return lengths[256] && 0 <= gzpar_code(lengths, nlen, 15) && 0 <= gzpar_code(lengths + nlen, ndist, 15);
+}
+
+static void gzpar_prime(z_stream *strm, unsigned char *in, long long bit, unsigned char *dict, int dictLen) {
+	
+	/* raw inflate from a bit offset, with a preset window */
+	inflateReset(strm);
+	strm->next_in = in + (bit >> 3);
+	if(bit & 7) {
+		inflatePrime(strm, 8 - (bit & 7), *strm->next_in++ >> (bit & 7));
+	}
+	if(dictLen) {
+		inflateSetDictionary(strm, dict, dictLen);
+	}
+}
+
+static int gzpar_trial(GzChunk *chunk, long long bit) {
+	
+	int status, nl;
+	unsigned char *out;
+	z_stream *strm;
+	
+	/* inflate the first block, with 255 for unknown bytes */
+	strm = &chunk->strm;
+	gzpar_prime(strm, chunk->in, bit, chunk->src->dicts, WINSIZE);
+	strm->avail_in = chunk->in + chunk->inLen - strm->next_in;
+	strm->next_out = chunk->scratch;
+	strm->avail_out = GZPAR_TRIAL;
+	do {
+		status = inflate(strm, Z_BLOCK);
+	} while(status == Z_OK && strm->avail_out && !(strm->data_type & 128));
+	if(status != Z_OK || strm->next_out - chunk->scratch < 1024) {
+		return 0;
+	}
+	
+	/* text, as sequence files are */
+	nl = 0;
+	for(out = chunk->scratch; out < strm->next_out; ++out) {
+		if(*out != 255 && (126 < *out || (*out < 32 && *out != '\n' && *out != '\r' && *out != '\t'))) {
+			return 0;
+		}
+		nl |= *out == '\n';
+	}
+	
+	return nl;
+}
+
+static long gzpar_load(GzChunk *chunk, long long offset, long long len) {
+	
+	long size;
+	
+	/* pread compressed data, the file offset is left to the reader */
+	if(chunk->inSize < len) {
+		free(chunk->in);
+		chunk->inSize = len;
+		chunk->in = smalloc(len);
+	}
+	chunk->inLen = 0;
+	while(chunk->inLen < len && 0 < (size = pread(chunk->src->fd, chunk->in + chunk->inLen, len - chunk->inLen, offset + chunk->inLen))) {
+		chunk->inLen += size;
+	}
+	
+	return chunk->inLen;
+}
+
+static long long gzpar_scan(GzChunk *chunk, long long from) {
+	
+	long long base, bit, stop;
+	GzPar *src;
+	
+	/* first block start within a chunk length from "from" */
+	src = chunk->src;
+	base = from >> 3;
+	stop = src->size - base < GZPAR_CHUNK ? src->size - base : GZPAR_CHUNK;
+	gzpar_load(chunk, base, src->size - base < GZPAR_CHUNK + GZPAR_SLACK ? src->size - base : GZPAR_CHUNK + GZPAR_SLACK);
+	stop <<= 3;
+	for(bit = from & 7; bit < stop; ++bit) {
+		if(gzpar_block(chunk->in, chunk->inLen, bit) && gzpar_trial(chunk, bit)) {
+			return (base << 3) + bit;
+		}
+	}
+	
+	return -1;
+}
+
+static int gzpar_pass(GzChunk *chunk, long long bit, unsigned char *dict) {
+	
+	int status;
+	z_stream *strm;
+	
+	/* inflate again up to the last unknown byte, with other markers */
+	strm = &chunk->strm;
+	gzpar_prime(strm, chunk->in, bit, dict, WINSIZE);
+	strm->avail_in = chunk->in + chunk->inLen - strm->next_in;
+	strm->next_out = chunk->scratch;
+	strm->avail_out = chunk->marks;
+	do {
+		status = inflate(strm, Z_NO_FLUSH);
+	} while(status == Z_OK && strm->avail_out);
+	
+	return strm->avail_out != 0;
+}
+
+static void gzpar_inflate(GzChunk *chunk) {
+	
+	int status;
+	long k, len;
+	long long base, bit, stop, pos;
+	unsigned char *out;
+	z_stream *strm;
+	GzPar *src;
+	
+	/* inflate from start to the first block boundary at or after stop */
+	src = chunk->src;
+	base = chunk->start >> 3;
+	if(chunk->stop == GZPAR_END || src->size - base < (chunk->stop >> 3) - base + GZPAR_SLACK) {
+		gzpar_load(chunk, base, src->size - base);
+	} else {
+		gzpar_load(chunk, base, (chunk->stop >> 3) - base + GZPAR_SLACK);
+	}
+	bit = chunk->start & 7;
+	stop = chunk->stop == GZPAR_END ? GZPAR_END : chunk->stop - (base << 3);
+	strm = &chunk->strm;
+	if(chunk == src->chunks) {
+		gzpar_prime(strm, chunk->in, bit, src->window + WINSIZE - src->winLen, src->winLen);
+	} else {
+		gzpar_prime(strm, chunk->in, bit, src->dicts + WINSIZE, WINSIZE);
+	}
+	strm->avail_in = chunk->in + chunk->inLen - strm->next_in;
+	strm->next_out = chunk->out;
+	strm->avail_out = chunk->outSize;
+	chunk->ok = 0;
+	chunk->final = 0;
+	chunk->binary = 0;
+	chunk->end = chunk->start;
+	chunk->outLen = 0;
+	chunk->marks = 0;
+	while(1) {
+		if(!strm->avail_out) {
+			len = strm->next_out - chunk->out;
+			chunk->outSize <<= 1;
+			chunk->out = realloc(chunk->out, chunk->outSize);
+			if(!chunk->out) {
+				ERROR();
+			}
+			strm->next_out = chunk->out + len;
+			strm->avail_out = chunk->outSize - len;
+		}
+		if((status = inflate(strm, Z_BLOCK)) == Z_STREAM_END) {
+			chunk->final = 1;
+			chunk->trailer = base + (strm->next_in - chunk->in);
+			chunk->end = chunk->trailer << 3;
+			chunk->outLen = strm->next_out - chunk->out;
+			break;
+		} else if(status != Z_OK) {
+			break;
+		} else if((strm->data_type & 128) && !(strm->data_type & 64)) {
+			pos = ((strm->next_in - chunk->in) << 3) - (strm->data_type & 7);
+			chunk->end = (base << 3) + pos;
+			chunk->outLen = strm->next_out - chunk->out;
+			if(stop <= pos) {
+				chunk->ok = pos == stop;
+				break;
+			}
+		}
+	}
+	if(chunk == src->chunks) {
+		return;
+	}
+	
+	/* window offsets of unknown bytes, from two more passes */
+	out = chunk->out;
+	for(k = chunk->outLen; k && out[k - 1] < 128; --k);
+	if(!(chunk->marks = k)) {
+		return;
+	} else if(chunk->scratchSize < k) {
+		free(chunk->scratch);
+		free(chunk->refs);
+		chunk->scratchSize = k;
+		chunk->scratch = smalloc(k);
+		chunk->refs = smalloc(k * sizeof(unsigned short));
+	}
+	if(gzpar_pass(chunk, bit, src->dicts + 2 * WINSIZE)) {
+		chunk->marks = -1;
+		return;
+	}
+	for(k = 0; k < chunk->marks; ++k) {
+		if(out[k] & 128) {
+			chunk->refs[k] = (out[k] & 127) | ((chunk->scratch[k] & 127) << 7);
+		}
+	}
+	if(gzpar_pass(chunk, bit, src->dicts + 3 * WINSIZE)) {
+		chunk->marks = -1;
+		return;
+	}
+	for(k = 0; k < chunk->marks; ++k) {
+		if(out[k] & 128) {
+			chunk->binary |= out[k] == chunk->scratch[k];
+			chunk->refs[k] |= (chunk->scratch[k] & 64) << 8;
+		}
+	}
+}
+
+static void * gzpar_worker(void *arg) {
+	
+	int i;
+	GzPar *src;
+	GzChunk *chunk;
+	
+	src = arg;
+	while((i = __sync_fetch_and_add(&src->next, 1)) < src->jobs) {
+		if(src->phase == 0) {
+			chunk = src->chunks + i + 1;
+			chunk->start = gzpar_scan(chunk, src->start + (long long)(i + 1) * GZPAR_CHUNK * 8);
+		} else if(0 <= (chunk = src->chunks + i)->start) {
+			gzpar_inflate(chunk);
+		}
+	}
+	
+	return NULL;
+}
+
+static void gzpar_run(GzPar *src, int phase, int jobs) {
+	
+	int i, thread_num, errcode;
+	
+	src->phase = phase;
+	src->jobs = jobs;
+	src->next = 0;
+	thread_num = jobs < src->thread_num ? jobs : src->thread_num;
+	for(i = 1; i < thread_num; ++i) {
+		if((errcode = pthread_create(&src->chunks[i].id, NULL, &gzpar_worker, src))) {
+			fprintf(stderr, "Error %d (%s)\n", errcode, strerror(errcode));
+			thread_num = i;
+			break;
+		}
+	}
+	gzpar_worker(src);
+	for(i = 1; i < thread_num; ++i) {
+		pthread_join(src->chunks[i].id, NULL);
+	}
+}
+
+static void gzpar_round(GzPar *src) {
+	
+	int i, n;
+	long long last, nominal;
+	GzChunk *chunk, *prev;
+	
+	/* guess block starts a chunk apart, and inflate up to the next one */
+	last = (src->size - 8) << 3;
+	n = 1;
+	while(!src->serial && n < src->thread_num && src->start + (long long) n * GZPAR_CHUNK * 8 < last) {
+		++n;
+	}
+	nominal = src->start + (long long) n * GZPAR_CHUNK * 8;
+	src->chunks[0].start = src->start;
+	src->chunks[n].start = -1;
+	if(1 < n) {
+		gzpar_run(src, 0, nominal < last ? n : n - 1);
+	}
+	prev = src->chunks;
+	for(i = 1; i < n; ++i) {
+		chunk = src->chunks + i;
+		if(0 <= chunk->start) {
+			prev->stop = chunk->start;
+			prev = chunk;
+		}
+	}
+	if(0 <= src->chunks[n].start) {
+		prev->stop = src->chunks[n].start;
+	} else {
+		prev->stop = nominal < last ? nominal : GZPAR_END;
+	}
+	gzpar_run(src, 1, n);
+	src->n = n;
+	src->cur = 0;
+	src->pos = 0;
+}
+
+static void gzpar_window(GzPar *src, GzChunk *chunk) {
+	
+	long k, len;
+	unsigned char *out;
+	
+	/* resolve unknown bytes, and slide the window */
+	out = chunk->out;
+	len = chunk->outLen;
+	for(k = 0; k < chunk->marks; ++k) {
+		if(out[k] & 128) {
+			out[k] = src->window[chunk->refs[k]];
+		}
+	}
+	src->crc = crc32(src->crc, out, len);
+	src->isize += len;
+	if(WINSIZE <= len) {
+		memcpy(src->window, out + len - WINSIZE, WINSIZE);
+		src->winLen = WINSIZE;
+	} else {
+		memmove(src->window, src->window + len, WINSIZE - len);
+		memcpy(src->window + WINSIZE - len, out, len);
+		src->winLen = WINSIZE < src->winLen + len ? WINSIZE : src->winLen + len;
+	}
+	src->in = chunk->end >> 3;
+}
+
+static long gzpar_header(unsigned char *buff, long len) {
+	
+	long pos;
+	
+	/* size of a gzip member header, -1 when there is none */
+	if(len < 10 || buff[0] != 31 || buff[1] != 139 || buff[2] != 8) {
+		return -1;
+	}
+	pos = 10;
+	if(buff[3] & 4) {
+		pos = len < 12 ? len : 12 + (buff[10] | (buff[11] << 8));
+	}
+	if(buff[3] & 8) {
+		while(pos < len && buff[pos++]);
+	}
+	if(buff[3] & 16) {
+		while(pos < len && buff[pos++]);
+	}
+	if(buff[3] & 2) {
+		pos += 2;
+	}
+	
+	return pos < len ? pos : -1;
+}
+
+static int gzpar_member(GzPar *src) {
+	
+	long len;
+	GzChunk *chunk;
+	
+	/* start of the next member, 0 at end of file */
+	chunk = src->chunks;
+	if(!(len = gzpar_load(chunk, src->member, src->size - src->member < GZPAR_SLACK ? src->size - src->member : GZPAR_SLACK))) {
+		return 0;
+	} else if((len = gzpar_header(chunk->in, len)) < 0) {
+		return src->member ? 0 : -1;
+	}
+	src->start = (src->member + len) << 3;
+	src->winLen = 0;
+	src->crc = crc32(0, 0, 0);
+	src->isize = 0;
+	
+	return 1;
+}
+
+static int gzpar_next(GzPar *src) {
+	
+	int i, status;
+	unsigned char trailer[8];
+	GzChunk *chunk, *next;
+	
+	/* move on to the next chunk, 0 at end of file and -1 on errors */
+	while(1) {
+		if(!src->n) {
+			if(src->start < 0 && (status = gzpar_member(src)) <= 0) {
+				return status;
+			}
+			gzpar_round(src);
+			chunk = src->chunks;
+			if(chunk->end == chunk->start && !chunk->final) {
+				return -1;
+			}
+			gzpar_window(src, chunk);
+			if(chunk->outLen) {
+				return 1;
+			}
+		}
+		chunk = src->chunks + src->cur;
+		if(chunk->final) {
+			/* check the member trailer */
+			if(pread(src->fd, trailer, 8, chunk->trailer) != 8 || gzpar_get32(trailer) != src->crc || gzpar_get32(trailer + 4) != (unsigned)(src->isize)) {
+				return -1;
+			}
+			src->member = chunk->trailer + 8;
+			src->start = -1;
+			src->n = 0;
+			continue;
+		}
+		next = 0;
+		for(i = src->cur + 1; i < src->n && !next; ++i) {
+			if(0 <= src->chunks[i].start) {
+				next = src->chunks + i;
+			}
+		}
+		if(chunk->ok && next && next->start == chunk->end && 0 <= next->marks && !next->binary && src->winLen == WINSIZE) {
+			src->cur = next - src->chunks;
+			src->pos = 0;
+			gzpar_window(src, next);
+			if(next->outLen) {
+				return 1;
+			}
+		} else {
+			/* guesses went wrong, go on from the last known boundary */
+			if(chunk->ok && next && next->binary) {
+				src->serial = 1;
+			}
+			src->start = chunk->end;
+			src->n = 0;
+		}
+	}
+}
+
+long gzpar_read(GzPar *src, unsigned char *dest, long size) {
+	
+	int status;
+	long len, avail;
+	GzChunk *chunk;
+	
+	len = 0;
+	while(len < size) {
+		chunk = src->chunks + src->cur;
+		if(!src->n || src->pos == chunk->outLen) {
+			if((status = gzpar_next(src)) <= 0) {
+				return status < 0 ? -1 : len;
+			}
+			chunk = src->chunks + src->cur;
+		}
+		avail = chunk->outLen - src->pos;
+		avail = size - len < avail ? size - len : avail;
+		memcpy(dest + len, chunk->out + src->pos, avail);
+		src->pos += avail;
+		len += avail;
+	}
+	
+	return len;
+}
+
+int gzpar_check(FILE *file, int thread_num) {
+	
+	int fd;
+	struct stat st;
+	
+	/* worth guessing on large regular files only */
+	fd = fileno(file);
+	return 1 < thread_num && 0 <= fd && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && 2LL * GZPAR_CHUNK <= st.st_size;
+}
+
+GzPar * gzpar_init(int fd, int thread_num) {
+	
+	int i;
+	struct stat st;
+	unsigned char *dict;
+	GzChunk *chunk;
+	GzPar *dest;
+	
+	dest = smalloc(sizeof(GzPar));
+	dest->fd = fd;
+	dest->thread_num = thread_num;
+	dest->serial = 0;
+	dest->n = 0;
+	dest->cur = 0;
+	dest->pos = 0;
+	dest->size = fstat(fd, &st) == 0 ? st.st_size : 0;
+	dest->start = -1;
+	dest->member = 0;
+	dest->in = 0;
+	dest->winLen = 0;
+	
+	/* trial window, then markers of position bits 0-6, 7-13 and 14 */
+	dest->dicts = smalloc(4 * WINSIZE);
+	dict = dest->dicts;
+	for(i = 0; i < WINSIZE; ++i) {
+		dict[i] = 255;
+		dict[WINSIZE + i] = 128 | (i & 127);
+		dict[2 * WINSIZE + i] = 128 | ((i >> 7) & 127);
+		dict[3 * WINSIZE + i] = 128 | ((i >> 8) & 64) | (~i & 63);
+	}
+	
+	dest->chunks = smalloc((thread_num + 1) * sizeof(GzChunk));
+	for(i = 0; i <= thread_num; ++i) {
+		chunk = dest->chunks + i;
+		chunk->src = dest;
+		chunk->start = -1;
+		chunk->inSize = GZPAR_CHUNK + GZPAR_SLACK;
+		chunk->inLen = 0;
+		chunk->in = smalloc(chunk->inSize);
+		chunk->outSize = 4 * GZPAR_CHUNK;
+		chunk->outLen = 0;
+		chunk->out = smalloc(chunk->outSize);
+		chunk->scratchSize = GZPAR_TRIAL;
+		chunk->scratch = smalloc(chunk->scratchSize);
+		chunk->refs = smalloc(chunk->scratchSize * sizeof(unsigned short));
+		chunk->strm.zalloc = Z_NULL;
+		chunk->strm.zfree = Z_NULL;
+		chunk->strm.opaque = Z_NULL;
+		chunk->strm.next_in = Z_NULL;
+		chunk->strm.avail_in = 0;
+		if(inflateInit2(&chunk->strm, -15) != Z_OK) {
+			ERROR();
+		}
+	}
+	
+	return dest;
+}
+
+void gzpar_destroy(GzPar *dest) {
+	
+	int i;
+	
+	for(i = 0; i <= dest->thread_num; ++i) {
+		inflateEnd(&dest->chunks[i].strm);
+		free(dest->chunks[i].in);
+		free(dest->chunks[i].out);
+		free(dest->chunks[i].scratch);
+		free(dest->chunks[i].refs);
+	}
+	free(dest->chunks);
+	free(dest->dicts);
+	free(dest);
+}
@@ -0,0 +1,82 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <zlib.h>
+#include "gzindex.h"
+
+#ifndef GZPAR
+typedef struct gzPar GzPar;
+typedef struct gzChunk GzChunk;
+struct gzChunk {
+	struct gzPar *src;
+	int ok; /* ended exactly where the next chunk starts */
+	int final; /* ended with the last block of the member */
+	int binary; /* output is not ascii, markers cannot be told apart */
+	long long start; /* bit offsets in the file */
+	long long stop;
+	long long end; /* last block boundary reached */
+	long long trailer; /* byte offset after the last block */
+	long inSize;
+	long inLen;
+	long outSize;
+	long outLen; /* output up to end */
+	long marks; /* output up to the last byte from the unknown window */
+	long scratchSize;
+	unsigned char *in;
+	unsigned char *out;
+	unsigned char *scratch;
+	unsigned short *refs; /* window offset of unknown bytes */
+	z_stream strm;
+	pthread_t id;
+};
+struct gzPar {
+	int fd;
+	int thread_num;
+	int serial; /* output is not ascii, do not guess */
+	int n; /* chunks of the round */
+	int cur; /* chunk being read */
+	int phase; /* scanning or inflating */
+	int jobs;
+	volatile int next; /* next job of the phase */
+	long pos; /* read from output of cur */
+	long long size; /* of the file */
+	long long start; /* bit offset of the next round, -1 for a new member */
+	long long member; /* byte offset of the next member */
+	long long in; /* compressed bytes done */
+	unsigned crc;
+	unsigned long isize;
+	int winLen;
+	unsigned char window[WINSIZE];
+	unsigned char *dicts; /* trial and three marker windows */
+	GzChunk *chunks;
+};
+#define GZPAR 1
+#define GZPAR_CHUNK 4194304
+#define GZPAR_SLACK 1048576
+#define GZPAR_TRIAL 262144
+#define GZPAR_END 0x7FFFFFFFFFFFFFFFLL
+#endif
+
+/* speculative parallel inflate of plain gzip text, in the style of pugz */
+int gzpar_check(FILE *file, int thread_num);
+GzPar * gzpar_init(int fd, int thread_num);
+long gzpar_read(GzPar *src, unsigned char *dest, long size);
+void gzpar_destroy(GzPar *dest);
@@ -0,0 +1,366 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "idpack.h"
+
+#define idpack_entry(i) (arena + (off32 ? off32[i] : off64[i]))
+
+static unsigned idpack_hash(char *prefix, long len) {
+	
+	unsigned hash;
+	
+	/* FNV-1a */
+	hash = 2166136261U;
+	while(len--) {
+		hash = (hash ^ (unsigned char)(*prefix++)) * 16777619U;
+	}
+	
+	return hash;
+}
+
+static int idpack_rehash(IdPack *dest) {
+	
+	unsigned i, pos, mask, size, *phash;
+	char *prefix;
+	
+	/* keep load below one half */
+	size = dest->psize ? dest->psize << 1 : 64;
+	if(!(phash = calloc(size, sizeof(unsigned)))) {
+		return 1;
+	}
+	free(dest->phash);
+	dest->phash = phash;
+	dest->psize = size;
+	mask = dest->psize - 1;
+	for(i = 0; i < dest->pn; ++i) {
+		prefix = dest->parena + dest->prefixes[i];
+		pos = idpack_hash(prefix, dest->prefixes[i + 1] - dest->prefixes[i]) & mask;
+		while(dest->phash[pos]) {
+			pos = (pos + 1) & mask;
+		}
+		dest->phash[pos] = i + 1;
+	}
+	
+	return 0;
+}
+
+static unsigned idpack_prefix(IdPack *src, char *prefix, long len, int add) {
+	
+	unsigned pos, mask, index;
+	long unsigned start, size, *prefixes;
+	char *parena;
+	
+	/* get prefix id, starting from one */
+	mask = src->psize - 1;
+	pos = idpack_hash(prefix, len) & mask;
+	while((index = src->phash[pos])) {
+		start = src->prefixes[index - 1];
+		if(src->prefixes[index] - start == len && memcmp(src->parena + start, prefix, len) == 0) {
+			return index;
+		}
+		pos = (pos + 1) & mask;
+	}
+	if(!add || src->pn == 0xFFFFFFFEU) {
+		return 0;
+	}
+	
+	/* add new prefix, ids that fail to get one are left unpacked */
+	if(src->parenaSize < src->plen + len) {
+		size = src->parenaSize;
+		while(size < src->plen + len) {
+			size <<= 1;
+		}
+		if(!(parena = realloc(src->parena, size))) {
+			return 0;
+		}
+		src->parena = parena;
+		src->parenaSize = size;
+	}
+	if(!(prefixes = realloc(src->prefixes, (src->pn + 2) * sizeof(long unsigned)))) {
+		return 0;
+	}
+	src->prefixes = prefixes;
+	memcpy(src->parena + src->plen, prefix, len);
+	src->plen += len;
+	src->prefixes[++src->pn] = src->plen;
+	src->phash[pos] = src->pn;
+	if(src->psize <= src->pn << 1 && idpack_rehash(src)) {
+		/* a full table would not end probes */
+		src->phash[pos] = 0;
+		src->plen -= len;
+		--src->pn;
+		return 0;
+	}
+	
+	return src->pn;
+}
+
+static char * idpack_num(char *entry, long long unsigned max, long long unsigned *num) {
+	
+	/* canonical decimal, so keys map back to one string */
+	if(!isdigit(*entry) || (*entry == '0' && isdigit(entry[1]))) {
+		return 0;
+	}
+	*num = 0;
+	while(isdigit(*entry)) {
+		*num = *num * 10 + (*entry++ - '0');
+		if(max < *num) {
+			return 0;
+		}
+	}
+	
+	return entry;
+}
+
+static int idpack_hex(int c) {
+	
+	if('0' <= c && c <= '9') {
+		return c - '0';
+	} else if('a' <= c && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	
+	return -1;
+}
+
+int idpack_parse(IdPack *src, char *entry, int add, long long unsigned *hi, long long unsigned *lo) {
+	
+	int i, c, fields;
+	unsigned prefix;
+	char *ptr;
+	long long unsigned lane, tile, x, y;
+	
+	/* ont uuid, lower case 8-4-4-4-12 */
+	*hi = 0;
+	*lo = 0;
+	ptr = entry;
+	for(i = 0; i < 36; ++i, ++ptr) {
+		if(i == 8 || i == 13 || i == 18 || i == 23) {
+			if(*ptr != '-') {
+				break;
+			}
+		} else if((c = idpack_hex(*ptr)) < 0) {
+			break;
+		} else if(i < 18) {
+			*hi = (*hi << 4) | c;
+		} else {
+			*lo = (*lo << 4) | c;
+		}
+	}
+	if(i == 36 && (!*ptr || (!add && isspace(*ptr)))) {
+		return (*hi | *lo) ? IDPACK_UUID : IDPACK_NONE;
+	}
+	
+	/* illumina, instrument:run:flowcell:lane:tile:x:y */
+	fields = 0;
+	ptr = entry;
+	while(*ptr && !isspace(*ptr) && fields < 3) {
+		if(*ptr++ == ':') {
+			++fields;
+		}
+	}
+	if(fields != 3 || ptr - entry == 3) {
+		return IDPACK_NONE;
+	} else if(!(ptr = idpack_num(ptr, 0xFF, &lane)) || *ptr++ != ':'
+		|| !(ptr = idpack_num(ptr, 0xFFFFFF, &tile)) || *ptr++ != ':'
+		|| !(ptr = idpack_num(ptr, 0xFFFFFFFF, &x)) || *ptr++ != ':'
+		|| !(ptr = idpack_num(ptr, 0xFFFFFFFF, &y))
+		|| (*ptr && (add || !isspace(*ptr)))) {
+		return IDPACK_NONE;
+	}
+	for(fields = 0, i = 0; fields < 3; ++i) {
+		if(entry[i] == ':') {
+			++fields;
+		}
+	}
+	if(!(prefix = idpack_prefix(src, entry, i - 1, add))) {
+		return IDPACK_NONE;
+	}
+	*hi = ((long long unsigned)(prefix) << 32) | (lane << 24) | tile;
+	*lo = (x << 32) | y;
+	
+	return IDPACK_ILLUMINA;
+}
+
+static int keycmp(const void *key1, const void *key2) {
+	
+	const long long unsigned *k1, *k2;
+	
+	k1 = key1;
+	k2 = key2;
+	if(*k1 != *k2) {
+		return *k1 < *k2 ? -1 : 1;
+	} else if(k1[1] != k2[1]) {
+		return k1[1] < k2[1] ? -1 : 1;
+	}
+	
+	return 0;
+}
+
+IdPack * idpack_build(char *arena, unsigned *off32, long unsigned *off64, long n, char *parsed) {
+	
+	int type;
+	long i;
+	long long unsigned hi, lo, *keys, *uuids;
+	IdPack *dest;
+	
+	/* zero on failure, the targets then stay in the sorted list */
+	if(!(dest = calloc(1, sizeof(IdPack)))) {
+		return 0;
+	}
+	dest->parenaSize = 1024;
+	dest->parena = malloc(dest->parenaSize);
+	dest->prefixes = calloc(1, sizeof(long unsigned));
+	keys = malloc((n ? 2 * n : 1) * sizeof(long long unsigned));
+	if(!dest->parena || !dest->prefixes || !keys || idpack_rehash(dest)) {
+		free(keys);
+		idpack_destroy(dest);
+		return 0;
+	}
+	
+	/* pack targets, illumina keys from the front and uuids from the back */
+	uuids = keys + 2 * n;
+	for(i = 0; i < n; ++i) {
+		type = idpack_parse(dest, idpack_entry(i), 1, &hi, &lo);
+		if(type == IDPACK_ILLUMINA) {
+			keys[2 * dest->n] = hi;
+			keys[2 * dest->n++ + 1] = lo;
+		} else if(type == IDPACK_UUID) {
+			uuids -= 2;
+			uuids[0] = hi;
+			uuids[1] = lo;
+			++dest->un;
+		} else if(!parsed) {
+			/* a missing parsed list means all must pack */
+			free(keys);
+			idpack_destroy(dest);
+			return 0;
+		}
+		if(parsed) {
+			parsed[i] = type != IDPACK_NONE;
+		}
+	}
+	if(!(dest->uuids = malloc((dest->un ? 2 * dest->un : 1) * sizeof(long long unsigned)))) {
+		free(keys);
+		idpack_destroy(dest);
+		return 0;
+	}
+	memcpy(dest->uuids, uuids, 2 * dest->un * sizeof(long long unsigned));
+	
+	/* sort keys */
+	qsort(keys, dest->n, 2 * sizeof(long long unsigned), keycmp);
+	qsort(dest->uuids, dest->un, 2 * sizeof(long long unsigned), keycmp);
+	
+	/* group illumina keys by prefix, lane and tile */
+	for(i = 0; i < dest->n; ++i) {
+		if(!i || keys[2 * i] != keys[2 * i - 2]) {
+			++dest->gn;
+		}
+	}
+	dest->groups = malloc((dest->gn + 1) * sizeof(long long unsigned));
+	dest->gstart = malloc((dest->gn + 1) * sizeof(long));
+	dest->coords = malloc((dest->n ? dest->n : 1) * sizeof(long long unsigned));
+	if(!dest->groups || !dest->gstart || !dest->coords) {
+		free(keys);
+		idpack_destroy(dest);
+		return 0;
+	}
+	dest->gn = 0;
+	for(i = 0; i < dest->n; ++i) {
+		if(!i || keys[2 * i] != keys[2 * i - 2]) {
+			dest->groups[dest->gn] = keys[2 * i];
+			dest->gstart[dest->gn++] = i;
+		}
+		dest->coords[i] = keys[2 * i + 1];
+	}
+	dest->gstart[dest->gn] = dest->n;
+	free(keys);
+	
+	return dest;
+}
+
+static long idpack_bsearch(long long unsigned *keys, long n, long long unsigned key) {
+	
+	long base, half;
+	
+	/* branchless lower bound */
+	if(!n) {
+		return -1;
+	}
+	base = 0;
+	while(1 < n) {
+		half = n >> 1;
+		base = keys[base + half] <= key ? base + half : base;
+		n -= half;
+	}
+	
+	return keys[base] == key ? base : -1;
+}
+
+long idpack_grep(IdPack *src, char *entry) {
+	
+	int type;
+	long g, index, n, base, half;
+	long long unsigned hi, lo, *uuids;
+	
+	type = idpack_parse(src, entry, 0, &hi, &lo);
+	if(type == IDPACK_ILLUMINA) {
+		if((g = idpack_bsearch(src->groups, src->gn, hi)) < 0) {
+			return -1;
+		}
+		index = idpack_bsearch(src->coords + src->gstart[g], src->gstart[g + 1] - src->gstart[g], lo);
+		return index < 0 ? -1 : src->gstart[g] + index;
+	} else if(type == IDPACK_UUID) {
+		if(!(n = src->un)) {
+			return -1;
+		}
+		uuids = src->uuids;
+		base = 0;
+		while(1 < n) {
+			half = n >> 1;
+			g = base + half;
+			base = (uuids[2 * g] < hi || (uuids[2 * g] == hi && uuids[2 * g + 1] <= lo)) ? g : base;
+			n -= half;
+		}
+		return (uuids[2 * base] == hi && uuids[2 * base + 1] == lo) ? src->n + base : -1;
+	}
+	
+	return -2;
+}
+
+long unsigned idpack_memory(IdPack *src) {
+	return src->parenaSize + (src->pn + 1) * sizeof(long unsigned) + src->psize * sizeof(unsigned)
+		+ (src->gn + 1) * (sizeof(long long unsigned) + sizeof(long)) + src->n * sizeof(long long unsigned)
+		+ 2 * src->un * sizeof(long long unsigned);
+}
+
+void idpack_destroy(IdPack *src) {
+	free(src->parena);
+	free(src->prefixes);
+	free(src->phash);
+	free(src->groups);
+	free(src->gstart);
+	free(src->coords);
+	free(src->uuids);
+	free(src);
+}
@@ -0,0 +1,52 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef IDPACK
+typedef struct idPack IdPack;
+struct idPack {
+	/* prefix dictionary, instrument:run:flowcell */
+	unsigned pn;
+	unsigned psize;
+	long unsigned plen;
+	long unsigned parenaSize;
+	char *parena;
+	long unsigned *prefixes;
+	unsigned *phash;
+	/* illumina keys, grouped by prefix, lane and tile */
+	long gn;
+	long long unsigned *groups;
+	long *gstart;
+	long n;
+	long long unsigned *coords;
+	/* ont read ids */
+	long un;
+	long long unsigned *uuids;
+};
+#define IDPACK 1
+#define IDPACK_NONE 0
+#define IDPACK_ILLUMINA 1
+#define IDPACK_UUID 2
+#endif
+
+/* fixed width integer keys of structured identifiers */
+IdPack * idpack_build(char *arena, unsigned *off32, long unsigned *off64, long n, char *parsed);
+int idpack_parse(IdPack *src, char *entry, int add, long long unsigned *hi, long long unsigned *lo);
+long idpack_grep(IdPack *src, char *entry);
+long unsigned idpack_memory(IdPack *src);
+void idpack_destroy(IdPack *src);
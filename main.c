@@ -22,6 +22,7 @@
 #include <string.h>
 #include "cmdline.h"
 #include "fqgrep.h"
+#include "serve.h"
 #include "version.h"
 #define missArg(opt) fprintf(stderr, "Missing argument at %s.\n", opt); exit(1);
 #define invaArg(opt) fprintf(stderr, "Invalid value parsed at %s.\n", opt); exit(1);
@@ -29,30 +30,74 @@
 static int helpMessage(FILE *out) {
 	
 	fprintf(out, "#fqgrep greps sequences entries from fasta and fastq files from a list of sorted identifiers.\n");
+	fprintf(out, "#fqgrep serve -f targets -S socket keeps the targets loaded, and serves -S socket requests.\n");
+	fprintf(out, "#fqgrep serve only lets its own user connect, as requests read and write files as that user.\n");
+	fprintf(out, "#fqgrep merge manifests... merges the outputs of --shard runs.\n");
+	fprintf(out, "#fqgrep -g with -t inflates gzip input in parallel, once its index is stored by an earlier run.\n");
 	fprintf(out, "#   %-24s\t%-32s\t%s\n", "Options are:", "Desc:", "Default:");
-	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'f', "file", "Newline separated file with target identifiers.", "");
+	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'f', "file", "Ids, prefix* or lo..hi, or read file.", "");
+	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'P', "pattern-file", "Glob or re:regex per line on ids.", "");
 	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'i', "input", "Input file(s) single end.", "stdin");
 	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'I', "interleaved", "Input file(s) interleaved.", "");
 	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'p', "paired", "Input file(s) paired end.", "");
 	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'o', "output", "Output file(s).", "stdout");
+	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'u', "unmatched-output", "Output file(s) of the rest.", "");
 	fprintf(out, "#    -%c, --%-17s\t%-32s\t%s\n", 'v', "invert-match", "Invert the sense of matching.", "");
+	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 's', "stream", "Stream fastq records unbuffered.", "");
+	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'b', "bam-output", "Write bam input as bam.", "");
+#ifdef HAVE_ZSTD
+	fprintf(out, "#        --%-16s\t%-32s\t%s\n", "zstd", "Write records as zstd of level #.", "");
+	fprintf(out, "#        --%-16s\t%-32s\t%s\n", "zstd-workers", "Zstd compression threads.", "threads");
+#endif
+	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'c', "count", "Only count matches per input.", "");
+	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'l', "list-ids", "Only list matching ids.", "");
+	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'g', "gzindex", "Checkpoint gzip input every # MB.", "");
+	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'C', "checkpoint", "Resume from and save to file.", "");
+	fprintf(out, "#        --%-16s\t%-32s\t%d\n", "checkpoint-interval", "Seconds between checkpoints.", CHECKPOINT_INTERVAL);
+	fprintf(out, "#        --%-16s\t%-32s\t%s\n", "progress", "Report progress every # seconds.", "");
+	fprintf(out, "#        --%-16s\t%-32s\t%s\n", "heartbeat", "Write progress as json to file.", "stderr");
+	fprintf(out, "#        --%-16s\t%-32s\t%d\n", "buffer-size", "Input buffer size in kB.", CHUNK >> 10);
+	fprintf(out, "#        --%-16s\t%-32s\t%s\n", "io-size", "Read size in kB.", "");
+	fprintf(out, "#        --%-16s\t%-32s\t%s\n", "drop-cache", "Release read input from page cache.", "");
+	fprintf(out, "#        --%-16s\t%-32s\t%s\n", "direct", "Read input with O_DIRECT.", "");
+	fprintf(out, "#        --%-16s\t%-32s\t%s\n", "hugepages", "Advise transparent huge pages.", "");
+	fprintf(out, "#        --%-16s\t%-32s\t%s\n", "shard", "Only do share i/N of the input.", "");
+	fprintf(out, "#        --%-16s\t%-32s\t%s\n", "demux", "Split by index reads of sample sheet.", "");
+	fprintf(out, "#        --%-16s\t%-32s\t%s\n", "repair", "Pair up mates of unsynced -p files.", "");
+	fprintf(out, "#        --%-16s\t%-32s\t%d\n", "repair-memory", "Memory of --repair in MB.", REPAIR_MEMORY);
+	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 't', "threads", "Number of threads.", "1");
+	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'e', "engine", "Lookup, auto, sorted, trie or packed.", "auto");
 	fprintf(out, "#    -%c, --%-17s\t%-32s\t%s\n", 'V', "version", "Version.", "");
 	fprintf(out, "#    -%c, --%-16s\t%-32s\t%s\n", 'h', "help", "Shows this helpmessage.", "");
 	
 	return out == stderr;
 }
 
+static int getEngine(char *arg) {
+	
+	if(strcmp(arg, "sorted") == 0) {
+		return TARGET_SORTED;
+	} else if(strcmp(arg, "trie") == 0) {
+		return TARGET_TRIE;
+	} else if(strcmp(arg, "packed") == 0) {
+		return TARGET_PACKED;
+	} else if(strcmp(arg, "auto") == 0) {
+		return TARGET_AUTO;
+	}
+	invaArg("engine");
+	
+	return 0;
+}
+
 int main(int argc, char *argv[]) {
 	
-	const char *stdstream = "-";
-	int args, len, offset, se, pe, inter;
-	unsigned invert;
-	char **Arg, *arg, *outputfilename, *targetfilename, opt;
+	int args, len, offset, se, pe, inter, serve, reload;
+	char **Arg, *arg, *targetfilename, opt;
 	char **inputfilenames, **intfilenames, **pefilenames;
+	GrepOpts *opts;
 	
 	/* set defaults */
-	invert = 0;
-	outputfilename = (char *)(stdstream);
+	opts = grepOpts_init();
 	targetfilename = 0;
 	se = 0;
 	inputfilenames = 0;
@@ -60,6 +105,25 @@ int main(int argc, char *argv[]) {
 	intfilenames = 0;
 	pe = 0;
 	pefilenames = 0;
+	reload = 0;
+	
+	/* merge shards */
+	if(1 < argc && strcmp(argv[1], "merge") == 0) {
+		if(argc < 3) {
+			fprintf(stderr, "Missing manifests.\n");
+			return helpMessage(stderr);
+		}
+		return shard_merge(argv + 2, argc - 2);
+	}
+	
+	/* server sub-command */
+	if(1 < argc && strcmp(argv[1], "serve") == 0) {
+		serve = 1;
+		--argc;
+		++argv;
+	} else {
+		serve = 0;
+	}
 	
 	/* parse cmd-line */
 	args = argc - 1;
@@ -92,11 +156,95 @@ int main(int argc, char *argv[]) {
 					pefilenames = getArgListDie(&Arg, &args, len + offset, "paired");
 					pe = getArgListLen(&Arg, &args);
 				} else if(cmdcmp(arg, "output") == 0) {
-					outputfilename = getArgDie(&Arg, &args, len + offset, "output");
+					opts->outputfilename = getArgDie(&Arg, &args, len + offset, "output");
+				} else if(cmdcmp(arg, "unmatched-output") == 0) {
+					opts->unmatchedname = getArgDie(&Arg, &args, len + offset, "unmatched-output");
 				} else if(cmdcmp(arg, "file") == 0) {
 					targetfilename = getArgDie(&Arg, &args, len + offset, "file");
+				} else if(cmdcmp(arg, "pattern-file") == 0) {
+					opts->patternfilename = getArgDie(&Arg, &args, len + offset, "pattern-file");
+				} else if(cmdcmp(arg, "socket") == 0) {
+					opts->socketname = getArgDie(&Arg, &args, len + offset, "socket");
+				} else if(cmdcmp(arg, "reload") == 0) {
+					reload = 1;
+				} else if(cmdcmp(arg, "stream") == 0) {
+					opts->stream = 1;
+				} else if(cmdcmp(arg, "bam-output") == 0) {
+					opts->bamout = 1;
+				} else if(cmdcmp(arg, "zstd") == 0) {
+					opts->zstdlevel = getNumArg(&Arg, &args, len + offset, "zstd");
+					if(opts->zstdlevel < 1 || 22 < opts->zstdlevel) {
+						invaArg("--zstd");
+					}
+				} else if(cmdcmp(arg, "zstd-workers") == 0) {
+					opts->zstdworkers = getNumArg(&Arg, &args, len + offset, "zstd-workers");
+					if(opts->zstdworkers <= 0) {
+						invaArg("--zstd-workers");
+					}
+				} else if(cmdcmp(arg, "count") == 0) {
+					opts->mode = GREP_COUNT;
+				} else if(cmdcmp(arg, "list-ids") == 0) {
+					opts->mode = GREP_IDS;
 				} else if(cmdcmp(arg, "invert-match") == 0) {
-					invert = 1;
+					opts->invert = 1;
+				} else if(cmdcmp(arg, "gzindex") == 0) {
+					opts->gzspan = getNumArg(&Arg, &args, len + offset, "gzindex");
+					if(opts->gzspan <= 0) {
+						invaArg("--gzindex");
+					}
+					opts->gzspan <<= 20;
+				} else if(cmdcmp(arg, "checkpoint") == 0) {
+					opts->checkpointname = getArgDie(&Arg, &args, len + offset, "checkpoint");
+				} else if(cmdcmp(arg, "checkpoint-interval") == 0) {
+					opts->checkpointinterval = getNumArg(&Arg, &args, len + offset, "checkpoint-interval");
+					if(opts->checkpointinterval < 0) {
+						invaArg("--checkpoint-interval");
+					}
+				} else if(cmdcmp(arg, "progress") == 0) {
+					opts->progressinterval = getNumArg(&Arg, &args, len + offset, "progress");
+					if(opts->progressinterval <= 0) {
+						invaArg("--progress");
+					}
+				} else if(cmdcmp(arg, "heartbeat") == 0) {
+					opts->heartbeatname = getArgDie(&Arg, &args, len + offset, "heartbeat");
+				} else if(cmdcmp(arg, "buffer-size") == 0) {
+					opts->buffsize = getNumArg(&Arg, &args, len + offset, "buffer-size");
+					if(opts->buffsize < 64 || (1 << 20) < opts->buffsize) {
+						invaArg("--buffer-size");
+					}
+					opts->buffsize <<= 10;
+				} else if(cmdcmp(arg, "io-size") == 0) {
+					opts->iosize = getNumArg(&Arg, &args, len + offset, "io-size");
+					if(opts->iosize < 4 || (1 << 20) < opts->iosize) {
+						invaArg("--io-size");
+					}
+					opts->iosize <<= 10;
+				} else if(cmdcmp(arg, "drop-cache") == 0) {
+					opts->ioflags |= FILEBUFF_DROPCACHE;
+				} else if(cmdcmp(arg, "direct") == 0) {
+					opts->ioflags |= FILEBUFF_DIRECT;
+				} else if(cmdcmp(arg, "hugepages") == 0) {
+					opts->ioflags |= FILEBUFF_HUGEPAGES;
+				} else if(cmdcmp(arg, "repair") == 0) {
+					opts->repair = 1;
+				} else if(cmdcmp(arg, "repair-memory") == 0) {
+					opts->repairmemory = getNumArg(&Arg, &args, len + offset, "repair-memory");
+					if(opts->repairmemory <= 0) {
+						invaArg("--repair-memory");
+					}
+				} else if(cmdcmp(arg, "demux") == 0) {
+					opts->demuxname = getArgDie(&Arg, &args, len + offset, "demux");
+				} else if(cmdcmp(arg, "shard") == 0) {
+					if(sscanf(getArgDie(&Arg, &args, len + offset, "shard"), "%d/%d", &opts->shardnum, &opts->shardtotal) != 2 || opts->shardnum < 1 || opts->shardtotal < opts->shardnum) {
+						invaArg("--shard");
+					}
+				} else if(cmdcmp(arg, "threads") == 0) {
+					opts->thread_num = getNumArg(&Arg, &args, len + offset, "threads");
+					if(opts->thread_num <= 0) {
+						invaArg("--threads");
+					}
+				} else if(cmdcmp(arg, "engine") == 0) {
+					opts->engine = getEngine(getArgDie(&Arg, &args, len + offset, "engine"));
 				} else if(cmdcmp(arg, "version") == 0) {
 					fprintf(stdout, "fqgrep-%s\n", FQGREP_VERSION);
 				} else if(cmdcmp(arg, "help") == 0) {
@@ -123,13 +271,51 @@ int main(int argc, char *argv[]) {
 						pe = getArgListLen(&Arg, &args);
 						opt = 0;
 					} else if(opt == 'o') {
-						outputfilename = getArgDie(&Arg, &args, len, "o");
+						opts->outputfilename = getArgDie(&Arg, &args, len, "o");
+						opt = 0;
+					} else if(opt == 'u') {
+						opts->unmatchedname = getArgDie(&Arg, &args, len, "u");
 						opt = 0;
 					} else if(opt == 'f') {
 						targetfilename = getArgDie(&Arg, &args, len, "f");
 						opt = 0;
+					} else if(opt == 'P') {
+						opts->patternfilename = getArgDie(&Arg, &args, len, "P");
+						opt = 0;
+					} else if(opt == 'S') {
+						opts->socketname = getArgDie(&Arg, &args, len, "S");
+						opt = 0;
+					} else if(opt == 'R') {
+						reload = 1;
+					} else if(opt == 's') {
+						opts->stream = 1;
+					} else if(opt == 'b') {
+						opts->bamout = 1;
+					} else if(opt == 'c') {
+						opts->mode = GREP_COUNT;
+					} else if(opt == 'l') {
+						opts->mode = GREP_IDS;
 					} else if(opt == 'v') {
-						invert = 1;
+						opts->invert = 1;
+					} else if(opt == 'g') {
+						opts->gzspan = getNumArg(&Arg, &args, len, "g");
+						if(opts->gzspan <= 0) {
+							invaArg("-g");
+						}
+						opts->gzspan <<= 20;
+						opt = 0;
+					} else if(opt == 'C') {
+						opts->checkpointname = getArgDie(&Arg, &args, len, "C");
+						opt = 0;
+					} else if(opt == 't') {
+						opts->thread_num = getNumArg(&Arg, &args, len, "t");
+						if(opts->thread_num <= 0) {
+							invaArg("-t");
+						}
+						opt = 0;
+					} else if(opt == 'e') {
+						opts->engine = getEngine(getArgDie(&Arg, &args, len, "e"));
+						opt = 0;
 					} else if(opt == 'V') {
 						fprintf(stdout, "fqgrep-%s\n", FQGREP_VERSION);
 					} else if(opt == 'h') {
@@ -155,15 +341,114 @@ int main(int argc, char *argv[]) {
 		se = args;
 	}
 	
+	if(opts->unmatchedname && *opts->unmatchedname == '-' && opts->unmatchedname[1] == 0 && *opts->outputfilename == '-' && opts->outputfilename[1] == 0) {
+		fprintf(stderr, "Matched and unmatched records cannot both go to stdout.\n");
+		return 1;
+	}
+	
+#ifndef HAVE_ZSTD
+	if(opts->zstdlevel || opts->zstdworkers) {
+		fprintf(stderr, "Zstd output needs fqgrep built with libzstd.\n");
+		return 1;
+	}
+#endif
+	
+	if(opts->checkpointname && ((*opts->outputfilename == '-' && opts->outputfilename[1] == 0) || (opts->unmatchedname && *opts->unmatchedname == '-' && opts->unmatchedname[1] == 0))) {
+		fprintf(stderr, "Checkpoints need output files.\n");
+		return 1;
+	} else if(opts->checkpointname && (opts->bamout || opts->zstdlevel)) {
+		fprintf(stderr, "Checkpoints are not supported with bam or zstd output.\n");
+		return 1;
+	} else if(opts->bamout && opts->zstdlevel) {
+		fprintf(stderr, "Cannot write bam as zstd.\n");
+		return 1;
+	}
+	
+	if(opts->shardtotal && ((*opts->outputfilename == '-' && opts->outputfilename[1] == 0) || (opts->unmatchedname && *opts->unmatchedname == '-' && opts->unmatchedname[1] == 0))) {
+		fprintf(stderr, "Shards need output files.\n");
+		return 1;
+	} else if(opts->shardtotal && (opts->checkpointname || opts->bamout)) {
+		fprintf(stderr, "Shards are not supported with checkpoints or bam output.\n");
+		return 1;
+	} else if(opts->shardtotal && (serve || opts->socketname)) {
+		fprintf(stderr, "Shards are not supported by the server.\n");
+		return 1;
+	}
+	
+	if(opts->demuxname && (targetfilename || opts->patternfilename || opts->invert)) {
+		fprintf(stderr, "Demultiplexing does not take targets.\n");
+		return 1;
+	} else if(opts->demuxname && (opts->mode == GREP_IDS || opts->bamout || opts->checkpointname)) {
+		fprintf(stderr, "Demultiplexing is not supported with id lists, bam output or checkpoints.\n");
+		return 1;
+	} else if(opts->demuxname && opts->mode == GREP_RECORDS && *opts->outputfilename == '-' && opts->outputfilename[1] == 0) {
+		fprintf(stderr, "Demultiplexing needs an output prefix.\n");
+		return 1;
+	} else if(opts->demuxname && (serve || opts->socketname)) {
+		fprintf(stderr, "Demultiplexing is not supported by the server.\n");
+		return 1;
+	}
+	
+	if(opts->repair && (se || inter || !pe)) {
+		fprintf(stderr, "Repair needs paired end input only.\n");
+		return 1;
+	} else if(opts->repair && (targetfilename || opts->patternfilename || opts->invert || opts->demuxname)) {
+		fprintf(stderr, "Repair does not take targets.\n");
+		return 1;
+	} else if(opts->repair && (opts->mode || opts->bamout || opts->checkpointname || opts->shardtotal)) {
+		fprintf(stderr, "Repair is not supported with counts, id lists, bam output, checkpoints or shards.\n");
+		return 1;
+	} else if(opts->repair && *opts->outputfilename == '-' && opts->outputfilename[1] == 0) {
+		fprintf(stderr, "Repair needs an output prefix.\n");
+		return 1;
+	} else if(opts->repair && (serve || opts->socketname)) {
+		fprintf(stderr, "Repair is not supported by the server.\n");
+		return 1;
+	}
+	
+	/* requests only carry what the server does not set itself */
+	if(!serve && opts->socketname && (targetfilename || opts->patternfilename || opts->engine != TARGET_AUTO)) {
+		fprintf(stderr, "Targets and engine are set by the server.\n");
+		return 1;
+	} else if(!serve && opts->socketname && (opts->checkpointname || opts->progressinterval || opts->heartbeatname)) {
+		fprintf(stderr, "Checkpoints and progress are not supported by the client.\n");
+		return 1;
+	} else if(!serve && opts->socketname && (opts->buffsize != CHUNK || opts->iosize || opts->ioflags)) {
+		fprintf(stderr, "Buffer and io options are not supported by the client.\n");
+		return 1;
+	}
+	
+	if(opts->heartbeatname && !opts->progressinterval) {
+		opts->progressinterval = PROGRESS_INTERVAL;
+	}
+	
+	/* server and client */
+	if(serve) {
+		if(!opts->socketname) {
+			fprintf(stderr, "Missing socket.\n");
+			return helpMessage(stderr);
+		} else if(!targetfilename && !opts->patternfilename) {
+			fprintf(stderr, "Missing entry target(s).\n");
+			return helpMessage(stderr);
+		}
+		return fqserve(targetfilename, opts);
+	} else if(opts->socketname) {
+		if(!reload && (se + pe + inter) == 0) {
+			fprintf(stderr, "Missing input.\n");
+			return helpMessage(stderr);
+		}
+		return fqclient(opts, reload, inputfilenames, se, intfilenames, inter, pefilenames, pe);
+	}
+	
 	/* check input */
 	if((se + pe + inter) == 0) {
 		fprintf(stderr, "Missing input.\n");
 		return helpMessage(stderr);
-	} else if(!targetfilename) {
+	} else if(!targetfilename && !opts->patternfilename && !opts->demuxname && !opts->repair) {
 		fprintf(stderr, "Missing entry target(s).\n");
 		return helpMessage(stderr);
 	}
 	
 	/* fqgrep */
-	return fqgrep(targetfilename, invert, inputfilenames, se, intfilenames, inter, pefilenames, pe, outputfilename);
+	return fqgrep(targetfilename, opts, inputfilenames, se, intfilenames, inter, pefilenames, pe);
 }
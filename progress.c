@@ -0,0 +1,236 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _XOPEN_SOURCE 600
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "filebuff.h"
+#include "pherror.h"
+#include "progress.h"
+
+static volatile sig_atomic_t progress_due = 0;
+
+static void progress_signal(int sig) {
+	progress_due = 1;
+}
+
+static double progress_time(void) {
+	
+	struct timeval now;
+	
+	gettimeofday(&now, NULL);
+	
+	return now.tv_sec + now.tv_usec / 1000000.0;
+}
+
+static long long progress_tell(FILE *file) {
+	
+	long long pos;
+	
+	/* compressed bytes consumed, the reader may be ahead of the grep */
+	if(!file || (pos = ftello(file)) < 0) {
+		return 0;
+	}
+	
+	return pos;
+}
+
+Progress * progress_init(char *filename, int interval) {
+	
+	Progress *dest;
+	struct sigaction act;
+	struct itimerval timer;
+	
+	dest = smalloc(sizeof(Progress));
+	memset(dest, 0, sizeof(Progress));
+	dest->interval = interval;
+	dest->start = progress_time();
+	dest->lastTime = dest->start;
+	dest->filename = filename;
+	if(filename) {
+		dest->tmpname = smalloc(strlen(filename) + strlen(PROGRESS_EXT) + 1);
+		sprintf(dest->tmpname, "%s%s", filename, PROGRESS_EXT);
+	}
+	
+	/* the handlers only raise a flag, checked by the grep loops */
+	progress_due = 0;
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = &progress_signal;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &act, NULL);
+	if(interval) {
+		sigaction(SIGALRM, &act, NULL);
+		timer.it_interval.tv_sec = interval;
+		timer.it_interval.tv_usec = 0;
+		timer.it_value = timer.it_interval;
+		setitimer(ITIMER_REAL, &timer, NULL);
+	}
+	
+	return dest;
+}
+
+void progress_add(Progress *dest, char **filenames, int n) {
+	
+	struct stat st;
+	
+	while(n--) {
+		if(stat(*filenames++, &st) == 0 && S_ISREG(st.st_mode)) {
+			dest->total += st.st_size;
+		}
+	}
+}
+
+void progress_skip(Progress *dest, char *filename) {
+	
+	struct stat st;
+	
+	/* input already covered by a checkpoint */
+	if(dest && stat(filename, &st) == 0 && S_ISREG(st.st_mode)) {
+		dest->done += st.st_size;
+		dest->last += st.st_size;
+	}
+}
+
+void progress_input(Progress *dest, char *input, FileBuff *src, FileBuff *src2, long *count) {
+	
+	if(!dest) {
+		return;
+	}
+	dest->input = input;
+	dest->file = src->file;
+	dest->file2 = src2 ? src2->file : 0;
+	dest->count = count;
+}
+
+void progress_close(Progress *dest) {
+	
+	/* finished input, before its files are closed */
+	if(!dest) {
+		return;
+	}
+	dest->done += progress_tell(dest->file) + progress_tell(dest->file2);
+	dest->ranged = 0;
+	dest->matches += dest->count ? *dest->count : 0;
+	dest->input = 0;
+	dest->file = 0;
+	dest->file2 = 0;
+	dest->count = 0;
+}
+
+void progress_update(Progress *dest, long records) {
+	
+	if(!dest) {
+		return;
+	}
+	
+	/* range threads count at once, and one of them reports */
+	__sync_fetch_and_add(&dest->records, records);
+	if(progress_due && !__sync_lock_test_and_set(&dest->reporting, 1)) {
+		if(progress_due) {
+			progress_report(dest, "running");
+		}
+		__sync_lock_release(&dest->reporting);
+	}
+}
+
+void progress_read(Progress *dest, long long bytes) {
+	
+	if(dest) {
+		__sync_fetch_and_add(&dest->ranged, bytes);
+	}
+}
+
+void progress_report(Progress *src, const char *state) {
+	
+	long matches;
+	long long bytes;
+	double now, rate, eta;
+	char *name;
+	FILE *out;
+	
+	progress_due = 0;
+	now = progress_time();
+	bytes = src->done + progress_tell(src->file) + progress_tell(src->file2) + __sync_add_and_fetch(&src->ranged, 0);
+	matches = src->matches + (src->count ? *src->count : 0);
+	
+	/* current rate since the last report */
+	rate = (src->lastTime < now) ? (bytes - src->last) / (now - src->lastTime) : 0;
+	eta = (0 < rate && bytes <= src->total) ? (src->total - bytes) / rate : -1;
+	src->last = bytes;
+	src->lastTime = now;
+	
+	if(!src->filename) {
+		fprintf(stderr, "# Progress:\t%ld records\t%ld matches\t%lld/%lld bytes\t%.1f MB/s", src->records, matches, bytes, src->total, rate / 1048576);
+		if(0 <= eta) {
+			fprintf(stderr, "\tETA %.0fs\n", eta);
+		} else {
+			fprintf(stderr, "\tETA unknown\n");
+		}
+		return;
+	}
+	
+	/* heartbeat is written aside, and renamed into place */
+	if(!(out = fopen(src->tmpname, "w"))) {
+		fprintf(stderr, "Cannot write heartbeat:\t%s\n", src->tmpname);
+		return;
+	}
+	fprintf(out, "{\"state\": \"%s\", \"pid\": %ld, \"time\": %.0f, \"elapsed\": %.1f, ", state, (long) getpid(), now, now - src->start);
+	fprintf(out, "\"input\": ");
+	if((name = src->input)) {
+		fputc('"', out);
+		while(*name) {
+			if(*name == '"' || *name == '\\') {
+				fputc('\\', out);
+			}
+			fputc(*name++, out);
+		}
+		fprintf(out, "\", ");
+	} else {
+		fprintf(out, "null, ");
+	}
+	fprintf(out, "\"records\": %ld, \"matches\": %ld, \"bytes\": %lld, \"total\": %lld, \"rate\": %.0f, \"eta\": ", src->records, matches, bytes, src->total, rate);
+	if(0 <= eta) {
+		fprintf(out, "%.0f}\n", eta);
+	} else {
+		fprintf(out, "null}\n");
+	}
+	fclose(out);
+	if(rename(src->tmpname, src->filename)) {
+		fprintf(stderr, "Cannot write heartbeat:\t%s\n", src->filename);
+	}
+}
+
+void progress_destroy(Progress *src) {
+	
+	struct itimerval timer;
+	
+	if(src->interval) {
+		memset(&timer, 0, sizeof(timer));
+		setitimer(ITIMER_REAL, &timer, NULL);
+	}
+	signal(SIGUSR1, SIG_DFL);
+	free(src->tmpname);
+	free(src);
+}
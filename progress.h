@@ -0,0 +1,57 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdio.h>
+#include "filebuff.h"
+
+#ifndef PROGRESS
+typedef struct progress Progress;
+struct progress {
+	int interval; /* seconds between reports, 0 on demand only */
+	long records;
+	long matches; /* of finished inputs */
+	long *count; /* matches of current input */
+	long long total; /* size of all inputs */
+	long long done; /* size of finished inputs */
+	long long last; /* bytes at last report */
+	long long ranged; /* bytes pread by range threads, unseen by ftello */
+	int reporting;
+	double start;
+	double lastTime;
+	char *input;
+	FILE *file;
+	FILE *file2;
+	char *filename;
+	char *tmpname;
+};
+#define PROGRESS 1
+#define PROGRESS_INTERVAL 10
+#define PROGRESS_EXT ".tmp"
+#endif
+
+/* progress reports on a timer and on SIGUSR1 */
+Progress * progress_init(char *filename, int interval);
+void progress_add(Progress *dest, char **filenames, int n);
+void progress_skip(Progress *dest, char *filename);
+void progress_input(Progress *dest, char *input, FileBuff *src, FileBuff *src2, long *count);
+void progress_close(Progress *dest);
+void progress_report(Progress *src, const char *state);
+void progress_update(Progress *dest, long records);
+void progress_read(Progress *dest, long long bytes);
+void progress_destroy(Progress *src);
@@ -0,0 +1,237 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pherror.h"
+#include "qbatch.h"
+
+QBatch * qbatch_init(int size, long arenaSize) {
+	
+	QBatch *dest;
+	
+	dest = smalloc(sizeof(QBatch));
+	dest->n = 0;
+	dest->size = size;
+	dest->len = 0;
+	dest->arenaSize = arenaSize;
+	dest->arena = smalloc(arenaSize);
+	dest->header = smalloc(3 * size * sizeof(long));
+	dest->seq = dest->header + size;
+	dest->qual = dest->seq + size;
+	dest->hlen = smalloc(3 * size * sizeof(int));
+	dest->slen = dest->hlen + size;
+	dest->qlen = dest->slen + size;
+	dest->end = 0;
+	memset(&dest->point, 0, sizeof(GzPoint));
+	
+	return dest;
+}
+
+void qbatch_reset(QBatch *dest) {
+	dest->n = 0;
+	dest->len = 0;
+}
+
+void qbatch_reserve(QBatch *dest, long len) {
+	
+	/* offsets stay valid when the arena moves */
+	if(dest->arenaSize < dest->len + len) {
+		while(dest->arenaSize < dest->len + len) {
+			dest->arenaSize <<= 1;
+		}
+		dest->arena = realloc(dest->arena, dest->arenaSize);
+		if(!dest->arena) {
+			ERROR();
+		}
+	}
+}
+
+void qbatch_shrink(QBatch *dest) {
+	
+	/* let go of arenas grown by very long records */
+	if((QBATCHBYTES << 1) < dest->arenaSize) {
+		dest->arenaSize = QARENASIZE;
+		if(!(dest->arena = realloc(dest->arena, dest->arenaSize))) {
+			ERROR();
+		}
+	}
+}
+
+void qbatch_destroy(QBatch *dest) {
+	free(dest->arena);
+	free(dest->header);
+	free(dest->hlen);
+	free(dest);
+}
+
+void qbatch_printFq(QBatch *src, int i, FILE *out) {
+	
+	putc('@', out);
+	fwrite(src->arena + src->header[i], 1, src->hlen[i], out);
+	putc('\n', out);
+	fwrite(src->arena + src->seq[i], 1, src->slen[i], out);
+	fwrite("\n+\n", 1, 3, out);
+	fwrite(src->arena + src->qual[i], 1, src->qlen[i], out);
+	putc('\n', out);
+}
+
+void qbatch_printFsa(QBatch *src, int i, FILE *out) {
+	
+	putc('>', out);
+	fwrite(src->arena + src->header[i], 1, src->hlen[i], out);
+	putc('\n', out);
+	fwrite(src->arena + src->seq[i], 1, src->slen[i], out);
+	putc('\n', out);
+}
+
+void qbatch_printRaw(QBatch *src, int i, FILE *out) {
+	fwrite(src->arena + src->seq[i], 1, src->slen[i], out);
+}
+
+QBatchPool * qbatchpool_init(int size, int batchSize) {
+	
+	QBatchPool *dest;
+	
+	dest = smalloc(sizeof(QBatchPool));
+	dest->size = size;
+	dest->batchSize = batchSize;
+	dest->slots = smalloc(size * sizeof(QBatch *));
+	memset((void *)(dest->slots), 0, size * sizeof(QBatch *));
+	
+	return dest;
+}
+
+QBatch * qbatchpool_get(QBatchPool *src) {
+	
+	int i;
+	QBatch *batch;
+	
+	/* claim a free batch, slots are only ever swapped atomically */
+	for(i = 0; i < src->size; ++i) {
+		if(src->slots[i] && (batch = __sync_lock_test_and_set(src->slots + i, 0))) {
+			qbatch_reset(batch);
+			return batch;
+		}
+	}
+	
+	/* pool is still warming up */
+	return qbatch_init(src->batchSize, QARENASIZE);
+}
+
+void qbatchpool_put(QBatchPool *dest, QBatch *batch) {
+	
+	int i;
+	
+	qbatch_shrink(batch);
+	for(i = 0; i < dest->size; ++i) {
+		if(!dest->slots[i] && __sync_bool_compare_and_swap(dest->slots + i, 0, batch)) {
+			return;
+		}
+	}
+	
+	/* pool is full */
+	qbatch_destroy(batch);
+}
+
+void qbatchpool_destroy(QBatchPool *dest) {
+	
+	int i;
+	
+	for(i = 0; i < dest->size; ++i) {
+		if(dest->slots[i]) {
+			qbatch_destroy(dest->slots[i]);
+		}
+	}
+	free((void *)(dest->slots));
+	free(dest);
+}
+
+QBatchQueue * qbatchqueue_init(unsigned size) {
+	
+	QBatchQueue *dest;
+	
+	dest = smalloc(sizeof(QBatchQueue));
+	dest->size = 1;
+	while(dest->size < size) {
+		dest->size <<= 1;
+	}
+	dest->head = 0;
+	dest->tail = 0;
+	dest->stop = 0;
+	dest->list = smalloc(dest->size * sizeof(QBatch *));
+	if((errno = pthread_mutex_init(&dest->lock, NULL)) || (errno = pthread_cond_init(&dest->cond, NULL))) {
+		ERROR();
+	}
+	
+	return dest;
+}
+
+int qbatchqueue_push(QBatchQueue *dest, QBatch *batch) {
+	
+	/* wait for room, unless the consumer stopped */
+	pthread_mutex_lock(&dest->lock);
+	while(dest->tail - dest->head == dest->size && !dest->stop) {
+		pthread_cond_wait(&dest->cond, &dest->lock);
+	}
+	if(dest->stop) {
+		pthread_mutex_unlock(&dest->lock);
+		return 0;
+	}
+	dest->list[dest->tail & (dest->size - 1)] = batch;
+	++dest->tail;
+	pthread_cond_broadcast(&dest->cond);
+	pthread_mutex_unlock(&dest->lock);
+	
+	return 1;
+}
+
+QBatch * qbatchqueue_pop(QBatchQueue *src) {
+	
+	QBatch *batch;
+	
+	/* wait for batch */
+	pthread_mutex_lock(&src->lock);
+	while(src->head == src->tail) {
+		pthread_cond_wait(&src->cond, &src->lock);
+	}
+	batch = src->list[src->head & (src->size - 1)];
+	++src->head;
+	pthread_cond_broadcast(&src->cond);
+	pthread_mutex_unlock(&src->lock);
+	
+	return batch;
+}
+
+void qbatchqueue_stop(QBatchQueue *dest) {
+	
+	/* wakes a producer waiting for room */
+	pthread_mutex_lock(&dest->lock);
+	dest->stop = 1;
+	pthread_cond_broadcast(&dest->cond);
+	pthread_mutex_unlock(&dest->lock);
+}
+
+void qbatchqueue_destroy(QBatchQueue *dest) {
+	pthread_mutex_destroy(&dest->lock);
+	pthread_cond_destroy(&dest->cond);
+	free(dest->list);
+	free(dest);
+}
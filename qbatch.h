@@ -0,0 +1,86 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#include <pthread.h>
+#include <stdio.h>
+#include "gzindex.h"
+
+#ifndef QBATCH
+typedef struct qBatch QBatch;
+typedef struct qBatchPool QBatchPool;
+typedef struct qBatchQueue QBatchQueue;
+struct qBatch {
+	int n;
+	int size;
+	long len;
+	long arenaSize;
+	unsigned char *arena;
+	long *header; /* offsets into arena */
+	long *seq;
+	long *qual;
+	int *hlen;
+	int *slen;
+	int *qlen;
+	long long end; /* input offset after the last record */
+	GzPoint point; /* inflate state before end */
+};
+struct qBatchPool {
+	int size;
+	int batchSize;
+	QBatch * volatile *slots;
+};
+struct qBatchQueue {
+	unsigned size; /* power of two */
+	unsigned head;
+	unsigned tail;
+	int stop;
+	QBatch **list;
+	pthread_mutex_t lock;
+	pthread_cond_t cond; /* signals a push, a pop or a stop */
+};
+#define QBATCH 1
+#define QBATCHSIZE 4096
+#define QARENASIZE 1048576
+#define QBATCHBYTES 4194304
+/* closed by records or bytes, the latter at an even count to keep interleaved mates together */
+#define qbatch_full(src) ((src)->size <= (src)->n || (QBATCHBYTES <= (src)->len && !((src)->n & 1)))
+#define qbatch_header(src, i) ((char *)((src)->arena + (src)->header[i]))
+#define qbatch_seq(src, i) ((char *)((src)->arena + (src)->seq[i]))
+#define qbatch_qual(src, i) ((char *)((src)->arena + (src)->qual[i]))
+#endif
+
+/* batch of records stored back to back in one arena */
+QBatch * qbatch_init(int size, long arenaSize);
+void qbatch_reset(QBatch *dest);
+void qbatch_reserve(QBatch *dest, long len);
+void qbatch_shrink(QBatch *dest);
+void qbatch_destroy(QBatch *dest);
+void qbatch_printFq(QBatch *src, int i, FILE *out);
+void qbatch_printFsa(QBatch *src, int i, FILE *out);
+void qbatch_printRaw(QBatch *src, int i, FILE *out);
+/* lock free pool of batches */
+QBatchPool * qbatchpool_init(int size, int batchSize);
+QBatch * qbatchpool_get(QBatchPool *src);
+void qbatchpool_put(QBatchPool *dest, QBatch *batch);
+void qbatchpool_destroy(QBatchPool *dest);
+/* single producer, single consumer queue between pipeline stages */
+QBatchQueue * qbatchqueue_init(unsigned size);
+int qbatchqueue_push(QBatchQueue *dest, QBatch *batch);
+QBatch * qbatchqueue_pop(QBatchQueue *src);
+void qbatchqueue_stop(QBatchQueue *dest);
+void qbatchqueue_destroy(QBatchQueue *dest);
@@ -0,0 +1,288 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ranges.h"
+
+#define rangekey(c) ((isspace(c) ? 0 : (unsigned char)(c)) ^ (CHAR_MIN < 0 ? 0x80 : 0))
+
+Ranges * ranges_init(long size) {
+	
+	Ranges *dest;
+	
+	/* zero on failure, as the index is also built by the api */
+	if(!(dest = calloc(1, sizeof(Ranges)))) {
+		return 0;
+	}
+	dest->size = size ? size : 1;
+	dest->arenaSize = dest->size << 5;
+	dest->arena = malloc(dest->arenaSize);
+	dest->lo = malloc(dest->size * sizeof(long));
+	dest->hi = malloc(dest->size * sizeof(long));
+	dest->prefix = malloc(dest->size);
+	if(!dest->arena || !dest->lo || !dest->hi || !dest->prefix) {
+		ranges_destroy(dest);
+		return 0;
+	}
+	
+	return dest;
+}
+
+int rangecmp(char *src1, char *src2) {
+	
+	/* entrycmp order of ids, ending at whitespace */
+	while(*src1 == *src2 && *src1 && !isspace(*src1)) {
+		++src1;
+		++src2;
+	}
+	
+	return rangekey(*src1) - rangekey(*src2);
+}
+
+static int ranges_prefixed(char *entry, char *prefix) {
+	
+	while(*prefix && *entry == *prefix) {
+		++entry;
+		++prefix;
+	}
+	
+	return *prefix == 0;
+}
+
+static long ranges_push(Ranges *dest, char *bound, long len) {
+	
+	long offset, size;
+	char *arena;
+	
+	if(dest->arenaSize < dest->len + len + 1) {
+		size = dest->arenaSize;
+		while(size < dest->len + len + 1) {
+			size <<= 1;
+		}
+		if(!(arena = realloc(dest->arena, size))) {
+			return -1;
+		}
+		dest->arena = arena;
+		dest->arenaSize = size;
+	}
+	offset = dest->len;
+	memcpy(dest->arena + offset, bound, len);
+	dest->arena[offset + len] = 0;
+	dest->len += len + 1;
+	
+	return offset;
+}
+
+int ranges_check(char *entry) {
+	
+	int valid;
+	long len;
+	char *sep, *ptr;
+	
+	/* whitespace marks a plain id with a comment */
+	for(ptr = entry; *ptr; ++ptr) {
+		if(isspace(*ptr)) {
+			return 0;
+		}
+	}
+	len = ptr - entry;
+	if((sep = strstr(entry, ".."))) {
+		*sep = 0;
+		valid = !(sep == entry || !sep[2] || 0 < rangecmp(entry, sep + 2) || strstr(sep + 2, ".."));
+		*sep = '.';
+		return valid ? 1 : -1;
+	}
+	
+	return (len && entry[len - 1] == '*') ? 1 : 0;
+}
+
+int ranges_add(Ranges *dest, char *entry) {
+	
+	int kind;
+	long len, *lo, *hi;
+	char *sep;
+	unsigned char *prefix;
+	
+	if((kind = ranges_check(entry)) < 0) {
+		fprintf(stderr, "Invalid target range:\t%s\n", entry);
+		exit(1);
+	} else if(!kind) {
+		return 0;
+	}
+	len = strlen(entry);
+	sep = strstr(entry, "..");
+	
+	/* add range */
+	if(dest->n == dest->size) {
+		if((lo = realloc(dest->lo, (dest->size << 1) * sizeof(long)))) {
+			dest->lo = lo;
+		}
+		if((hi = realloc(dest->hi, (dest->size << 1) * sizeof(long)))) {
+			dest->hi = hi;
+		}
+		if((prefix = realloc(dest->prefix, dest->size << 1))) {
+			dest->prefix = prefix;
+		}
+		if(!lo || !hi || !prefix) {
+			return -1;
+		}
+		dest->size <<= 1;
+	}
+	if(sep) {
+		dest->lo[dest->n] = ranges_push(dest, entry, sep - entry);
+		dest->hi[dest->n] = ranges_push(dest, sep + 2, len - (sep + 2 - entry));
+		dest->prefix[dest->n] = 0;
+	} else {
+		dest->lo[dest->n] = ranges_push(dest, entry, len - 1);
+		dest->hi[dest->n] = dest->lo[dest->n];
+		dest->prefix[dest->n] = 1;
+	}
+	if(dest->lo[dest->n] < 0 || dest->hi[dest->n] < 0) {
+		return -1;
+	}
+	++dest->n;
+	
+	return 1;
+}
+
+int ranges_below(Ranges *src, long i, char *entry) {
+	
+	char *hi;
+	
+	/* entry is at most the upper bound of range i */
+	hi = src->arena + src->hi[i];
+	if(src->prefix[i] && ranges_prefixed(entry, hi)) {
+		return 1;
+	}
+	
+	return rangecmp(entry, hi) <= 0;
+}
+
+static int ranges_hicmp(Ranges *src, long i, long j) {
+	
+	char *hi1, *hi2;
+	
+	/* order of upper bounds, a prefix is above its extensions */
+	hi1 = src->arena + src->hi[i];
+	hi2 = src->arena + src->hi[j];
+	if(src->prefix[i] && ranges_prefixed(hi2, hi1)) {
+		return (src->prefix[j] && ranges_prefixed(hi1, hi2)) ? 0 : 1;
+	} else if(src->prefix[j] && ranges_prefixed(hi1, hi2)) {
+		return -1;
+	}
+	
+	return rangecmp(hi1, hi2);
+}
+
+static Ranges *sortRanges;
+
+static int locmp(const void *a, const void *b) {
+	return rangecmp(sortRanges->arena + sortRanges->lo[*(const long *)(a)], sortRanges->arena + sortRanges->lo[*(const long *)(b)]);
+}
+
+int ranges_merge(Ranges *src) {
+	
+	long i, n, *order, *lo, *hi;
+	unsigned char *prefix;
+	
+	if(!src->n) {
+		return 0;
+	}
+	
+	/* sort on lower bound */
+	order = malloc(src->n * sizeof(long));
+	lo = malloc(src->n * sizeof(long));
+	hi = malloc(src->n * sizeof(long));
+	prefix = malloc(src->n);
+	if(!order || !lo || !hi || !prefix) {
+		free(order);
+		free(lo);
+		free(hi);
+		free(prefix);
+		return 1;
+	}
+	for(i = 0; i < src->n; ++i) {
+		order[i] = i;
+	}
+	sortRanges = src;
+	qsort(order, src->n, sizeof(long), locmp);
+	
+	/* merge overlaps */
+	lo[0] = src->lo[*order];
+	hi[0] = src->hi[*order];
+	prefix[0] = src->prefix[*order];
+	for(i = 1, n = 0; i < src->n; ++i) {
+		if(ranges_below(src, order[n], src->arena + src->lo[order[i]])) {
+			/* extend upper bound */
+			if(ranges_hicmp(src, order[n], order[i]) < 0) {
+				hi[n] = src->hi[order[i]];
+				prefix[n] = src->prefix[order[i]];
+				order[n] = order[i];
+			}
+		} else {
+			++n;
+			lo[n] = src->lo[order[i]];
+			hi[n] = src->hi[order[i]];
+			prefix[n] = src->prefix[order[i]];
+			order[n] = order[i];
+		}
+	}
+	free(src->lo);
+	free(src->hi);
+	free(src->prefix);
+	free(order);
+	src->n = n + 1;
+	src->size = src->n;
+	src->lo = lo;
+	src->hi = hi;
+	src->prefix = prefix;
+	
+	return 0;
+}
+
+long ranges_grep(Ranges *src, char *entry) {
+	
+	long downlim, uplim, index;
+	
+	/* last range starting at or below entry */
+	downlim = 0;
+	uplim = src->n - 1;
+	while(downlim <= uplim) {
+		index = (downlim + uplim) >> 1;
+		if(rangecmp(entry, src->arena + src->lo[index]) < 0) {
+			uplim = index - 1;
+		} else {
+			downlim = index + 1;
+		}
+	}
+	
+	return (0 <= uplim && ranges_below(src, uplim, entry)) ? uplim : -1;
+}
+
+void ranges_destroy(Ranges *src) {
+	free(src->arena);
+	free(src->lo);
+	free(src->hi);
+	free(src->prefix);
+	free(src);
+}
@@ -0,0 +1,43 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef RANGES
+typedef struct ranges Ranges;
+struct ranges {
+	long n;
+	long size;
+	long len;
+	long arenaSize;
+	char *arena; /* bounds stored back to back */
+	long *lo;
+	long *hi;
+	unsigned char *prefix; /* hi is a prefix, covering all its extensions */
+};
+#define RANGES 1
+#endif
+
+/* prefix* and lo..hi target lines, as sorted disjoint intervals, failed allocations are returned */
+Ranges * ranges_init(long size);
+int rangecmp(char *src1, char *src2);
+int ranges_check(char *entry);
+int ranges_add(Ranges *dest, char *entry);
+int ranges_below(Ranges *src, long i, char *entry);
+int ranges_merge(Ranges *src);
+long ranges_grep(Ranges *src, char *entry);
+void ranges_destroy(Ranges *src);
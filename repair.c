@@ -0,0 +1,294 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _XOPEN_SOURCE 600
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fqsplit.h"
+#include "pherror.h"
+#include "qbatch.h"
+#include "repair.h"
+
+Repair * repair_init(long long memory) {
+	
+	Repair *dest;
+	
+	dest = smalloc(sizeof(Repair));
+	dest->memory = memory;
+	dest->n = 0;
+	dest->size = 1024;
+	dest->len = 0;
+	dest->arenaSize = 1048576;
+	dest->mask = 2047;
+	dest->slots = smalloc((dest->mask + 1) * sizeof(long));
+	memset(dest->slots, 0, (dest->mask + 1) * sizeof(long));
+	dest->arena = smalloc(dest->arenaSize);
+	dest->entries = smalloc(dest->size * sizeof(RepairEntry));
+	dest->spill = 0;
+	
+	return dest;
+}
+
+static int repair_key(char *header, unsigned *hash) {
+	
+	int i, len;
+	
+	/* name up to the first whitespace, without /1 or /2 */
+	len = 0;
+	while(header[len] && !isspace(header[len])) {
+		++len;
+	}
+	if(2 < len && header[len - 2] == '/' && (header[len - 1] == '1' || header[len - 1] == '2')) {
+		len -= 2;
+	}
+	*hash = 2166136261U;
+	for(i = 0; i < len; ++i) {
+		*hash = (*hash ^ (unsigned char)(header[i])) * 16777619U;
+	}
+	
+	return len;
+}
+
+static unsigned repair_mix(unsigned hash, int level) {
+	
+	/* partition of a name, independent between levels */
+	hash ^= level * 0x9E3779B9U;
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6BU;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35U;
+	hash ^= hash >> 16;
+	
+	return hash;
+}
+
+static long repair_slot(Repair *src, unsigned hash) {
+	return (hash * 0x9E3779B1U) & src->mask;
+}
+
+static void repair_insert(Repair *dest, long i) {
+	
+	long slot;
+	
+	for(slot = repair_slot(dest, dest->entries[i].hash); dest->slots[slot]; slot = (slot + 1) & dest->mask);
+	dest->slots[slot] = i + 1;
+}
+
+static long long repair_usage(Repair *src) {
+	return src->len + src->n * (sizeof(RepairEntry) + 2 * sizeof(long));
+}
+
+static void repair_record(QBatch *batch, int i, char *dest) {
+	
+	/* same layout as qbatch_printFq */
+	*dest++ = '@';
+	memcpy(dest, batch->arena + batch->header[i], batch->hlen[i]);
+	dest += batch->hlen[i];
+	*dest++ = '\n';
+	memcpy(dest, batch->arena + batch->seq[i], batch->slen[i]);
+	dest += batch->slen[i];
+	memcpy(dest, "\n+\n", 3);
+	dest += 3;
+	memcpy(dest, batch->arena + batch->qual[i], batch->qlen[i]);
+	dest[batch->qlen[i]] = '\n';
+}
+
+int repair_add(Repair *dest, QBatch *batch, int i) {
+	
+	long len, slot;
+	RepairEntry *entry;
+	
+	/* keep the record, and tell when the table outgrows its memory */
+	len = batch->hlen[i] + batch->slen[i] + batch->qlen[i] + 6;
+	if(dest->arenaSize < dest->len + len) {
+		while(dest->arenaSize < dest->len + len) {
+			dest->arenaSize <<= 1;
+		}
+		if(!(dest->arena = realloc(dest->arena, dest->arenaSize))) {
+			ERROR();
+		}
+	}
+	if(dest->n == dest->size) {
+		dest->size <<= 1;
+		if(!(dest->entries = realloc(dest->entries, dest->size * sizeof(RepairEntry)))) {
+			ERROR();
+		}
+	}
+	if((dest->mask + 1) >> 1 <= dest->n) {
+		/* rehash at half load */
+		free(dest->slots);
+		dest->mask = dest->mask << 1 | 1;
+		dest->slots = smalloc((dest->mask + 1) * sizeof(long));
+		memset(dest->slots, 0, (dest->mask + 1) * sizeof(long));
+		for(slot = 0; slot < dest->n; ++slot) {
+			repair_insert(dest, slot);
+		}
+	}
+	entry = dest->entries + dest->n;
+	entry->off = dest->len;
+	entry->len = len;
+	entry->klen = repair_key(qbatch_header(batch, i), &entry->hash);
+	entry->used = 0;
+	repair_record(batch, i, dest->arena + dest->len);
+	dest->len += len;
+	repair_insert(dest, dest->n++);
+	
+	return dest->memory < repair_usage(dest);
+}
+
+void repair_put(Repair *dest, int mate, QBatch *batch, int i) {
+	repairparts_put(dest->spill, mate, batch, i);
+}
+
+void repair_spill(Repair *dest, int parts) {
+	
+	long j;
+	RepairEntry *entry;
+	
+	/* partitions on disk for both mates, with the table so far */
+	dest->spill = repairparts_init(parts, 0);
+	for(j = 0, entry = dest->entries; j < dest->n; ++j, ++entry) {
+		sfwrite(dest->arena + entry->off, 1, entry->len, dest->spill->files[0][repair_mix(entry->hash, 0) % parts]);
+	}
+	repair_clear(dest);
+}
+
+long repair_take(Repair *src, char *header) {
+	
+	int klen;
+	long i, slot;
+	unsigned hash;
+	RepairEntry *entry;
+	
+	/* first unused mate of the same name */
+	klen = repair_key(header, &hash);
+	for(slot = repair_slot(src, hash); (i = src->slots[slot]); slot = (slot + 1) & src->mask) {
+		entry = src->entries + i - 1;
+		if(!entry->used && entry->hash == hash && entry->klen == klen && strncmp(src->arena + entry->off + 1, header, klen) == 0) {
+			entry->used = 1;
+			return i - 1;
+		}
+	}
+	
+	return -1;
+}
+
+void repair_print(Repair *src, long i, FILE *out) {
+	sfwrite(src->arena + src->entries[i].off, 1, src->entries[i].len, out);
+}
+
+long repair_orphans(Repair *src, FILE *out) {
+	
+	long i, n;
+	RepairEntry *entry;
+	
+	/* mates that were never taken */
+	for(i = 0, n = 0, entry = src->entries; i < src->n; ++i, ++entry) {
+		if(!entry->used) {
+			sfwrite(src->arena + entry->off, 1, entry->len, out);
+			++n;
+		}
+	}
+	
+	return n;
+}
+
+void repair_clear(Repair *dest) {
+	
+	/* empty the table */
+	memset(dest->slots, 0, (dest->mask + 1) * sizeof(long));
+	dest->n = 0;
+	dest->len = 0;
+}
+
+void repair_reset(Repair *dest) {
+	
+	/* and close the partitions of the last pair of files */
+	repair_clear(dest);
+	repairparts_destroy(dest->spill);
+	dest->spill = 0;
+}
+
+void repair_destroy(Repair *dest) {
+	
+	if(dest) {
+		repair_reset(dest);
+		free(dest->slots);
+		free(dest->arena);
+		free(dest->entries);
+		free(dest);
+	}
+}
+
+RepairParts * repairparts_init(int n, int level) {
+	
+	int i, k;
+	RepairParts *dest;
+	
+	dest = smalloc(sizeof(RepairParts));
+	dest->n = n;
+	dest->level = level;
+	for(k = 0; k < 2; ++k) {
+		dest->files[k] = smalloc(n * sizeof(FILE *));
+		for(i = 0; i < n; ++i) {
+			dest->files[k][i] = fqsplit_tmpfile();
+		}
+	}
+	
+	return dest;
+}
+
+void repairparts_put(RepairParts *dest, int mate, QBatch *batch, int i) {
+	
+	unsigned hash;
+	
+	/* records go to the partition of their name */
+	repair_key(qbatch_header(batch, i), &hash);
+	qbatch_printFq(batch, i, dest->files[mate][repair_mix(hash, dest->level) % dest->n]);
+}
+
+FILE * repairparts_file(RepairParts *src, int mate, int part, long long *size) {
+	
+	FILE *file;
+	
+	/* partitions are read back with pread */
+	file = src->files[mate][part];
+	if(fflush(file) || (*size = ftello(file)) < 0) {
+		ERROR();
+	}
+	
+	return file;
+}
+
+void repairparts_destroy(RepairParts *dest) {
+	
+	int i, k;
+	
+	if(dest) {
+		for(k = 0; k < 2; ++k) {
+			for(i = 0; i < dest->n; ++i) {
+				fclose(dest->files[k][i]);
+			}
+			free(dest->files[k]);
+		}
+		free(dest);
+	}
+}
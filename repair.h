@@ -0,0 +1,73 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdio.h>
+#include "qbatch.h"
+
+#ifndef REPAIR
+typedef struct repair Repair;
+typedef struct repairEntry RepairEntry;
+typedef struct repairParts RepairParts;
+struct repairEntry {
+	long off; /* record in arena, as fastq text */
+	int len;
+	int klen; /* name without /1 or /2, from off + 1 */
+	unsigned hash;
+	int used;
+};
+struct repair {
+	long long memory; /* budget of the table in bytes */
+	long n;
+	long size;
+	long len;
+	long arenaSize;
+	long mask; /* slots - 1 */
+	long *slots; /* entry + 1, 0 if empty */
+	char *arena;
+	RepairEntry *entries;
+	RepairParts *spill; /* 0 while all is in memory */
+};
+struct repairParts {
+	int n;
+	int level; /* times split before, each level hashes names anew */
+	FILE **files[2];
+};
+#define REPAIR 1
+#define REPAIR_MEMORY 1024 /* MB */
+#define REPAIR_MAXPARTS 256
+#define REPAIR_MAXSPLIT 16 /* subpartitions of a partition outgrowing the memory */
+#define REPAIR_MAXLEVEL 8
+#endif
+
+/* hash join of mates on their names, spilling partitions to disk when short of memory */
+Repair * repair_init(long long memory);
+int repair_add(Repair *dest, QBatch *batch, int i);
+void repair_spill(Repair *dest, int parts);
+void repair_put(Repair *dest, int mate, QBatch *batch, int i);
+long repair_take(Repair *src, char *header);
+void repair_print(Repair *src, long i, FILE *out);
+long repair_orphans(Repair *src, FILE *out);
+void repair_clear(Repair *dest);
+void repair_reset(Repair *dest);
+void repair_destroy(Repair *dest);
+/* partitions of both mates by name, in unlinked files */
+RepairParts * repairparts_init(int n, int level);
+void repairparts_put(RepairParts *dest, int mate, QBatch *batch, int i);
+FILE * repairparts_file(RepairParts *src, int mate, int part, long long *size);
+void repairparts_destroy(RepairParts *dest);
@@ -18,20 +18,24 @@
 */
 
 #include <ctype.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include "bgzf.h"
 #include "filebuff.h"
 #include "pherror.h"
+#include "qbatch.h"
 #include "qseqs.h"
 #include "seqparse.h"
+#include "zstdio.h"
 
-int openAndDetermineFQ(FileBuff *inputfile, char *filename) {
+static unsigned openFQ(FileBuff *inputfile, char *filename) {
 	
 	unsigned FASTQ;
 	short unsigned *check;
 	
-	/* determine filetype and open it */
+	/* open it, and inflate compressed input */
 	FASTQ = 0;
 	if(*filename == '-' && filename[1] == 0) {
 		inputfile->file = stdin;
@@ -40,17 +44,45 @@ int openAndDetermineFQ(FileBuff *inputfile, char *filename) {
 	}
 	
 	inputfile->buffer[0] = 0;
+	inputfile->pos = 0;
+	inputfile->dropped = 0;
+	inputfile->end = 0;
 	if(buff_FileBuff(inputfile)) {
 		check = (short unsigned *) inputfile->buffer;
 		if(*check == 35615) {
 			FASTQ = 4;
-			init_gzFile(inputfile);
-			inputfile->buffFileBuff = &BuffgzFileBuff;
+			if(inputfile->gzspan && inputfile->file != stdin) {
+				gzindexFileBuff(inputfile, filename);
+				init_gzFile(inputfile);
+				inputfile->buffFileBuff = &BuffgzFileBuff;
+			} else if(BGZF_BLOCKSIZE <= inputfile->buffSize && bgzf_check(inputfile->buffer, inputfile->bytes)) {
+				init_bgzfFile(inputfile);
+			} else if(inputfile->file != stdin && gzpar_check(inputfile->file, inputfile->thread_num)) {
+				init_gzparFile(inputfile);
+			} else {
+				init_gzFile(inputfile);
+				inputfile->buffFileBuff = &BuffgzFileBuff;
+			}
+		} else if(zstd_check(inputfile->buffer, inputfile->bytes)) {
+			FASTQ = 4;
+			init_zstdFile(inputfile);
 		} else {
 			inputfile->buffFileBuff = &buff_FileBuff;
 		}
 	}
-	if(inputfile->buffer[0] == '@') { //FASTQ
+	
+	return FASTQ;
+}
+
+int openAndDetermineFQ(FileBuff *inputfile, char *filename) {
+	
+	unsigned FASTQ;
+	
+	/* determine filetype and open it */
+	FASTQ = openFQ(inputfile, filename);
+	if(4 <= inputfile->bytes && memcmp(inputfile->buffer, "BAM\1", 4) == 0) { //BAM
+		FASTQ |= 9;
+	} else if(inputfile->buffer[0] == '@') { //FASTQ
 		FASTQ |= 1;
 	} else if(inputfile->buffer[0] == '>') { //FASTA
 		FASTQ |= 2;
@@ -64,6 +96,81 @@ int openAndDetermineFQ(FileBuff *inputfile, char *filename) {
 	return FASTQ;
 }
 
+static int isSam(unsigned char *buff, long len) {
+	
+	int tabs;
+	
+	/* header line like @HD, or an alignment line of eleven or more fields */
+	if(4 <= len && buff[0] == '@' && isupper(buff[1]) && isalpha(buff[2]) && buff[3] == '\t') {
+		return 1;
+	}
+	for(tabs = 0; len && *buff != '\n'; --len, ++buff) {
+		tabs += *buff == '\t';
+	}
+	
+	return 10 <= tabs;
+}
+
+static int isFq(unsigned char *buff, long len) {
+	
+	unsigned char *line;
+	
+	/* header, sequence and then the '+' line */
+	if(!len || *buff != '@' || !(line = memchr(buff, '\n', len)) || !(line = memchr(line + 1, '\n', buff + len - line - 1))) {
+		return 0;
+	}
+	
+	return line + 1 < buff + len && line[1] == '+';
+}
+
+static int isFsa(unsigned char *buff, long len) {
+	
+	int seqs;
+	unsigned char *end, *line;
+	
+	/* headers followed by sequence lines, so a list of ids starting with '>' stays a list */
+	if(!len || *buff != '>') {
+		return 0;
+	}
+	seqs = 0;
+	while(len) {
+		if(!(end = memchr(buff, '\n', len))) {
+			/* line continues in the next buffer */
+			end = buff + len;
+		}
+		if(*buff != '>') {
+			for(line = buff; line < end && (isalpha(*line) || *line == '*' || *line == '-'); ++line);
+			if(line < end && (*line != '\r' || line + 1 < end)) {
+				return 0;
+			}
+			seqs += line != buff;
+		}
+		len -= end - buff + (end < buff + len);
+		buff = end + 1;
+	}
+	
+	return seqs != 0;
+}
+
+int openAndDetermineTargets(FileBuff *inputfile, char *filename) {
+	
+	unsigned FASTQ;
+	
+	/* sequence and alignment files give their read names, others are lists */
+	FASTQ = openFQ(inputfile, filename);
+	if(4 <= inputfile->bytes && memcmp(inputfile->buffer, "BAM\1", 4) == 0) {
+		FASTQ |= 9;
+	} else if(isSam(inputfile->buffer, inputfile->bytes)) {
+		FASTQ |= 16;
+	} else if(isFq(inputfile->buffer, inputfile->bytes)) {
+		FASTQ |= 1;
+	} else if(isFsa(inputfile->buffer, inputfile->bytes)) {
+		FASTQ |= 2;
+	}
+	
+	return FASTQ;
+}
+
 int FileBuffgetFsa(FileBuff *src, Qseqs *header, Qseqs *qseq) {
 	
 	unsigned char *buff, *seq;
@@ -361,7 +468,7 @@ int FileBuffgetFq(FileBuff *src, Qseqs *header, Qseqs *qseq, Qseqs *qual) {
 	}
 	
 	/* get quality */
-	if(qual->size != qseq->size) {
+	if(qual->size <= qseq->len) {
 		qual->size = qseq->size;
 		free(qual->seq);
 		qual->seq = malloc(qual->size);
@@ -504,7 +611,7 @@ int FileBuffgetFqSeq(FileBuff *src, Qseqs *qseq, Qseqs *qual) {
 	}
 	
 	/* get quality */
-	if(qual->size != qseq->size) {
+	if(qual->size <= qseq->len) {
 		qual->size = qseq->size;
 		free(qual->seq);
 		qual->seq = malloc(qual->size);
@@ -552,3 +659,624 @@ int FileBuffgetFqSeq(FileBuff *src, Qseqs *qseq, Qseqs *qual) {
 	
 	return 1;
 }
+
+static int batch_getline(FileBuff *src, QBatch *dest) {
+	
+	int avail, len;
+	long start;
+	unsigned char *buff, *end, *seq;
+	
+	/* append line to arena */
+	start = dest->len;
+	avail = src->bytes;
+	buff = src->next;
+	end = 0;
+	while(!end) {
+		if(avail == 0) {
+			if((avail = src->buffFileBuff(src)) == 0) {
+				if(start == dest->len) {
+					src->bytes = 0;
+					return -1;
+				}
+				break;
+			}
+			buff = src->buffer;
+		}
+		if((end = memchr(buff, '\n', avail))) {
+			len = end - buff;
+		} else {
+			len = avail;
+		}
+		qbatch_reserve(dest, len + 1);
+		memcpy(dest->arena + dest->len, buff, len);
+		dest->len += len;
+		if(end) {
+			++len;
+		}
+		buff += len;
+		avail -= len;
+	}
+	src->bytes = avail;
+	src->next = buff;
+	
+	/* chomp line */
+	seq = dest->arena + dest->len;
+	while(start < dest->len && isspace(*--seq)) {
+		--dest->len;
+	}
+	dest->arena[dest->len++] = 0;
+	
+	return dest->len - start - 1;
+}
+
+static int batch_skipline(FileBuff *src) {
+	
+	int avail;
+	unsigned char *buff, *end;
+	
+	avail = src->bytes;
+	buff = src->next;
+	while(1) {
+		if(avail == 0) {
+			if((avail = src->buffFileBuff(src)) == 0) {
+				src->bytes = 0;
+				return 0;
+			}
+			buff = src->buffer;
+		}
+		if((end = memchr(buff, '\n', avail))) {
+			++end;
+			src->bytes = avail - (end - buff);
+			src->next = end;
+			return 1;
+		}
+		avail = 0;
+	}
+}
+
+int FileBuffgetFqBatch(FileBuff *src, QBatch *dest) {
+	
+	int i;
+	
+	qbatch_reset(dest);
+	while(!qbatch_full(dest)) {
+		i = dest->n;
+		if(src->bytes == 0 && src->buffFileBuff(src) == 0) {
+			break;
+		} else if(*src->next != '@') {
+			fprintf(stderr, "Malformed input.\n");
+			errno |= 1;
+			break;
+		}
+		/* skip first char */
+		++src->next;
+		--src->bytes;
+		
+		/* get header, qseq and quality */
+		dest->header[i] = dest->len;
+		if((dest->hlen[i] = batch_getline(src, dest)) < 0) {
+			break;
+		}
+		dest->seq[i] = dest->len;
+		if((dest->slen[i] = batch_getline(src, dest)) < 0 || !batch_skipline(src)) {
+			break;
+		}
+		dest->qual[i] = dest->len;
+		if((dest->qlen[i] = batch_getline(src, dest)) < 0) {
+			break;
+		}
+		++dest->n;
+	}
+	
+	return dest->n;
+}
+
+static long batch_countline(FileBuff *src) {
+	
+	int avail;
+	long len;
+	unsigned char *buff, *end;
+	
+	/* skip line, returning its length */
+	len = 0;
+	avail = src->bytes;
+	buff = src->next;
+	while(1) {
+		if(avail == 0) {
+			if((avail = src->buffFileBuff(src)) == 0) {
+				src->bytes = 0;
+				return len ? len : -1;
+			}
+			buff = src->buffer;
+		}
+		if((end = memchr(buff, '\n', avail))) {
+			len += end - buff;
+			++end;
+			src->bytes = avail - (end - buff);
+			src->next = end;
+			return len;
+		}
+		len += avail;
+		avail = 0;
+	}
+}
+
+static int batch_skipbytes(FileBuff *src, long len) {
+	
+	/* jump a line of known length */
+	while(src->bytes <= len) {
+		len -= src->bytes;
+		if(src->buffFileBuff(src) == 0) {
+			src->bytes = 0;
+			return 0;
+		}
+	}
+	src->next += len;
+	src->bytes -= len;
+	
+	return batch_skipline(src);
+}
+
+int FileBuffgetFqHeaders(FileBuff *src, QBatch *dest) {
+	
+	int i;
+	long len;
+	
+	qbatch_reset(dest);
+	while(!qbatch_full(dest)) {
+		i = dest->n;
+		if(src->bytes == 0 && src->buffFileBuff(src) == 0) {
+			break;
+		} else if(*src->next != '@') {
+			fprintf(stderr, "Malformed input.\n");
+			errno |= 1;
+			break;
+		}
+		++src->next;
+		--src->bytes;
+		
+		/* get header, skip qseq and quality of the same length */
+		dest->header[i] = dest->len;
+		if((dest->hlen[i] = batch_getline(src, dest)) < 0) {
+			break;
+		} else if((len = batch_countline(src)) < 0 || !batch_skipline(src)) {
+			break;
+		}
+		batch_skipbytes(src, len);
+		dest->slen[i] = len;
+		dest->qlen[i] = len;
+		++dest->n;
+	}
+	
+	return dest->n;
+}
+
+int FileBuffgetFsaHeaders(FileBuff *src, QBatch *dest) {
+	
+	int i;
+	long len;
+	
+	qbatch_reset(dest);
+	while(!qbatch_full(dest)) {
+		i = dest->n;
+		if(src->bytes == 0 && src->buffFileBuff(src) == 0) {
+			break;
+		} else if(*src->next != '>') {
+			fprintf(stderr, "Malformed input.\n");
+			errno |= 1;
+			break;
+		}
+		++src->next;
+		--src->bytes;
+		
+		/* get header, skip sequence lines */
+		dest->header[i] = dest->len;
+		if((dest->hlen[i] = batch_getline(src, dest)) < 0) {
+			break;
+		}
+		dest->slen[i] = 0;
+		while((src->bytes || src->buffFileBuff(src)) && *src->next != '>') {
+			if(0 < (len = batch_countline(src))) {
+				dest->slen[i] += len;
+			}
+		}
+		dest->qlen[i] = 0;
+		++dest->n;
+	}
+	
+	return dest->n;
+}
+
+int FileBuffgetHeader(FileBuff *src, Qseqs *header, int mark) {
+	
+	int avail, len;
+	unsigned char *buff, *end;
+	
+	/* get next header line, after its mark */
+	if(src->bytes == 0 && src->buffFileBuff(src) == 0) {
+		return 0;
+	} else if(*src->next != mark) {
+		fprintf(stderr, "Malformed input.\n");
+		errno |= 1;
+		return 0;
+	}
+	++src->next;
+	--src->bytes;
+	header->len = 0;
+	avail = src->bytes;
+	buff = src->next;
+	end = 0;
+	while(!end) {
+		if(avail == 0) {
+			if((avail = src->buffFileBuff(src)) == 0) {
+				break;
+			}
+			buff = src->buffer;
+		}
+		len = (end = memchr(buff, '\n', avail)) ? end - buff : avail;
+		while(header->size <= header->len + len) {
+			header->size <<= 1;
+			if(!(header->seq = realloc(header->seq, header->size))) {
+				ERROR();
+			}
+		}
+		memcpy(header->seq + header->len, buff, len);
+		header->len += len;
+		len += end ? 1 : 0;
+		buff += len;
+		avail -= len;
+	}
+	src->bytes = avail;
+	src->next = buff;
+	
+	/* chomp */
+	while(header->len && isspace(header->seq[header->len - 1])) {
+		--header->len;
+	}
+	header->seq[header->len] = 0;
+	
+	return 1;
+}
+
+static long stream_line(FileBuff *src, FILE *out) {
+	
+	int avail, len, cr;
+	long total;
+	unsigned char *buff, *end;
+	
+	/* pass a line from the buffer to out, or skip it without out */
+	total = 0;
+	cr = 0;
+	avail = src->bytes;
+	buff = src->next;
+	end = 0;
+	while(!end) {
+		if(avail == 0) {
+			if((avail = src->buffFileBuff(src)) == 0) {
+				break;
+			}
+			buff = src->buffer;
+		}
+		len = (end = memchr(buff, '\n', avail)) ? end - buff : avail;
+		if(cr && (len || !end)) {
+			/* carriage return was not the line end */
+			if(out) {
+				putc('\r', out);
+			}
+			++total;
+		}
+		cr = (len && buff[len - 1] == '\r');
+		if(out) {
+			sfwrite(buff, 1, len - cr, out);
+		}
+		total += len - cr;
+		len += end ? 1 : 0;
+		buff += len;
+		avail -= len;
+	}
+	src->bytes = avail;
+	src->next = buff;
+	if(out && (total || end)) {
+		putc('\n', out);
+	}
+	
+	return total;
+}
+
+long FileBuffpassFq(FileBuff *src, FILE *out) {
+	
+	long len;
+	
+	/* sequence, plus line and quality of the same length */
+	len = stream_line(src, out);
+	if(!batch_skipline(src)) {
+		return len;
+	} else if(out) {
+		fwrite("+\n", 1, 2, out);
+		stream_line(src, out);
+	} else {
+		batch_skipbytes(src, len);
+	}
+	
+	return len;
+}
+
+long FileBuffpassFsa(FileBuff *src, FILE *out) {
+	
+	long len, total;
+	
+	/* sequence lines up to the next header */
+	total = 0;
+	while((src->bytes || src->buffFileBuff(src)) && *src->next != '>') {
+		if(*src->next == '\n' || *src->next == '\r') {
+			/* blank lines are left out */
+			stream_line(src, 0);
+		} else {
+			len = stream_line(src, out);
+			total += len;
+		}
+	}
+	
+	return total;
+}
+
+static long bam_getbytes(FileBuff *src, unsigned char *dest, long len) {
+	
+	long n, got;
+	
+	/* copy or skip binary data across buffer refills */
+	got = 0;
+	while(got < len) {
+		if(src->bytes == 0 && src->buffFileBuff(src) == 0) {
+			src->bytes = 0;
+			break;
+		}
+		n = len - got < src->bytes ? len - got : src->bytes;
+		if(dest) {
+			memcpy(dest + got, src->next, n);
+		}
+		src->next += n;
+		src->bytes -= n;
+		got += n;
+	}
+	
+	return got;
+}
+
+static unsigned bam_get32(unsigned char *buff) {
+	return buff[0] | (buff[1] << 8) | (buff[2] << 16) | ((unsigned)(buff[3]) << 24);
+}
+
+static unsigned bam_copy(FileBuff *src, Qseqs *dest, long len) {
+	
+	/* append len bytes, returning the last four */
+	if(dest->size < dest->len + len) {
+		dest->size = (dest->len + len) << 1;
+		if(!(dest->seq = realloc(dest->seq, dest->size))) {
+			ERROR();
+		}
+	}
+	if(bam_getbytes(src, dest->seq + dest->len, len) != len) {
+		fprintf(stderr, "Malformed input.\n");
+		errno |= 1;
+		dest->len = 0;
+		return 0;
+	}
+	dest->len += len;
+	
+	return bam_get32(dest->seq + dest->len - 4);
+}
+
+int FileBuffgetBamHeader(FileBuff *src, Qseqs *dest) {
+	
+	unsigned n, len;
+	
+	/* magic, text and references, kept raw for bam output */
+	dest->len = 0;
+	len = bam_copy(src, dest, 8);
+	n = dest->len ? bam_copy(src, dest, len + 4) : 0;
+	while(n-- && dest->len) {
+		len = bam_copy(src, dest, 4);
+		if(dest->len) {
+			bam_copy(src, dest, len + 4);
+		}
+	}
+	
+	return dest->len;
+}
+
+static int bam_getrecord(FileBuff *src, QBatch *dest, int raw) {
+	
+	int i, j, code, lname, ncigar, flag;
+	long bsize, lseq, rest, got;
+	unsigned char core[36], *seq, *qual, tmp;
+	static const char nuc[] = "=ACMGRSVTWYHKDBN";
+	static const char rcnuc[] = "=TGKCYSBAWRDMHVN";
+	
+	/* fixed part of record */
+	i = dest->n;
+	if((got = bam_getbytes(src, core, 36)) != 36) {
+		if(got) {
+			fprintf(stderr, "Malformed input.\n");
+			errno |= 1;
+		}
+		return 0;
+	}
+	bsize = bam_get32(core);
+	lname = core[12];
+	ncigar = core[16] | (core[17] << 8);
+	flag = core[18] | (core[19] << 8);
+	lseq = bam_get32(core + 20);
+	rest = bsize - 32 - lname - 4 * ncigar - ((lseq + 1) >> 1) - lseq;
+	if(lname == 0 || lseq < 0 || rest < 0) {
+		fprintf(stderr, "Malformed input.\n");
+		errno |= 1;
+		return 0;
+	}
+	
+	if(raw) {
+		/* keep the record as it is, with the read name as header */
+		qbatch_reserve(dest, bsize + 4 + lname);
+		seq = dest->arena + dest->len;
+		memcpy(seq, core, 36);
+		got = bam_getbytes(src, seq + 36, bsize - 32) + 32;
+		dest->seq[i] = dest->len;
+		dest->slen[i] = bsize + 4;
+		dest->len += bsize + 4;
+		dest->header[i] = dest->len;
+		dest->hlen[i] = lname - 1;
+		memcpy(dest->arena + dest->len, seq + 36, lname - 1);
+		dest->len += lname;
+		dest->arena[dest->len - 1] = 0;
+		dest->qual[i] = dest->len - 1;
+		dest->qlen[i] = 0;
+	} else {
+		/* decode name, sequence and quality */
+		qbatch_reserve(dest, lname + 2 * lseq + 2);
+		dest->header[i] = dest->len;
+		dest->hlen[i] = lname - 1;
+		got = 32 + bam_getbytes(src, dest->arena + dest->len, lname);
+		dest->len += lname;
+		dest->arena[dest->len - 1] = 0;
+		got += bam_getbytes(src, 0, 4 * ncigar);
+		
+		/* packed sequence is read into the quality slot first */
+		seq = dest->arena + dest->len;
+		qual = seq + lseq + 1;
+		got += bam_getbytes(src, qual, (lseq + 1) >> 1);
+		for(j = 0; j < lseq; ++j) {
+			code = (qual[j >> 1] >> ((~j & 1) << 2)) & 15;
+			if(flag & 16) {
+				seq[lseq - 1 - j] = rcnuc[code];
+			} else {
+				seq[j] = nuc[code];
+			}
+		}
+		seq[lseq] = 0;
+		got += bam_getbytes(src, qual, lseq);
+		if(lseq && qual[0] == 255) {
+			memset(qual, '"', lseq);
+		} else {
+			for(j = 0; j < lseq; ++j) {
+				qual[j] += 33;
+			}
+		}
+		if(flag & 16) {
+			for(j = 0; j < lseq >> 1; ++j) {
+				tmp = qual[j];
+				qual[j] = qual[lseq - 1 - j];
+				qual[lseq - 1 - j] = tmp;
+			}
+		}
+		qual[lseq] = 0;
+		dest->seq[i] = dest->len;
+		dest->slen[i] = lseq;
+		dest->qual[i] = dest->len + lseq + 1;
+		dest->qlen[i] = lseq;
+		dest->len += 2 * lseq + 2;
+		got += bam_getbytes(src, 0, rest);
+	}
+	if(got != bsize) {
+		fprintf(stderr, "Malformed input.\n");
+		errno |= 1;
+		return 0;
+	}
+	
+	/* secondary and supplementary records repeat a read */
+	if(!raw && (flag & 2304)) {
+		dest->len = dest->header[i];
+	} else {
+		++dest->n;
+	}
+	
+	return 1;
+}
+
+int FileBuffgetBamBatch(FileBuff *src, QBatch *dest) {
+	
+	qbatch_reset(dest);
+	while(!qbatch_full(dest) && bam_getrecord(src, dest, 0));
+	
+	return dest->n;
+}
+
+int FileBuffgetBamRaw(FileBuff *src, QBatch *dest) {
+	
+	qbatch_reset(dest);
+	while(!qbatch_full(dest) && bam_getrecord(src, dest, 1));
+	
+	return dest->n;
+}
+
+static void * fqBatchReaderThrd(void *arg) {
+	
+	FqBatchReader *src;
+	QBatch *batch;
+	
+	src = arg;
+	do {
+		batch = qbatchpool_get(src->pool);
+		if(!src->getBatch(src->src, batch)) {
+			qbatchpool_put(src->pool, batch);
+			batch = 0;
+		} else {
+			batch->end = tellFileBuff(src->src, &batch->point);
+		}
+		if(!qbatchqueue_push(src->queue, batch)) {
+			if(batch) {
+				qbatchpool_put(src->pool, batch);
+			}
+			return NULL;
+		}
+	} while(batch);
+	
+	return NULL;
+}
+
+FqBatchReader * fqBatchReader_start(FileBuff *src, QBatchPool *pool, unsigned size, int (*getBatch)(FileBuff *, QBatch *)) {
+	
+	FqBatchReader *dest;
+	
+	dest = smalloc(sizeof(FqBatchReader));
+	dest->src = src;
+	dest->getBatch = getBatch;
+	dest->pool = pool;
+	dest->queue = qbatchqueue_init(size);
+	if((errno = pthread_create(&dest->id, NULL, &fqBatchReaderThrd, dest))) {
+		ERROR();
+	}
+	
+	return dest;
+}
+
+QBatch * fqBatchReader_get(FqBatchReader *src) {
+	
+	QBatch *batch;
+	
+	/* end of input is marked by an empty entry, after which the reader is gone */
+	if(src->queue->stop) {
+		return 0;
+	} else if(!(batch = qbatchqueue_pop(src->queue))) {
+		qbatchqueue_stop(src->queue);
+	}
+	
+	return batch;
+}
+
+void fqBatchReader_stop(FqBatchReader *src) {
+	
+	QBatch *batch;
+	QBatchQueue *queue;
+	
+	/* stop reader and return unused batches to the pool */
+	queue = src->queue;
+	qbatchqueue_stop(queue);
+	pthread_join(src->id, NULL);
+	while(queue->head != queue->tail) {
+		if((batch = qbatchqueue_pop(queue))) {
+			qbatchpool_put(src->pool, batch);
+		}
+	}
+	qbatchqueue_destroy(queue);
+	free(src);
+}
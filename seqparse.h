@@ -17,14 +17,46 @@
  * limitations under the License.
 */
 
+#include <pthread.h>
 #include "filebuff.h"
+#include "qbatch.h"
 #include "qseqs.h"
 
+#ifndef SEQPARSE
+typedef struct fqBatchReader FqBatchReader;
+struct fqBatchReader {
+	FileBuff *src;
+	QBatchPool *pool;
+	QBatchQueue *queue;
+	int (*getBatch)(FileBuff *, QBatch *);
+	pthread_t id;
+};
+#define SEQPARSE 1
+#endif
+
 /* determine format */
 int openAndDetermineFQ(FileBuff *inputfile, char *filename);
+int openAndDetermineTargets(FileBuff *inputfile, char *filename);
 /* get entry from fastafile */
 int FileBuffgetFsa(FileBuff *src, Qseqs *header, Qseqs *qseq);
 int FileBuffgetFsaSeq(FileBuff *src, Qseqs *qseq);
 /* get entry from fastq file */
 int FileBuffgetFq(FileBuff *src, Qseqs *header, Qseqs *qseq, Qseqs *qual);
 int FileBuffgetFqSeq(FileBuff *src, Qseqs *qseq, Qseqs *qual);
+/* get batch of entries from fastq file */
+int FileBuffgetFqBatch(FileBuff *src, QBatch *dest);
+/* get batch of headers only, skipping sequences */
+int FileBuffgetFqHeaders(FileBuff *src, QBatch *dest);
+int FileBuffgetFsaHeaders(FileBuff *src, QBatch *dest);
+/* stream entries, the header decides whether the rest is passed to out */
+int FileBuffgetHeader(FileBuff *src, Qseqs *header, int mark);
+long FileBuffpassFq(FileBuff *src, FILE *out);
+long FileBuffpassFsa(FileBuff *src, FILE *out);
+/* get header and batches of records from unaligned bam */
+int FileBuffgetBamHeader(FileBuff *src, Qseqs *dest);
+int FileBuffgetBamBatch(FileBuff *src, QBatch *dest);
+int FileBuffgetBamRaw(FileBuff *src, QBatch *dest);
+/* parse batches in a separate thread */
+FqBatchReader * fqBatchReader_start(FileBuff *src, QBatchPool *pool, unsigned size, int (*getBatch)(FileBuff *, QBatch *));
+QBatch * fqBatchReader_get(FqBatchReader *src);
+void fqBatchReader_stop(FqBatchReader *src);
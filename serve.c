@@ -0,0 +1,406 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "fqgrep.h"
+#include "pherror.h"
+#include "qseqs.h"
+#include "serve.h"
+#include "targets.h"
+
+static volatile sig_atomic_t serve_reload = 0;
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_signal(int sig) {
+	
+	if(sig == SIGHUP) {
+		serve_reload = 1;
+	} else {
+		serve_stop = 1;
+	}
+}
+
+static void serve_sigaction(int sig, void (*handler)(int)) {
+	
+	struct sigaction act;
+	
+	/* no restart, so accept and waitpid return on signals */
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = handler;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = 0;
+	sigaction(sig, &act, NULL);
+}
+
+static int serve_socket(char *socketname, struct sockaddr_un *addr) {
+	
+	int sock;
+	
+	if(sizeof(addr->sun_path) <= strlen(socketname)) {
+		fprintf(stderr, "Socket path too long:\t%s\n", socketname);
+		exit(1);
+	} else if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		ERROR();
+	}
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, socketname);
+	
+	return sock;
+}
+
+static void request_add(Qseqs *dest, const char *key, const char *value) {
+	
+	int len;
+	
+	/* one "key\tvalue" line per field */
+	len = strlen(key) + strlen(value) + 2;
+	if(dest->size <= dest->len + len) {
+		dest->size = (dest->len + len) << 1;
+		if(!(dest->seq = realloc(dest->seq, dest->size))) {
+			ERROR();
+		}
+	}
+	sprintf((char *)(dest->seq + dest->len), "%s\t%s\n", key, value);
+	dest->len += len;
+}
+
+static int request_read(int conn, Qseqs *dest, int *fds) {
+	
+	int len;
+	char cbuff[CMSG_SPACE(3 * sizeof(int))];
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	
+	/* first part carries the stdio of the client */
+	dest->len = 0;
+	iov.iov_base = dest->seq;
+	iov.iov_len = dest->size - 1;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuff;
+	msg.msg_controllen = sizeof(cbuff);
+	if((len = recvmsg(conn, &msg, 0)) <= 0) {
+		return 1;
+	} else if(!(cmsg = CMSG_FIRSTHDR(&msg)) || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+		return 1;
+	}
+	memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+	dest->len = len;
+	
+	/* rest of the request, up to the empty line */
+	while(dest->len < 2 || dest->seq[dest->len - 1] != '\n' || dest->seq[dest->len - 2] != '\n') {
+		if(dest->size <= dest->len + 1) {
+			dest->size <<= 1;
+			if(!(dest->seq = realloc(dest->seq, dest->size))) {
+				ERROR();
+			}
+		}
+		if((len = read(conn, dest->seq + dest->len, dest->size - dest->len - 1)) <= 0) {
+			return 1;
+		}
+		dest->len += len;
+	}
+	dest->seq[dest->len] = 0;
+	
+	return 0;
+}
+
+static int request_run(int conn, Target *targets) {
+	
+	int n, se, inter, pe, reload, fds[3];
+	char *line, *next, *value, *cwd;
+	char **inputfilenames, **intfilenames, **pefilenames;
+	GrepOpts *opts;
+	Qseqs *request;
+	
+	/* get request */
+	request = setQseqs(4096);
+	if(request_read(conn, request, fds)) {
+		fprintf(stderr, "Incomplete request.\n");
+		return 1;
+	}
+	
+	/* answer on the stdio of the client */
+	for(n = 0; n < 3; ++n) {
+		if(dup2(fds[n], n) < 0) {
+			ERROR();
+		}
+		close(fds[n]);
+	}
+	
+	/* parse fields, file lists point into the request */
+	n = 0;
+	for(line = (char *)(request->seq); *line; ++line) {
+		n += *line == '\n';
+	}
+	opts = grepOpts_init();
+	inputfilenames = smalloc(3 * n * sizeof(char *));
+	intfilenames = inputfilenames + n;
+	pefilenames = intfilenames + n;
+	se = 0;
+	inter = 0;
+	pe = 0;
+	reload = 0;
+	cwd = 0;
+	for(line = (char *)(request->seq); *line && *line != '\n'; line = next + 1) {
+		next = strchr(line, '\n');
+		*next = 0;
+		if(!(value = strchr(line, '\t'))) {
+			fprintf(stderr, "Malformed request.\n");
+			return 1;
+		}
+		*value++ = 0;
+		if(strcmp(line, "i") == 0) {
+			inputfilenames[se++] = value;
+		} else if(strcmp(line, "I") == 0) {
+			intfilenames[inter++] = value;
+		} else if(strcmp(line, "p") == 0) {
+			pefilenames[pe++] = value;
+		} else if(strcmp(line, "output") == 0) {
+			opts->outputfilename = value;
+		} else if(strcmp(line, "unmatched") == 0) {
+			opts->unmatchedname = value;
+		} else if(strcmp(line, "cwd") == 0) {
+			cwd = value;
+		} else if(strcmp(line, "invert") == 0) {
+			opts->invert = atoi(value);
+		} else if(strcmp(line, "mode") == 0) {
+			opts->mode = atoi(value);
+		} else if(strcmp(line, "stream") == 0) {
+			opts->stream = atoi(value);
+		} else if(strcmp(line, "bamout") == 0) {
+			opts->bamout = atoi(value);
+		} else if(strcmp(line, "zstd") == 0) {
+			opts->zstdlevel = atoi(value);
+		} else if(strcmp(line, "zstdworkers") == 0) {
+			opts->zstdworkers = atoi(value);
+		} else if(strcmp(line, "gzspan") == 0) {
+			opts->gzspan = atoll(value);
+		} else if(strcmp(line, "threads") == 0) {
+			opts->thread_num = atoi(value);
+		} else if(strcmp(line, "reload") == 0) {
+			reload = atoi(value);
+		} else {
+			fprintf(stderr, "Unknown request field:\t%s\n", line);
+			return 1;
+		}
+	}
+	
+	if(reload) {
+		/* the server reloads between requests */
+		kill(getppid(), SIGHUP);
+		return 0;
+	} else if(cwd && chdir(cwd)) {
+		ERROR();
+	}
+	
+	return targetgrep(targets, opts, inputfilenames, se, intfilenames, inter, pefilenames, pe);
+}
+
+int fqserve(char *targetfilename, GrepOpts *opts) {
+	
+	int sock, conn, running, status, len;
+	char num[32];
+	pid_t pid;
+	mode_t mask;
+	struct sockaddr_un addr;
+	Target *targets, *next;
+	
+	/* load targets once, workers inherit them */
+	targets = loadTargets(targetfilename, opts);
+	
+	/* listen */
+	sock = serve_socket(opts->socketname, &addr);
+	unlink(opts->socketname);
+	/* requests read and write files as the server, so only its user may connect */
+	mask = umask(077);
+	if(bind(sock, (struct sockaddr *) &addr, sizeof(addr)) || chmod(opts->socketname, 0600) || listen(sock, SERVE_BACKLOG)) {
+		ERROR();
+	}
+	umask(mask);
+	serve_sigaction(SIGHUP, &serve_signal);
+	serve_sigaction(SIGINT, &serve_signal);
+	serve_sigaction(SIGTERM, &serve_signal);
+	fprintf(stderr, "# Serving on:\t%s\n", opts->socketname);
+	
+	/* one process per request, at most thread_num at a time */
+	running = 0;
+	while(!serve_stop) {
+		while(running && 0 < waitpid(-1, &status, running < opts->thread_num ? WNOHANG : 0)) {
+			--running;
+		}
+		if(serve_reload) {
+			/* running requests keep the targets they were forked with */
+			serve_reload = 0;
+			if(targetfilename && access(targetfilename, R_OK)) {
+				fprintf(stderr, "Cannot reload targets:\t%s\n", targetfilename);
+			} else {
+				fprintf(stderr, "# Reloading targets.\n");
+				next = loadTargets(targetfilename, opts);
+				target_destroy(targets);
+				targets = next;
+			}
+		}
+		if(opts->thread_num <= running || serve_stop) {
+			continue;
+		} else if((conn = accept(sock, NULL, NULL)) < 0) {
+			if(errno != EINTR && errno != ECONNABORTED) {
+				ERROR();
+			}
+			continue;
+		}
+		
+		if((pid = fork()) < 0) {
+			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
+		} else if(pid == 0) {
+			/* worker */
+			close(sock);
+			signal(SIGHUP, SIG_DFL);
+			signal(SIGINT, SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+			status = request_run(conn, targets);
+			fflush(stdout);
+			fflush(stderr);
+			len = sprintf(num, "%d\n", status);
+			if(write(conn, num, len) != len) {
+				status |= 1;
+			}
+			close(conn);
+			exit(status);
+		} else {
+			++running;
+		}
+		close(conn);
+	}
+	
+	/* clean up */
+	close(sock);
+	unlink(opts->socketname);
+	while(0 < wait(&status));
+	target_destroy(targets);
+	
+	return 0;
+}
+
+int fqclient(GrepOpts *opts, int reload, char **inputfilenames, int se, char **intfilenames, int inter, char **pefilenames, int pe) {
+	
+	int i, sock, status, fds[3];
+	char cbuff[CMSG_SPACE(3 * sizeof(int))], num[32], cwd[PATH_MAX];
+	struct sockaddr_un addr;
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	Qseqs *request;
+	FILE *answer;
+	
+	/* connect */
+	sock = serve_socket(opts->socketname, &addr);
+	if(connect(sock, (struct sockaddr *) &addr, sizeof(addr))) {
+		fprintf(stderr, "Cannot connect to server:\t%s\n", opts->socketname);
+		return 1;
+	}
+	
+	/* request, relative paths are taken from the current directory */
+	request = setQseqs(4096);
+	if(!getcwd(cwd, sizeof(cwd))) {
+		ERROR();
+	}
+	request_add(request, "cwd", cwd);
+	sprintf(num, "%u", opts->invert);
+	request_add(request, "invert", num);
+	sprintf(num, "%d", opts->mode);
+	request_add(request, "mode", num);
+	sprintf(num, "%d", opts->stream);
+	request_add(request, "stream", num);
+	sprintf(num, "%d", opts->bamout);
+	request_add(request, "bamout", num);
+	sprintf(num, "%d", opts->zstdlevel);
+	request_add(request, "zstd", num);
+	sprintf(num, "%d", opts->zstdworkers);
+	request_add(request, "zstdworkers", num);
+	sprintf(num, "%lld", opts->gzspan);
+	request_add(request, "gzspan", num);
+	sprintf(num, "%d", opts->thread_num);
+	request_add(request, "threads", num);
+	sprintf(num, "%d", reload);
+	request_add(request, "reload", num);
+	request_add(request, "output", opts->outputfilename);
+	if(opts->unmatchedname) {
+		request_add(request, "unmatched", opts->unmatchedname);
+	}
+	for(i = 0; i < se; ++i) {
+		request_add(request, "i", inputfilenames[i]);
+	}
+	for(i = 0; i < inter; ++i) {
+		request_add(request, "I", intfilenames[i]);
+	}
+	for(i = 0; i < pe; ++i) {
+		request_add(request, "p", pefilenames[i]);
+	}
+	request->seq[request->len++] = '\n';
+	
+	/* send it along with stdin, stdout and stderr */
+	fds[0] = 0;
+	fds[1] = 1;
+	fds[2] = 2;
+	iov.iov_base = request->seq;
+	iov.iov_len = request->len;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuff;
+	msg.msg_controllen = sizeof(cbuff);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+	if(sendmsg(sock, &msg, 0) != request->len) {
+		ERROR();
+	}
+	destroyQseqs(request);
+	
+	/* exit status of the request */
+	if(!(answer = fdopen(sock, "rb")) || fscanf(answer, "%d", &status) != 1) {
+		fprintf(stderr, "No answer from server.\n");
+		status = 1;
+	}
+	if(answer) {
+		fclose(answer);
+	} else {
+		close(sock);
+	}
+	
+	return status;
+}
@@ -0,0 +1,29 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include "fqgrep.h"
+
+#ifndef SERVE
+#define SERVE 1
+#define SERVE_BACKLOG 64
+#endif
+
+/* resident server holding the targets, and its client */
+int fqserve(char *targetfilename, GrepOpts *opts);
+int fqclient(GrepOpts *opts, int reload, char **inputfilenames, int se, char **intfilenames, int inter, char **pefilenames, int pe);
@@ -0,0 +1,537 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _XOPEN_SOURCE 600
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "bgzf.h"
+#include "filebuff.h"
+#include "fqsplit.h"
+#include "gzindex.h"
+#include "pherror.h"
+#include "shard.h"
+
+#define SHARD_PLAIN 1
+#define SHARD_BGZF 2
+#define SHARD_GZINDEX 3
+#define SHARD_LINE 65536
+
+static char * shard_strdup(char *src) {
+	
+	char *dest;
+	
+	dest = smalloc(strlen(src) + 1);
+	strcpy(dest, src);
+	
+	return dest;
+}
+
+Shard * shard_init(int i, int n, int counts, char **outputfilename, char **unmatchedname) {
+	
+	int k;
+	char **names[2];
+	Shard *dest;
+	
+	/* outputs get ".shard<i>of<n>" after their prefix, and are listed in a manifest */
+	dest = smalloc(sizeof(Shard));
+	dest->i = i;
+	dest->n = n;
+	dest->counts = counts;
+	dest->files = 0;
+	dest->size = 4;
+	dest->names = smalloc(dest->size * sizeof(char *));
+	dest->merged = smalloc(dest->size * sizeof(char *));
+	names[0] = outputfilename;
+	names[1] = unmatchedname;
+	for(k = 0; k < 2; ++k) {
+		if((dest->prefix[k] = *names[k])) {
+			dest->name[k] = smalloc(strlen(dest->prefix[k]) + 32);
+			sprintf(dest->name[k], "%s.shard%dof%d", dest->prefix[k], i, n);
+			*names[k] = dest->name[k];
+		} else {
+			dest->name[k] = 0;
+		}
+	}
+	
+	return dest;
+}
+
+static void shard_add(Shard *dest, char *name, char *merged) {
+	
+	int i;
+	
+	/* outputs are opened once per input set, and listed once */
+	for(i = 0; i < dest->files; ++i) {
+		if(strcmp(dest->names[i], name) == 0) {
+			free(merged);
+			return;
+		}
+	}
+	if(dest->files == dest->size) {
+		dest->size <<= 1;
+		dest->names = realloc(dest->names, dest->size * sizeof(char *));
+		dest->merged = realloc(dest->merged, dest->size * sizeof(char *));
+		if(!dest->names || !dest->merged) {
+			ERROR();
+		}
+	}
+	dest->names[dest->files] = shard_strdup(name);
+	dest->merged[dest->files++] = merged;
+}
+
+void shard_output(Shard *dest, char *prefix, char *filename) {
+	
+	int k;
+	char *merged;
+	
+	/* output of this shard, and the file it ends up in */
+	k = !dest->name[0] || strncmp(prefix, dest->name[0], strlen(dest->name[0])) != 0;
+	merged = smalloc(strlen(dest->prefix[k]) + strlen(filename) - strlen(dest->name[k]) + 1);
+	sprintf(merged, "%s%s", dest->prefix[k], filename + strlen(dest->name[k]));
+	shard_add(dest, filename, merged);
+}
+
+int shard_mine(Shard *src, char *header) {
+	
+	int len;
+	
+	/* id up to the first whitespace and without /1 or /2, so mates agree */
+	len = 0;
+	while(header[len] && !isspace(header[len])) {
+		++len;
+	}
+	if(2 < len && header[len - 2] == '/' && (header[len - 1] == '1' || header[len - 1] == '2')) {
+		len -= 2;
+	}
+	
+	return crc32(0, (unsigned char *)(header), len) % src->n == src->i - 1;
+}
+
+static unsigned shard_get32(unsigned char *buff) {
+	return buff[0] | (buff[1] << 8) | (buff[2] << 16) | ((unsigned)(buff[3]) << 24);
+}
+
+static int shard_locate(ShardBound *dest, int kind, int fd, GzIndex *index, long long size, long long offset) {
+	
+	int i;
+	long bsize;
+	unsigned char buff[256];
+	
+	/* point to restart reading from, at or after offset */
+	dest->point = 0;
+	if(size <= offset) {
+		return 0;
+	} else if(kind == SHARD_PLAIN) {
+		dest->in = offset;
+		dest->out = offset;
+		return 1;
+	} else if(kind == SHARD_GZINDEX) {
+		for(i = 0; i < index->n && index->list[i].in < offset; ++i);
+		if(i == index->n) {
+			return 0;
+		}
+		dest->point = index->list + i;
+		dest->in = dest->point->in;
+		dest->out = dest->point->out;
+		return 1;
+	}
+	
+	/* walk bgzf block headers, adding up their inflated sizes */
+	dest->in = 0;
+	dest->out = 0;
+	while(dest->in < offset) {
+		if(pread(fd, buff, sizeof(buff), dest->in) < 18 || (bsize = bgzf_extra(buff, sizeof(buff))) < 26 || pread(fd, buff, 4, dest->in + bsize - 4) != 4) {
+			return 0;
+		}
+		dest->out += shard_get32(buff);
+		dest->in += bsize;
+	}
+	
+	return dest->in + 28 < size;
+}
+
+static long shard_bgzfread(int fd, long long in, unsigned char *dest, long size, int *eof) {
+	
+	long len, blen, bsize;
+	unsigned char *block;
+	z_stream strm;
+	
+	/* inflate blocks from "in" while a whole one fits */
+	strm.zalloc = Z_NULL;
+	strm.zfree = Z_NULL;
+	strm.opaque = Z_NULL;
+	strm.next_in = Z_NULL;
+	strm.avail_in = 0;
+	if(inflateInit2(&strm, -15) != Z_OK) {
+		ERROR();
+	}
+	block = smalloc(BGZF_BLOCKSIZE);
+	len = 0;
+	*eof = 0;
+	while(len + BGZF_BLOCKSIZE <= size) {
+		if((blen = pread(fd, block, BGZF_BLOCKSIZE, in)) <= 0 || (bsize = bgzf_bsize(block, blen)) <= 0) {
+			*eof = 1;
+			break;
+		}
+		inflateReset(&strm);
+		strm.next_in = block + 12 + (block[10] | (block[11] << 8));
+		strm.avail_in = block + bsize - 8 - strm.next_in;
+		strm.next_out = dest + len;
+		strm.avail_out = size - len;
+		if(inflate(&strm, Z_FINISH) != Z_STREAM_END) {
+			*eof = 1;
+			break;
+		}
+		len += strm.total_out;
+		in += bsize;
+	}
+	inflateEnd(&strm);
+	free(block);
+	
+	return len;
+}
+
+static long shard_gzread(int fd, GzPoint *point, unsigned char *dest, long size, int *eof) {
+	
+	int status;
+	long long in;
+	long len;
+	unsigned char *buff;
+	z_stream strm;
+	
+	/* raw inflate from an access point of the index */
+	strm.zalloc = Z_NULL;
+	strm.zfree = Z_NULL;
+	strm.opaque = Z_NULL;
+	strm.next_in = Z_NULL;
+	strm.avail_in = 0;
+	if(inflateInit2(&strm, -15) != Z_OK) {
+		ERROR();
+	}
+	buff = smalloc(CHUNK);
+	in = point->in;
+	if(point->bits) {
+		if(pread(fd, buff, 1, in - 1) != 1) {
+			ERROR();
+		}
+		inflatePrime(&strm, point->bits, buff[0] >> (8 - point->bits));
+	}
+	inflateSetDictionary(&strm, point->window, WINSIZE);
+	strm.next_out = dest;
+	strm.avail_out = size;
+	status = Z_OK;
+	while(status == Z_OK && strm.avail_out) {
+		if(!strm.avail_in) {
+			if((len = pread(fd, buff, CHUNK, in)) <= 0) {
+				break;
+			}
+			in += len;
+			strm.next_in = buff;
+			strm.avail_in = len;
+		}
+		status = inflate(&strm, Z_NO_FLUSH);
+	}
+	*eof = strm.avail_out != 0;
+	len = size - strm.avail_out;
+	inflateEnd(&strm);
+	free(buff);
+	
+	return len;
+}
+
+static int shard_sync(ShardBound *dest, int kind, int fd, long long size, int pairs) {
+	
+	int eof;
+	long len, window, pos;
+	unsigned char *buff;
+	
+	/* first record after the partial line at the restart point */
+	if(kind == SHARD_PLAIN) {
+		return 0 <= (dest->pos = fqsplit_sync(fd, dest->in, size, pairs));
+	}
+	pos = -2;
+	for(window = FQSPLIT_WINDOW; pos == -2 && window <= FQSPLIT_MAXWINDOW; window <<= 1) {
+		buff = smalloc(window);
+		if(kind == SHARD_BGZF) {
+			len = shard_bgzfread(fd, dest->in, buff, window, &eof);
+		} else {
+			len = shard_gzread(fd, dest->point, buff, window, &eof);
+		}
+		pos = fqsplit_search(buff, len, eof, pairs);
+		free(buff);
+	}
+	dest->pos = 0 <= pos ? dest->out + pos : -1;
+	
+	return 0 <= pos;
+}
+
+static void shard_bound(ShardBound *dest, int kind, int fd, GzIndex *index, long long size, int k, int n, int pairs) {
+	
+	ShardBound next;
+	
+	/* boundary k of n, left to the next one when it is not found before that */
+	if(k <= 0) {
+		dest->in = 0;
+		dest->out = 0;
+		dest->pos = 0;
+		dest->point = 0;
+		return;
+	}
+	for(; k < n; ++k) {
+		if(shard_locate(dest, kind, fd, index, size, size * k / n) && shard_sync(dest, kind, fd, size, pairs)
+			&& (!shard_locate(&next, kind, fd, index, size, size * (k + 1) / n) || dest->pos < next.out)) {
+			return;
+		}
+	}
+	dest->pos = -1;
+}
+
+int shard_range(FileBuff *inputfile, unsigned FASTQ, int pairs, int i, int n) {
+	
+	int fd, kind;
+	struct stat st;
+	ShardBound lo, hi;
+	
+	/* plain, bgzf and indexed gzip fastq are cut in shares of their bytes */
+	if((FASTQ & 11) != 1 || (fd = fileno(inputfile->file)) < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+		return 0;
+	} else if(inputfile->buffFileBuff == &buff_FileBuff) {
+		kind = SHARD_PLAIN;
+	} else if(inputfile->buffFileBuff == &BuffbgzfFileBuff) {
+		kind = SHARD_BGZF;
+	} else if(inputfile->buffFileBuff == &BuffgzFileBuff && inputfile->index) {
+		/* all shards need the complete index to agree on the boundaries */
+		if(inputfile->index->window && indexgzFileBuff(inputfile)) {
+			fprintf(stderr, "Cannot index gzip input of share %d.\n", i);
+			exit(1);
+		}
+		kind = SHARD_GZINDEX;
+	} else {
+		return 0;
+	}
+	shard_bound(&lo, kind, fd, inputfile->index, st.st_size, i - 1, n, pairs);
+	shard_bound(&hi, kind, fd, inputfile->index, st.st_size, i, n, pairs);
+	
+	/* read from the first record of the share, up to the first of the next */
+	if(kind == SHARD_PLAIN) {
+		rangeFileBuff(inputfile, inputfile->file, lo.pos < 0 ? st.st_size : lo.pos, hi.pos < 0 ? st.st_size : hi.pos);
+	} else if(lo.pos < 0) {
+		inputfile->bytes = 0;
+		inputfile->next = inputfile->buffer;
+		endFileBuff(inputfile, inputfile->pos);
+	} else {
+		if(lo.pos && ((kind == SHARD_BGZF && seekbgzfFileBuff(inputfile, lo.in, lo.out)) || seekFileBuff(inputfile, lo.pos, lo.point))) {
+			fprintf(stderr, "Cannot seek to share %d.\n", i);
+			exit(1);
+		}
+		endFileBuff(inputfile, hi.pos < 0 ? 0 : hi.pos);
+	}
+	
+	return 1;
+}
+
+int shard_input(Shard *src, FileBuff *inputfile, unsigned FASTQ, int pairs) {
+	
+	return src && shard_range(inputfile, FASTQ, pairs, src->i, src->n);
+}
+
+int shard_save(Shard *src) {
+	
+	int i;
+	char *filename;
+	FILE *outfile;
+	
+	/* manifest next to the outputs, read by fqgrep merge */
+	filename = smalloc(strlen(src->name[0]) + strlen(SHARD_EXT) + 1);
+	sprintf(filename, "%s%s", src->name[0], SHARD_EXT);
+	outfile = sfopen(filename, "wb");
+	fprintf(outfile, "#fqgrep shard manifest\n");
+	fprintf(outfile, "shard\t%d\t%d\n", src->i, src->n);
+	fprintf(outfile, "counts\t%d\n", src->counts);
+	for(i = 0; i < src->files; ++i) {
+		fprintf(outfile, "file\t%s\t%s\n", src->names[i], src->merged[i]);
+	}
+	i = fclose(outfile);
+	free(filename);
+	
+	return i != 0;
+}
+
+static Shard * shard_load(char *filename) {
+	
+	int i, n, counts;
+	char *line, *name, *merged, *none;
+	FILE *infile;
+	Shard *dest;
+	
+	infile = sfopen(filename, "rb");
+	line = smalloc(SHARD_LINE);
+	dest = 0;
+	while(fgets(line, SHARD_LINE, infile)) {
+		line[strcspn(line, "\n")] = 0;
+		if(*line == '#') {
+			continue;
+		} else if(!dest && sscanf(line, "shard\t%d\t%d", &i, &n) == 2 && 0 < i && i <= n) {
+			none = 0;
+			dest = shard_init(i, n, 0, &none, &none);
+		} else if(dest && sscanf(line, "counts\t%d", &counts) == 1) {
+			dest->counts = counts;
+		} else if(dest && strncmp(line, "file\t", 5) == 0 && (merged = strchr((name = line + 5), '\t'))) {
+			*merged++ = 0;
+			shard_add(dest, name, shard_strdup(merged));
+		} else {
+			fprintf(stderr, "Invalid manifest:\t%s\n", filename);
+			exit(1);
+		}
+	}
+	fclose(infile);
+	free(line);
+	if(!dest) {
+		fprintf(stderr, "Invalid manifest:\t%s\n", filename);
+		exit(1);
+	}
+	
+	return dest;
+}
+
+static void shard_sum(FILE *outfile, FILE **infiles, int n, char *filename) {
+	
+	int i;
+	long count;
+	char *line, *other, *last, *olast;
+	
+	/* count lines of the shards come in the same order, with their last field summed */
+	line = smalloc(SHARD_LINE);
+	other = smalloc(SHARD_LINE);
+	while(fgets(line, SHARD_LINE, infiles[0])) {
+		if(!(last = strrchr(line, '\t'))) {
+			fprintf(stderr, "Invalid count line in:\t%s\n", filename);
+			exit(1);
+		}
+		count = strtol(last + 1, 0, 10);
+		for(i = 1; i < n; ++i) {
+			if(!fgets(other, SHARD_LINE, infiles[i]) || !(olast = strrchr(other, '\t')) || olast - other != last - line || strncmp(other, line, last - line)) {
+				fprintf(stderr, "Shard outputs differ:\t%s\n", filename);
+				exit(1);
+			}
+			count += strtol(olast + 1, 0, 10);
+		}
+		sprintf(last + 1, "%ld\n", count);
+		sfwrite(line, 1, strlen(line), outfile);
+	}
+	free(line);
+	free(other);
+}
+
+static void shard_cat(FILE *outfile, FILE *infile) {
+	
+	long len;
+	unsigned char *buff;
+	
+	buff = smalloc(CHUNK);
+	while((len = fread(buff, 1, CHUNK, infile))) {
+		sfwrite(buff, 1, len, outfile);
+	}
+	free(buff);
+}
+
+int shard_merge(char **manifests, int n) {
+	
+	int i, j;
+	FILE *outfile, **infiles;
+	Shard **shards, *src;
+	
+	/* all shards of one run, each once */
+	shards = smalloc(n * sizeof(Shard *));
+	for(i = 0; i < n; ++i) {
+		shards[i] = 0;
+	}
+	for(i = 0; i < n; ++i) {
+		src = shard_load(manifests[i]);
+		if(src->n != n || shards[src->i - 1]) {
+			fprintf(stderr, "Expected each of %d shards once:\t%s\n", src->n, manifests[i]);
+			exit(1);
+		}
+		shards[src->i - 1] = src;
+	}
+	src = *shards;
+	for(i = 1; i < n; ++i) {
+		if(shards[i]->files != src->files || shards[i]->counts != src->counts) {
+			fprintf(stderr, "Shards are from different runs.\n");
+			exit(1);
+		}
+		for(j = 0; j < src->files; ++j) {
+			if(strcmp(shards[i]->merged[j], src->merged[j])) {
+				fprintf(stderr, "Shards are from different runs.\n");
+				exit(1);
+			}
+		}
+	}
+	
+	/* concatenate outputs in shard order, shard files are kept */
+	infiles = smalloc(n * sizeof(FILE *));
+	for(j = 0; j < src->files; ++j) {
+		fprintf(stderr, "# Merging:\t%s\n", src->merged[j]);
+		outfile = sfopen(src->merged[j], "wb");
+		for(i = 0; i < n; ++i) {
+			infiles[i] = sfopen(shards[i]->names[j], "rb");
+		}
+		if(src->counts) {
+			shard_sum(outfile, infiles, n, src->merged[j]);
+		}
+		for(i = 0; i < n; ++i) {
+			if(!src->counts) {
+				shard_cat(outfile, infiles[i]);
+			}
+			fclose(infiles[i]);
+		}
+		if(fclose(outfile)) {
+			ERROR();
+		}
+	}
+	free(infiles);
+	for(i = 0; i < n; ++i) {
+		shard_destroy(shards[i]);
+	}
+	free(shards);
+	
+	return 0;
+}
+
+void shard_destroy(Shard *dest) {
+	
+	int i;
+	
+	if(dest) {
+		for(i = 0; i < dest->files; ++i) {
+			free(dest->names[i]);
+			free(dest->merged[i]);
+		}
+		free(dest->names);
+		free(dest->merged);
+		free(dest->name[0]);
+		free(dest->name[1]);
+		free(dest);
+	}
+}
@@ -0,0 +1,55 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <stdio.h>
+#include "filebuff.h"
+
+#ifndef SHARD
+typedef struct shard Shard;
+typedef struct shardBound ShardBound;
+struct shardBound {
+	long long in; /* compressed offset reading restarts from */
+	long long out; /* uncompressed offset of in */
+	long long pos; /* first record of the share, -1 at end of input */
+	GzPoint *point; /* inflate state at in, for indexed gzip */
+};
+struct shard {
+	int i; /* shard i of n, counted from 1 */
+	int n;
+	int counts; /* count lines are summed on merge */
+	int files;
+	int size;
+	char *prefix[2]; /* output and unmatched names without shards */
+	char *name[2]; /* and with */
+	char **names; /* outputs written by this shard */
+	char **merged; /* and what they are merged into */
+};
+#define SHARD 1
+#define SHARD_EXT ".manifest"
+#endif
+
+/* one share of the inputs, for runs on several nodes without coordination */
+Shard * shard_init(int i, int n, int counts, char **outputfilename, char **unmatchedname);
+void shard_output(Shard *dest, char *prefix, char *filename);
+int shard_mine(Shard *src, char *header);
+int shard_range(FileBuff *inputfile, unsigned FASTQ, int pairs, int i, int n);
+int shard_input(Shard *src, FileBuff *inputfile, unsigned FASTQ, int pairs);
+int shard_save(Shard *src);
+int shard_merge(char **manifests, int n);
+void shard_destroy(Shard *dest);
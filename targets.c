@@ -17,105 +17,148 @@
  * limitations under the License.
 */
 
+#define _XOPEN_SOURCE 600
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "filebuff.h"
 #include "pherror.h"
+#include "qbatch.h"
 #include "qseqs.h"
+#include "seqparse.h"
 #include "targets.h"
 
+#define radixkey(c) ((unsigned char)(c) ^ (CHAR_MIN < 0 ? 0x80 : 0))
+
 Target * target_malloc(long unsigned size) {
 	
 	Target *dest;
 	
-	dest = smalloc(sizeof(Target));
-	dest->n = 0;
+	/* zero on failure, as the api cannot exit */
+	if(!(dest = calloc(1, sizeof(Target)))) {
+		return 0;
+	}
 	dest->size = size;
-	dest->targets = smalloc(size * sizeof(char *));
+	dest->arenaSize = size << 5;
+	dest->arena = malloc(dest->arenaSize);
+	dest->off32 = malloc(size * sizeof(unsigned));
+	dest->grep = &target_bgrep;
+	if(!dest->arena || !dest->off32) {
+		target_destroy(dest);
+		return 0;
+	}
 	
 	return dest;
 }
 
 Target * target_realloc(Target *src, long unsigned size) {
 	
-	src->size = size;
-	src->targets = realloc(src->targets, size * sizeof(char *));
-	if(!src->targets) {
+	src->size = size ? size : 1;
+	if(src->off32) {
+		src->off32 = realloc(src->off32, src->size * sizeof(unsigned));
+	} else {
+		src->off64 = realloc(src->off64, src->size * sizeof(long unsigned));
+	}
+	if(!src->off32 && !src->off64) {
 		ERROR();
 	}
 	
 	return src;
 }
 
-int entrycmp(char *src1, char *src2) {
+static int target_arenaGrow(Target *src, long len) {
 	
-	static int tolerance = 0; /* here */ /* consider setting it cmd-line */
-	int diff, match;
+	long i, size;
+	long unsigned *off64;
+	char *arena;
 	
-	/* set max diff between identifiers */
-	if(tolerance < 0 && src1) {
-		tolerance = *(int*)(src1);
-	}
-	
-	diff = 0;
-	match = 0;
-	while(*src1 && *src2) {
-		if(*src1 != *src2) {
-			if(!match) {
-				match = *src1 < *src2 ? -1 : 1;
-			}
-			if(tolerance < ++diff) {
-				return match * diff;
-			}
+	/* grow arena */
+	if(src->arenaSize < src->len + len) {
+		size = src->arenaSize;
+		while(size < src->len + len) {
+			size <<= 1;
 		}
-		++src1;
-		++src2;
+		if(!(arena = realloc(src->arena, size))) {
+			return ENOMEM;
+		}
+		src->arena = arena;
+		src->arenaSize = size;
 	}
 	
-	if((*src1 || *src2) && !(isspace(*src1) || isspace(*src2))) {
-		if(!match) {
-			match = *src1 < *src2 ? -1 : 1;
+	/* switch to 64 bit offsets */
+	if(src->off32 && UINT_MAX < src->len + len) {
+		if(!(off64 = malloc(src->size * sizeof(long unsigned)))) {
+			return ENOMEM;
 		}
-		while(*src1) {
-			if(tolerance < ++diff) {
-				return match * diff;
-			}
-			++src1;
-		}
-		while(*src2) {
-			if(tolerance < ++diff) {
-				return match * diff;
-			}
-			++src2;
+		for(i = 0; i < src->n; ++i) {
+			off64[i] = src->off32[i];
 		}
+		free(src->off32);
+		src->off32 = 0;
+		src->off64 = off64;
 	}
 	
-	if(diff <= tolerance) {
-		diff = 0;
+	return 0;
+}
+
+void target_destroy(Target *src) {
+	if(src->trie) {
+		trie_destroy(src->trie);
+	}
+	if(src->pack) {
+		idpack_destroy(src->pack);
+	}
+	if(src->dfa) {
+		dfa_destroy(src->dfa);
 	}
+	if(src->ranges) {
+		ranges_destroy(src->ranges);
+	}
+	free(src->arena);
+	free(src->off32);
+	free(src->off64);
+	free(src->eyfp);
+	free(src->eyrank);
+	free(src);
+}
+
+int entrycmp(char *src1, char *src2) {
 	
-	return match * diff;
+	/* ids are equal up to where one of them ends, or runs into whitespace */
+	while(*src1 && *src1 == *src2) {
+		++src1;
+		++src2;
+	}
+	if(*src1 == *src2 || (!*src1 && isspace(*src2)) || (!*src2 && isspace(*src1))) {
+		return 0;
+	}
+	
+	return *src1 < *src2 ? -1 : 1;
 }
 
-int target_grep(Target *src, char *entry) {
+long target_bgrep(Target *src, char *entry) {
 	
-	int downlim, uplim, index, match;
-	char **targets;
+	long downlim, uplim, index;
+	int match;
 	
 	if(src->n == 0) {
 		return -1;
 	}
 	
 	/* init */
-	targets = src->targets;
-	
 	downlim = 0;
 	uplim = src->n - 1;
 	while(downlim <= uplim) {
 		index = (downlim + uplim) >> 1;
-		match = entrycmp(entry, targets[index]);
+		match = entrycmp(entry, target_entry(src, index));
 		if(match < 0) { /* lower */
 			uplim = index - 1;
 		} else if(0 < match) { /* upper */
@@ -128,54 +171,407 @@ int target_grep(Target *src, char *entry) {
 	return -1;
 }
 
+long target_triegrep(Target *src, char *entry) {
+	return trie_grep(src->trie, entry);
+}
+
+long target_packgrep(Target *src, char *entry) {
+	
+	long index;
+	
+	/* ids that did not pack are kept in the sorted list */
+	if(0 <= (index = idpack_grep(src->pack, entry))) {
+		return index;
+	} else if(index == -1 && !src->n) {
+		return -1;
+	}
+	index = src->eyfp ? target_eygrep(src, entry) : target_bgrep(src, entry);
+	return 0 <= index ? src->pack->n + src->pack->un + index : -1;
+}
+
+static long target_extra(Target *src, char *entry) {
+	
+	/* range and pattern hits are past the listed targets */
+	if(src->ranges && 0 <= ranges_grep(src->ranges, entry)) {
+		return src->n;
+	} else if(src->dfa && dfa_match(src->dfa, entry)) {
+		return src->n;
+	}
+	
+	return -1;
+}
+
+static void target_fingerprint(char *entry, long long unsigned *fp) {
+	
+	int i, j;
+	
+	/* 16 bytes in entrycmp order, the token end sorts as a terminator */
+	for(i = 0; i < 2; ++i) {
+		fp[i] = 0;
+		for(j = 0; j < 8; ++j) {
+			if(*entry && !isspace(*entry)) {
+				fp[i] = (fp[i] << 8) | radixkey(*entry++);
+			} else {
+				fp[i] = (fp[i] << 8) | radixkey(0);
+			}
+		}
+	}
+}
+
+static int target_tokencmp(char *src1, char *src2) {
+	
+	/* entrycmp order, with src1 ending at whitespace */
+	while(*src1 == *src2 && *src2) {
+		++src1;
+		++src2;
+	}
+	
+	return radixkey(isspace(*src1) ? 0 : *src1) - radixkey(*src2);
+}
+
+static inline long target_eystep(Target *src, long k, long long unsigned *fp, char *entry) {
+	
+	long long unsigned *node;
+	
+	/* fetch the nodes three levels down, two cache lines */
+	node = src->eyfp + (k << 1);
+	__builtin_prefetch(src->eyfp + (k << 4));
+	__builtin_prefetch(src->eyfp + (k << 4) + 8);
+	if(node[0] != fp[0] || node[1] != fp[1]) {
+		return (k << 1) + (node[0] < fp[0] || (node[0] == fp[0] && node[1] < fp[1]));
+	}
+	
+	return (k << 1) + (0 < target_tokencmp(entry + src->lcp, target_entry(src, src->eyrank[k]) + src->lcp));
+}
+
+static inline long target_eyhit(Target *src, long k, char *entry) {
+	
+	long index;
+	
+	/* lower bound is the last left turn */
+	if(!(k >>= __builtin_ffsl(~k))) {
+		return -1;
+	}
+	index = src->eyrank[k];
+	
+	return entrycmp(entry, target_entry(src, index)) == 0 ? index : -1;
+}
+
+long target_eygrep(Target *src, char *entry) {
+	
+	long k;
+	long long unsigned fp[2];
+	
+	if(strncmp(entry, target_entry(src, 0), src->lcp) != 0) {
+		return -1;
+	}
+	target_fingerprint(entry + src->lcp, fp);
+	k = 1;
+	while(k <= src->n) {
+		k = target_eystep(src, k, fp, entry);
+	}
+	
+	return target_eyhit(src, k, entry);
+}
+
+static void target_eybatch(Target *src, char **entries, long *hits, long n) {
+	
+	int j, m, depth;
+	long k[TARGET_BATCH];
+	long long unsigned fp[2 * TARGET_BATCH];
+	char *lcp;
+	
+	/* run searches side by side, so their cache misses overlap */
+	lcp = target_entry(src, 0);
+	while(n) {
+		m = n < TARGET_BATCH ? n : TARGET_BATCH;
+		for(j = 0; j < m; ++j) {
+			if(strncmp(entries[j], lcp, src->lcp) == 0) {
+				target_fingerprint(entries[j] + src->lcp, fp + 2 * j);
+				k[j] = 1;
+			} else {
+				k[j] = 0;
+			}
+		}
+		for(depth = src->eydepth; depth; --depth) {
+			for(j = 0; j < m; ++j) {
+				if(k[j] && k[j] <= src->n) {
+					k[j] = target_eystep(src, k[j], fp + 2 * j, entries[j]);
+				}
+			}
+		}
+		for(j = 0; j < m; ++j) {
+			hits[j] = k[j] ? target_eyhit(src, k[j], entries[j]) : -1;
+		}
+		entries += m;
+		hits += m;
+		n -= m;
+	}
+}
+
+void target_grep_batch(Target *src, char **entries, long *hits, long n) {
+	
+	long i;
+	
+	if(src->grep == &target_eygrep) {
+		target_eybatch(src, entries, hits, n);
+	} else {
+		for(i = 0; i < n; ++i) {
+			hits[i] = src->grep(src, entries[i]);
+		}
+	}
+	
+	/* ranges and patterns catch what the list missed */
+	if(src->ranges || src->dfa) {
+		for(i = 0; i < n; ++i) {
+			if(hits[i] < 0) {
+				hits[i] = target_extra(src, entries[i]);
+			}
+		}
+	}
+}
+
+static long target_eyfill(Target *src, long i, long k) {
+	
+	/* in order traversal of the implicit tree */
+	if(k <= src->n) {
+		i = target_eyfill(src, i, k << 1);
+		src->eyrank[k] = i;
+		target_fingerprint(target_entry(src, i) + src->lcp, src->eyfp + (k << 1));
+		i = target_eyfill(src, i + 1, (k << 1) + 1);
+	}
+	
+	return i;
+}
+
+static int target_eytzinger(Target *src) {
+	
+	long i;
+	char *entry, *last;
+	long long unsigned fp[2], prev[2];
+	
+	if(!src->n || UINT_MAX <= src->n) {
+		return 1;
+	}
+	
+	/* common prefix of first and last covers all sorted entries */
+	entry = target_entry(src, 0);
+	last = target_entry(src, src->n - 1);
+	src->lcp = 0;
+	while(entry[src->lcp] && entry[src->lcp] == last[src->lcp]) {
+		++src->lcp;
+	}
+	
+	/* fingerprints must follow the sorted order, with whitespace free targets */
+	prev[0] = 0;
+	prev[1] = 0;
+	for(i = 0; i < src->n; ++i) {
+		entry = target_entry(src, i);
+		while(*entry) {
+			if(isspace(*entry++)) {
+				return 1;
+			}
+		}
+		target_fingerprint(target_entry(src, i) + src->lcp, fp);
+		if(fp[0] < prev[0] || (fp[0] == prev[0] && fp[1] < prev[1])) {
+			return 1;
+		}
+		prev[0] = fp[0];
+		prev[1] = fp[1];
+	}
+	
+	/* breadth first layout, one indexed with nodes paired in cache lines */
+	if(posix_memalign((void **)(&src->eyfp), 64, ((src->n + 1) << 1) * sizeof(long long unsigned))) {
+		src->eyfp = 0;
+		return 1;
+	} else if(!(src->eyrank = malloc((src->n + 1) * sizeof(unsigned)))) {
+		free(src->eyfp);
+		src->eyfp = 0;
+		return 1;
+	}
+	target_eyfill(src, 0, 1);
+	for(src->eydepth = 0, i = src->n; i; i >>= 1) {
+		++src->eydepth;
+	}
+	src->grep = &target_eygrep;
+	
+	return 0;
+}
+
+long target_grep(Target *src, char *entry) {
+	
+	long index;
+	
+	if((index = src->grep(src, entry)) < 0) {
+		return target_extra(src, entry);
+	}
+	
+	return index;
+}
+
+static void target_free(Target *src) {
+	
+	free(src->arena);
+	free(src->off32);
+	free(src->off64);
+	free(src->eyfp);
+	free(src->eyrank);
+	src->n = 0;
+	src->eydepth = 0;
+	src->eyfp = 0;
+	src->eyrank = 0;
+	src->arena = 0;
+	src->off32 = 0;
+	src->off64 = 0;
+	src->len = 0;
+	src->arenaSize = 0;
+	src->size = 0;
+}
+
+static void target_keep(Target *src, char *keep) {
+	
+	long i, n, len, entrylen;
+	char *arena, *entry;
+	unsigned *off32;
+	
+	/* move kept entries to a fresh arena, order is preserved */
+	for(i = 0, n = 0, len = 0; i < src->n; ++i) {
+		if(keep[i]) {
+			len += strlen(target_entry(src, i)) + 1;
+			++n;
+		}
+	}
+	if(!n) {
+		target_free(src);
+		return;
+	} else if(UINT_MAX < len) {
+		/* leave large leftovers in place */
+		for(i = 0, n = 0; i < src->n; ++i) {
+			if(keep[i]) {
+				src->off64[n++] = src->off64[i];
+			}
+		}
+		src->n = n;
+		return;
+	}
+	arena = malloc(len);
+	off32 = malloc(n * sizeof(unsigned));
+	if(!arena || !off32) {
+		/* keep them all then */
+		free(arena);
+		free(off32);
+		return;
+	}
+	for(i = 0, n = 0, len = 0; i < src->n; ++i) {
+		if(keep[i]) {
+			entry = target_entry(src, i);
+			entrylen = strlen(entry) + 1;
+			memcpy(arena + len, entry, entrylen);
+			off32[n++] = len;
+			len += entrylen;
+		}
+	}
+	target_free(src);
+	src->n = n;
+	src->size = n;
+	src->len = len;
+	src->arenaSize = len;
+	src->arena = arena;
+	src->off32 = off32;
+}
+
+int target_engine(Target *src, int engine) {
+	
+	long i;
+	char *parsed;
+	
+	if(engine == TARGET_TRIE && !src->trie) {
+		/* shared prefixes are stored once, so the list can go */
+		if(!(src->trie = trie_build(src->arena, src->off32, src->off64, src->n))) {
+			fprintf(stderr, "Targets exceed the trie, keeping the sorted list.\n");
+			target_eytzinger(src);
+			return 1;
+		}
+		target_free(src);
+		src->grep = &target_triegrep;
+	} else if((engine == TARGET_PACKED || engine == TARGET_AUTO) && !src->pack && !src->trie && src->n) {
+		/* auto only packs when every target does */
+		parsed = engine == TARGET_PACKED ? malloc(src->n) : 0;
+		if((engine == TARGET_PACKED && !parsed) || !(src->pack = idpack_build(src->arena, src->off32, src->off64, src->n, parsed))) {
+			free(parsed);
+			target_eytzinger(src);
+			return 0;
+		}
+		if(parsed) {
+			for(i = 0; i < src->n; ++i) {
+				parsed[i] = !parsed[i];
+			}
+			target_keep(src, parsed);
+			target_eytzinger(src);
+			free(parsed);
+		} else {
+			target_free(src);
+		}
+		src->grep = &target_packgrep;
+	} else if(engine == TARGET_SORTED && !src->eyfp) {
+		target_eytzinger(src);
+	}
+	
+	return 0;
+}
+
 int target_duppush(Target *dest, Qseqs *target_entry) {
 	
 	int match;
 	char *entry;
 	
-	/* cpy entry */
-	entry = smalloc(target_entry->len + 1);
-	memcpy(entry, target_entry->seq, target_entry->len + 1);
-	
 	/* realloc */
 	if(dest->n == dest->size) {
 		dest = target_realloc(dest, dest->size << 1);
 	}
 	
+	/* cpy entry */
+	if((errno = target_arenaGrow(dest, target_entry->len + 1))) {
+		ERROR();
+	}
+	entry = dest->arena + dest->len;
+	memcpy(entry, target_entry->seq, target_entry->len + 1);
+	
 	/* check if entry is already added */
-	match = dest->n ? entrycmp(dest->targets[dest->n - 1], entry) : -1;
+	match = dest->n ? entrycmp(target_entry(dest, dest->n - 1), entry) : -1;
 	if(match) {
 		/* add entry */
-		dest->targets[dest->n++] = entry;
-	} else {
-		free(entry);
+		if(dest->off32) {
+			dest->off32[dest->n++] = dest->len;
+		} else {
+			dest->off64[dest->n++] = dest->len;
+		}
+		dest->len += target_entry->len + 1;
 	}
 	
 	return 0 < match;
 }
 
-int target_dedup(Target *src) {
+long target_dedup(Target *src) {
 	
-	int n;
-	char **org, **dest;
+	long i, n;
 	
 	if(!src->n) {
 		return 0;
 	}
 	
 	/* parse targets */
-	org = src->targets;
-	dest = src->targets;
-	n = src->n;
-	while(--n) {
-		if(entrycmp(*dest, *++org)) { /* adjust array */
-			*++dest = *org;
-		} else { /* duplcate */
-			/* remove duplicate */
-			src->n--;
-			free(*org);
+	n = 0;
+	for(i = 1; i < src->n; ++i) {
+		if(entrycmp(target_entry(src, n), target_entry(src, i))) { /* adjust array */
+			if(src->off32) {
+				src->off32[++n] = src->off32[i];
+			} else {
+				src->off64[++n] = src->off64[i];
+			}
 		}
 	}
+	src->n = n + 1;
 	
 	return src->n;
 }
@@ -231,42 +627,667 @@ int getTarget(FileBuff *src, Qseqs *entry) {
 	return 1;
 }
 
-static int stringcmp(const void *str1, const void *str2) {
-	return entrycmp(*(char **)(str1), *(char **)(str2));
+typedef struct targetThrd TargetThrd;
+struct targetThrd {
+	int id;
+	int thread_num;
+	int err;
+	long n;
+	long size;
+	long unsigned *offsets;
+	long *counts;
+	Target *dest;
+	long unsigned *aux;
+	volatile long *next;
+	pthread_t thrd;
+};
+
+#define TARGET_DUP ULONG_MAX
+
+static void target_threads(TargetThrd *thrds, int thread_num, void * (*func)(void *)) {
+	
+	int i, started;
+	
+	/* run func on all threads, the calling thread does the first share and those of threads that failed to start */
+	for(started = 1; started < thread_num && !pthread_create(&thrds[started].thrd, NULL, func, thrds + started); ++started);
+	func(thrds);
+	for(i = started; i < thread_num; ++i) {
+		func(thrds + i);
+	}
+	for(i = 1; i < started; ++i) {
+		pthread_join(thrds[i].thrd, NULL);
+	}
 }
 
-Target * getTargets(char *targetfilename) {
+static int target_addoffset(TargetThrd *src, long unsigned offset) {
 	
-	int sorted;
-	FileBuff *inputfile;
-	Qseqs *entry;
-	Target *dest;
+	long unsigned *offsets;
 	
-	/* init */
-	dest = target_malloc(1024);
-	inputfile = setFileBuff(1048576);
-	entry = setQseqs(256);
+	if(src->n == src->size) {
+		if(!(offsets = realloc(src->offsets, (src->size ? src->size << 1 : 1024) * sizeof(long unsigned)))) {
+			return (src->err = ENOMEM);
+		}
+		src->offsets = offsets;
+		src->size = src->size ? src->size << 1 : 1024;
+	}
+	src->offsets[src->n++] = offset;
+	
+	return 0;
+}
+
+static void * target_splitThrd(void *arg) {
+	
+	long i, end;
+	char *arena;
+	TargetThrd *src;
+#ifdef __SSE2__
+	unsigned mask;
+	__m128i nl;
+#endif
+	
+	/* terminate lines in this share, and note where the next ones start */
+	src = arg;
+	arena = src->dest->arena;
+	i = src->dest->len / src->thread_num * src->id;
+	end = src->id == src->thread_num - 1 ? src->dest->len : src->dest->len / src->thread_num * (src->id + 1);
+#ifdef __SSE2__
+	nl = _mm_set1_epi8('\n');
+	while(i + 16 <= end) {
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(arena + i)), nl));
+		while(mask) {
+			arena[i + __builtin_ctz(mask)] = 0;
+			if(target_addoffset(src, i + __builtin_ctz(mask) + 1)) {
+				return NULL;
+			}
+			mask &= mask - 1;
+		}
+		i += 16;
+	}
+#endif
+	while(i < end) {
+		if(arena[i] == '\n') {
+			arena[i] = 0;
+			if(target_addoffset(src, i + 1)) {
+				return NULL;
+			}
+		}
+		++i;
+	}
+	
+	return NULL;
+}
+
+static void * target_chompThrd(void *arg) {
+	
+	long i, end, last;
+	char *arena, *seq;
+	long unsigned *offsets;
+	TargetThrd *src;
+	
+	/* chomp the lines of this share, and mark empty ones */
+	src = arg;
+	arena = src->dest->arena;
+	offsets = src->dest->off64;
+	last = src->dest->n - 1;
+	i = src->dest->n / src->thread_num * src->id;
+	end = src->id == src->thread_num - 1 ? src->dest->n : src->dest->n / src->thread_num * (src->id + 1);
+	while(i < end) {
+		seq = i == last ? arena + src->dest->len : arena + offsets[i] + strlen(arena + offsets[i]);
+		while(arena + offsets[i] < seq && isspace(*--seq)) {
+			*seq = 0;
+		}
+		if(!arena[offsets[i]]) {
+			offsets[i] = TARGET_DUP;
+		}
+		++i;
+	}
+	
+	return NULL;
+}
+
+static void * target_sortedThrd(void *arg) {
+	
+	long i, end;
+	int match;
+	TargetThrd *src;
+	
+	/* count unsorted neighbours and duplicates */
+	src = arg;
+	i = src->dest->n / src->thread_num * src->id;
+	end = src->id == src->thread_num - 1 ? src->dest->n : src->dest->n / src->thread_num * (src->id + 1);
+	src->n = 0;
+	src->size = 0;
+	i = i ? i : 1;
+	while(i < end) {
+		match = entrycmp(target_entry(src->dest, i - 1), target_entry(src->dest, i));
+		if(0 < match) {
+			++src->n;
+		} else if(!match) {
+			++src->size;
+		}
+		++i;
+	}
+	
+	return NULL;
+}
+
+static int target_keycmp(char *arena, long unsigned off1, long unsigned off2, long depth) {
+	
+	unsigned char *src1, *src2;
+	
+	src1 = (unsigned char *)(arena + off1 + depth);
+	src2 = (unsigned char *)(arena + off2 + depth);
+	while(*src1 && *src1 == *src2) {
+		++src1;
+		++src2;
+	}
+	
+	return radixkey(*src1) - radixkey(*src2);
+}
+
+static void target_msd(char *arena, long unsigned *a, long unsigned *tmp, long n, long depth) {
+	
+	int c;
+	long i, j, count[257];
+	long unsigned key;
+	
+	while(32 <= n) {
+		/* count key bytes */
+		memset(count, 0, sizeof(count));
+		for(i = 0; i < n; ++i) {
+			++count[radixkey(arena[a[i] + depth]) + 1];
+		}
+		
+		/* common prefix, descend without moving anything */
+		c = radixkey(arena[*a + depth]);
+		if(count[c + 1] == n) {
+			if(c == radixkey(0)) {
+				/* identical entries */
+				for(i = 1; i < n; ++i) {
+					a[i] = TARGET_DUP;
+				}
+				return;
+			}
+			++depth;
+			continue;
+		}
+		
+		/* distribute */
+		for(c = 1; c < 257; ++c) {
+			count[c] += count[c - 1];
+		}
+		for(i = 0; i < n; ++i) {
+			tmp[count[radixkey(arena[a[i] + depth])]++] = a[i];
+		}
+		memcpy(a, tmp, n * sizeof(long unsigned));
+		
+		/* sort buckets */
+		for(c = 0, i = 0; c < 256; ++c) {
+			if(1 < count[c] - i) {
+				if(c == radixkey(0)) {
+					for(j = i + 1; j < count[c]; ++j) {
+						a[j] = TARGET_DUP;
+					}
+				} else {
+					target_msd(arena, a + i, tmp + i, count[c] - i, depth + 1);
+				}
+			}
+			i = count[c];
+		}
+		return;
+	}
+	
+	/* insertion sort small buckets */
+	for(i = 1; i < n; ++i) {
+		key = a[i];
+		for(j = i; 0 < j && 0 < target_keycmp(arena, a[j - 1], key, depth); --j) {
+			a[j] = a[j - 1];
+		}
+		a[j] = key;
+	}
+	for(i = n - 1; 0 < i; --i) {
+		if(!target_keycmp(arena, a[i - 1], a[i], depth)) {
+			a[i] = TARGET_DUP;
+		}
+	}
+}
+
+static void * target_countThrd(void *arg) {
 	
-	/* open target file */
-	openAndDetermine(inputfile, targetfilename);
+	long i, end;
+	char *arena;
+	long unsigned *offsets;
+	TargetThrd *src;
 	
-	/* parse target file */
-	sorted = 0;
-	while(getTarget(inputfile, entry)) {
-		sorted |= target_duppush(dest, entry);
+	/* histogram of first key byte */
+	src = arg;
+	arena = src->dest->arena;
+	offsets = src->dest->off64;
+	memset(src->counts, 0, 256 * sizeof(long));
+	i = src->dest->n / src->thread_num * src->id;
+	end = src->id == src->thread_num - 1 ? src->dest->n : src->dest->n / src->thread_num * (src->id + 1);
+	while(i < end) {
+		++src->counts[radixkey(arena[offsets[i]])];
+		++i;
 	}
 	
-	/* sort list */
-	if(sorted) {
-		qsort(dest->targets, dest->n, sizeof(char *), stringcmp);
+	return NULL;
+}
+
+static void * target_scatterThrd(void *arg) {
+	
+	long i, end;
+	char *arena;
+	long unsigned *offsets, *aux;
+	TargetThrd *src;
+	
+	/* move entries to their first byte buckets, counts hold positions */
+	src = arg;
+	arena = src->dest->arena;
+	offsets = src->dest->off64;
+	aux = src->aux;
+	i = src->dest->n / src->thread_num * src->id;
+	end = src->id == src->thread_num - 1 ? src->dest->n : src->dest->n / src->thread_num * (src->id + 1);
+	while(i < end) {
+		aux[src->counts[radixkey(arena[offsets[i]])]++] = offsets[i];
+		++i;
+	}
+	
+	return NULL;
+}
+
+static void * target_bucketThrd(void *arg) {
+	
+	long c, start, end;
+	TargetThrd *src;
+	
+	/* sort first byte buckets as they become available */
+	src = arg;
+	while((c = __sync_fetch_and_add(src->next, 1)) < 256) {
+		start = c ? src->counts[c - 1] : 0;
+		end = src->counts[c];
+		if(1 < end - start) {
+			if(c == radixkey(0)) {
+				while(++start < end) {
+					src->aux[start] = TARGET_DUP;
+				}
+			} else {
+				target_msd(src->dest->arena, src->aux + start, src->dest->off64 + start, end - start, 1);
+			}
+		}
+	}
+	
+	return NULL;
+}
+
+static int target_radixsort(Target *dest, TargetThrd *thrds, int thread_num) {
+	
+	int i, c;
+	long sum, *counts;
+	long unsigned *aux;
+	volatile long next;
+	
+	/* histogram first byte */
+	aux = malloc((dest->n ? dest->n : 1) * sizeof(long unsigned));
+	counts = malloc(256 * (thread_num + 1) * sizeof(long));
+	if(!aux || !counts) {
+		free(aux);
+		free(counts);
+		return ENOMEM;
+	}
+	for(i = 0; i < thread_num; ++i) {
+		thrds[i].counts = counts + 256 * i;
+		thrds[i].aux = aux;
+	}
+	target_threads(thrds, thread_num, &target_countThrd);
+	
+	/* positions of each thread in each bucket */
+	sum = 0;
+	for(c = 0; c < 256; ++c) {
+		for(i = 0; i < thread_num; ++i) {
+			sum += thrds[i].counts[c];
+			thrds[i].counts[c] = sum - thrds[i].counts[c];
+		}
+	}
+	target_threads(thrds, thread_num, &target_scatterThrd);
+	
+	/* bucket ends, as left by the last thread */
+	counts += 256 * thread_num;
+	memcpy(counts, thrds[thread_num - 1].counts, 256 * sizeof(long));
+	next = 0;
+	for(i = 0; i < thread_num; ++i) {
+		thrds[i].counts = counts;
+		thrds[i].next = &next;
+	}
+	target_threads(thrds, thread_num, &target_bucketThrd);
+	
+	/* sorted entries are in aux */
+	free(dest->off64);
+	dest->off64 = aux;
+	free(counts - 256 * thread_num);
+	
+	return 0;
+}
+
+static void target_compact(Target *dest) {
+	
+	long i, n;
+	long unsigned *offsets;
+	
+	offsets = dest->off64;
+	for(i = 0, n = 0; i < dest->n; ++i) {
+		if(offsets[i] != TARGET_DUP) {
+			offsets[n++] = offsets[i];
+		}
+	}
+	dest->n = n;
+}
+
+static long target_lowerbound(Target *dest, char *bound) {
+	
+	long downlim, uplim, index;
+	
+	/* first entry not below bound */
+	downlim = 0;
+	uplim = dest->n;
+	while(downlim < uplim) {
+		index = (downlim + uplim) >> 1;
+		if(rangecmp(dest->arena + dest->off64[index], bound) < 0) {
+			downlim = index + 1;
+		} else {
+			uplim = index;
+		}
+	}
+	
+	return downlim;
+}
+
+static int target_ranges(Target *dest) {
+	
+	int kind;
+	long i, start, end, downlim, uplim, index;
+	Ranges *ranges;
+	
+	/* move range lines out of the list */
+	if(!(ranges = ranges_init(16))) {
+		return ENOMEM;
+	}
+	for(i = 0; i < dest->n; ++i) {
+		if((kind = ranges_add(ranges, dest->arena + dest->off64[i])) < 0) {
+			ranges_destroy(ranges);
+			return ENOMEM;
+		} else if(kind) {
+			dest->off64[i] = TARGET_DUP;
+		}
+	}
+	if(!ranges->n) {
+		ranges_destroy(ranges);
+		return 0;
+	}
+	target_compact(dest);
+	if(ranges_merge(ranges)) {
+		ranges_destroy(ranges);
+		return ENOMEM;
+	}
+	
+	/* drop ids covered by a range, two binary searches each */
+	for(i = 0; i < ranges->n; ++i) {
+		start = target_lowerbound(dest, ranges->arena + ranges->lo[i]);
+		downlim = start;
+		uplim = dest->n;
+		while(downlim < uplim) {
+			index = (downlim + uplim) >> 1;
+			if(ranges_below(ranges, i, dest->arena + dest->off64[index])) {
+				downlim = index + 1;
+			} else {
+				uplim = index;
+			}
+		}
+		for(end = downlim; start < end; ++start) {
+			if(ranges_grep(ranges, dest->arena + dest->off64[start]) == i) {
+				dest->off64[start] = TARGET_DUP;
+			}
+		}
+	}
+	target_compact(dest);
+	dest->ranges = ranges;
+	
+	return 0;
+}
+
+int target_index(Target *dest, int thread_num) {
+	
+	int i, err;
+	long n, unsorted, dups;
+	unsigned *off32;
+	long unsigned *off64;
+	char *arena;
+	TargetThrd *thrds;
+	
+	/* arena holds raw newline separated targets */
+	if(thread_num < 1) {
+		thread_num = 1;
+	}
+	if((err = target_arenaGrow(dest, 1))) {
+		return err;
+	} else if(!(thrds = malloc(thread_num * sizeof(TargetThrd)))) {
+		return ENOMEM;
+	}
+	dest->arena[dest->len] = 0;
+	for(i = 0; i < thread_num; ++i) {
+		thrds[i].id = i;
+		thrds[i].thread_num = thread_num;
+		thrds[i].err = 0;
+		thrds[i].n = 0;
+		thrds[i].size = 0;
+		thrds[i].offsets = 0;
+		thrds[i].dest = dest;
+	}
+	
+	/* split lines */
+	target_threads(thrds, thread_num, &target_splitThrd);
+	n = dest->len ? 1 : 0;
+	for(i = 0; i < thread_num; ++i) {
+		n += thrds[i].n;
+		err = err ? err : thrds[i].err;
+	}
+	free(dest->off32);
+	free(dest->off64);
+	dest->off32 = 0;
+	if(err || !(dest->off64 = malloc((n ? n : 1) * sizeof(long unsigned)))) {
+		for(i = 0; i < thread_num; ++i) {
+			free(thrds[i].offsets);
+		}
+		free(thrds);
+		dest->off64 = 0;
+		dest->n = 0;
+		return ENOMEM;
+	}
+	dest->n = 0;
+	if(dest->len) {
+		dest->off64[dest->n++] = 0;
+	}
+	for(i = 0; i < thread_num; ++i) {
+		memcpy(dest->off64 + dest->n, thrds[i].offsets, thrds[i].n * sizeof(long unsigned));
+		dest->n += thrds[i].n;
+		free(thrds[i].offsets);
+		thrds[i].offsets = 0;
+	}
+	/* a trailing newline does not start a target */
+	if(dest->n && dest->off64[dest->n - 1] == dest->len) {
+		--dest->n;
+	}
+	
+	/* chomp and remove empty lines */
+	target_threads(thrds, thread_num, &target_chompThrd);
+	target_compact(dest);
+	
+	/* sort and dedup unless sorted already */
+	target_threads(thrds, thread_num, &target_sortedThrd);
+	unsorted = 0;
+	dups = 0;
+	for(i = 0; i < thread_num; ++i) {
+		unsorted += thrds[i].n;
+		dups += thrds[i].size;
+	}
+	if(unsorted) {
+		err = target_radixsort(dest, thrds, thread_num);
+		target_compact(dest);
+	} else if(dups) {
 		target_dedup(dest);
 	}
+	free(thrds);
+	if(err || (err = target_ranges(dest))) {
+		return err;
+	}
+	
+	/* release parse space, keeping the larger parts if that fails */
+	dest->size = dest->n;
+	if(dest->len < UINT_MAX && (off32 = malloc((dest->n ? dest->n : 1) * sizeof(unsigned)))) {
+		for(n = 0; n < dest->n; ++n) {
+			off32[n] = dest->off64[n];
+		}
+		free(dest->off64);
+		dest->off64 = 0;
+		dest->off32 = off32;
+	} else if((off64 = realloc(dest->off64, (dest->n ? dest->n : 1) * sizeof(long unsigned)))) {
+		dest->off64 = off64;
+	}
+	if((arena = realloc(dest->arena, dest->len + 1))) {
+		dest->arena = arena;
+		dest->arenaSize = dest->len + 1;
+	}
+	
+	return 0;
+}
+
+static void target_names(Target *dest, FileBuff *inputfile, unsigned FASTQ) {
+	
+	int i;
+	long len;
+	char *name;
+	Qseqs *header;
+	QBatch *batch;
+	QBatchPool *pool;
+	FqBatchReader *reader;
+	
+	/* read names up to the first whitespace, from the header only parsers */
+	if(FASTQ & 8) {
+		header = setQseqs(256);
+		FileBuffgetBamHeader(inputfile, header);
+		destroyQseqs(header);
+	}
+	pool = qbatchpool_init(6, QBATCHSIZE);
+	reader = fqBatchReader_start(inputfile, pool, 4, (FASTQ & 8) ? &FileBuffgetBamRaw : (FASTQ & 1) ? &FileBuffgetFqHeaders : &FileBuffgetFsaHeaders);
+	while((batch = fqBatchReader_get(reader))) {
+		for(i = 0; i < batch->n; ++i) {
+			name = qbatch_header(batch, i);
+			len = 0;
+			while(name[len] && !isspace(name[len])) {
+				++len;
+			}
+			if((errno = target_arenaGrow(dest, len + 1))) {
+				ERROR();
+			}
+			memcpy(dest->arena + dest->len, name, len);
+			dest->len += len;
+			dest->arena[dest->len++] = '\n';
+		}
+		qbatchpool_put(pool, batch);
+	}
+	fqBatchReader_stop(reader);
+	qbatchpool_destroy(pool);
+}
+
+static void target_samNames(Target *dest, FileBuff *inputfile) {
+	
+	int state;
+	unsigned char *buff, *end, *stop;
+	
+	/* first field of alignment lines, state is 0 at line start, 1 in a name and 2 past it */
+	state = 0;
+	do {
+		if((errno = target_arenaGrow(dest, inputfile->bytes + 1))) {
+			ERROR();
+		}
+		buff = inputfile->buffer;
+		end = buff + inputfile->bytes;
+		while(buff < end) {
+			if(state == 2) {
+				if(!(buff = memchr(buff, '\n', end - buff))) {
+					break;
+				}
+				++buff;
+				state = 0;
+			} else if(state == 0 && (*buff == '@' || *buff == '\n')) {
+				state = *buff++ == '@' ? 2 : 0;
+			} else {
+				for(stop = buff; stop < end && *stop != '\t' && *stop != '\n'; ++stop);
+				memcpy(dest->arena + dest->len, buff, stop - buff);
+				dest->len += stop - buff;
+				if(stop == end) {
+					state = 1;
+				} else {
+					dest->arena[dest->len++] = '\n';
+					state = *stop == '\n' ? 0 : 2;
+					++stop;
+				}
+				buff = stop;
+			}
+		}
+	} while(inputfile->buffFileBuff(inputfile));
+	if(state == 1) {
+		if((errno = target_arenaGrow(dest, 1))) {
+			ERROR();
+		}
+		dest->arena[dest->len++] = '\n';
+	}
+}
+
+Target * getTargets(char *targetfilename, int thread_num) {
+	
+	unsigned FASTQ;
+	struct stat st;
+	FileBuff *inputfile;
+	Target *dest;
+	
+	/* init */
+	if(!(dest = target_malloc(1))) {
+		ERROR();
+	}
+	inputfile = setFileBuff(CHUNK);
+	inputfile->thread_num = thread_num;
+	
+	/* open target file, lists are read as they are */
+	FASTQ = openAndDetermineTargets(inputfile, targetfilename);
+	if(FASTQ & 16) {
+		target_samNames(dest, inputfile);
+	} else if(FASTQ & 11) {
+		target_names(dest, inputfile, FASTQ);
+	} else {
+		if(fstat(fileno(inputfile->file), &st) == 0 && S_ISREG(st.st_mode)) {
+			if((errno = target_arenaGrow(dest, st.st_size + 1))) {
+				ERROR();
+			}
+		}
+		
+		/* read target file into arena */
+		do {
+			if((errno = target_arenaGrow(dest, inputfile->bytes + 1))) {
+				ERROR();
+			}
+			memcpy(dest->arena + dest->len, inputfile->buffer, inputfile->bytes);
+			dest->len += inputfile->bytes;
+		} while(inputfile->buffFileBuff(inputfile));
+	}
 	
 	/* clean up */
 	closeFileBuff(inputfile);
 	destroyFileBuff(inputfile);
-	destroyQseqs(entry);
-	dest = target_realloc(dest, dest->n);
+	
+	if((errno = target_index(dest, thread_num))) {
+		ERROR();
+	}
 	
 	return dest;
 }
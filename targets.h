@@ -16,23 +16,55 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
+#include "filebuff.h"
 #include "qseqs.h"
+#include "dfa.h"
+#include "idpack.h"
+#include "ranges.h"
+#include "trie.h"
 
 #ifndef TARGETS
 typedef struct target Target;
 struct target {
-	int n;
-	int size;
-	char **targets;
+	long n;
+	long size;
+	long len;
+	long arenaSize;
+	char *arena; /* targets stored back to back */
+	unsigned *off32; /* offsets into arena, while it fits 32 bits */
+	long unsigned *off64;
+	Trie *trie;
+	IdPack *pack;
+	Dfa *dfa; /* header patterns */
+	Ranges *ranges; /* prefix* and lo..hi lines */
+	long lcp; /* prefix shared by all sorted entries */
+	int eydepth;
+	long long unsigned *eyfp; /* eytzinger ordered fingerprints */
+	unsigned *eyrank; /* sorted index of eytzinger nodes */
+	long (*grep)(Target *, char *);
 };
 #define TARGETS 1
+#define TARGET_AUTO 0
+#define TARGET_SORTED 1
+#define TARGET_TRIE 2
+#define TARGET_PACKED 3
+#define TARGET_BATCH 32
+#define target_entry(src, i) ((src)->arena + ((src)->off32 ? (src)->off32[i] : (src)->off64[i]))
 #endif
 
 Target * target_malloc(long unsigned size);
 Target * target_realloc(Target *src, long unsigned size);
+void target_destroy(Target *src);
 int entrycmp(char *src1, char *src2);
-int target_grep(Target *src, char *entry);
+long target_bgrep(Target *src, char *entry);
+long target_triegrep(Target *src, char *entry);
+long target_packgrep(Target *src, char *entry);
+long target_eygrep(Target *src, char *entry);
+long target_grep(Target *src, char *entry);
+void target_grep_batch(Target *src, char **entries, long *hits, long n);
+int target_engine(Target *src, int engine);
 int target_duppush(Target *dest, Qseqs *target_entry);
-int target_dedup(Target *src);
+long target_dedup(Target *src);
 int getTarget(FileBuff *src, Qseqs *entry);
-Target * getTargets(char *targetfilename);
+int target_index(Target *dest, int thread_num);
+Target * getTargets(char *targetfilename, int thread_num);
@@ -0,0 +1,34 @@
+#!/bin/sh
+# target file formats: ./test/targets.sh [fqgrep]
+FQGREP=${1:-./fqgrep}
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+fail=0
+
+expect() {
+	# expect name got wanted
+	if [ "$2" = "$3" ]; then
+		echo "ok:	$1"
+	else
+		echo "FAIL:	$1"
+		fail=1
+	fi
+}
+
+printf '@id1\nACGT\n+\nIIII\n@id2\nACGT\n+\nIIII\n@id3\nACGT\n+\nIIII\n' > "$DIR/reads.fq"
+
+# an id list whose first line starts with '>' stays a list
+printf '>id1\nid2\nid3\n' > "$DIR/list.txt"
+expect "list starting with '>'" "$("$FQGREP" -l -f "$DIR/list.txt" -i "$DIR/reads.fq" 2>/dev/null | tr '\n' ' ')" "id2 id3 "
+
+# fasta gives the names of its headers
+printf '>id1 comment\nACGT\nAC\n\n>id3\nACGT\n' > "$DIR/targets.fa"
+expect "fasta targets" "$("$FQGREP" -l -f "$DIR/targets.fa" -i "$DIR/reads.fq" 2>/dev/null | tr '\n' ' ')" "id1 id3 "
+
+# fastq gives its read names, an id list starting with '@' stays a list
+printf '@id2\nACGT\n+\nIIII\n' > "$DIR/targets.fq"
+expect "fastq targets" "$("$FQGREP" -l -f "$DIR/targets.fq" -i "$DIR/reads.fq" 2>/dev/null | tr '\n' ' ')" "id2 "
+printf '@id1\nid2\nid3\n' > "$DIR/list2.txt"
+expect "list starting with '@'" "$("$FQGREP" -l -f "$DIR/list2.txt" -i "$DIR/reads.fq" 2>/dev/null | tr '\n' ' ')" "id2 id3 "
+
+exit $fail
@@ -0,0 +1,271 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trie.h"
+
+#define trie_entry(i) (arena + (off32 ? off32[i] : off64[i]))
+#define radixkey(c) ((unsigned char)(c) ^ (CHAR_MIN < 0 ? 0x80 : 0))
+
+static unsigned trie_newnodes(Trie *dest, unsigned n) {
+	
+	unsigned node, size;
+	TrieNode *nodes;
+	
+	if(UINT_MAX - dest->n < n) {
+		return 0;
+	} else if(dest->size < dest->n + n) {
+		size = dest->size;
+		while(size < dest->n + n) {
+			size = size < UINT_MAX / 2 ? size << 1 : UINT_MAX;
+		}
+		if(!(nodes = realloc(dest->nodes, size * sizeof(TrieNode)))) {
+			return 0;
+		}
+		dest->nodes = nodes;
+		dest->size = size;
+	}
+	node = dest->n;
+	dest->n += n;
+	memset(dest->nodes + node, 0, n * sizeof(TrieNode));
+	
+	return node;
+}
+
+static int trie_label(Trie *dest, unsigned node, char *label, long len) {
+	
+	long size;
+	unsigned char *labels;
+	
+	if(UINT_MAX < dest->len + len) {
+		return 1;
+	} else if(dest->labelSize < dest->len + len) {
+		size = dest->labelSize;
+		while(size < dest->len + len) {
+			size <<= 1;
+		}
+		if(!(labels = realloc(dest->labels, size))) {
+			return 1;
+		}
+		dest->labels = labels;
+		dest->labelSize = size;
+	}
+	memcpy(dest->labels + dest->len, label, len);
+	dest->nodes[node].label = dest->len;
+	dest->nodes[node].len = len;
+	dest->len += len;
+	
+	return 0;
+}
+
+static int trie_node(Trie *dest, unsigned node, char *arena, unsigned *off32, long unsigned *off64, long lo, long hi, long depth) {
+	
+	long i, j, end;
+	unsigned child, nchild;
+	char *first, *last;
+	
+	/* label is the common prefix of the range */
+	first = trie_entry(lo);
+	last = trie_entry(hi - 1);
+	end = depth;
+	while(first[end] && first[end] == last[end]) {
+		++end;
+	}
+	
+	/* long labels are chained */
+	if(USHRT_MAX < end - depth) {
+		if(trie_label(dest, node, first + depth, USHRT_MAX) || !(child = trie_newnodes(dest, 1))) {
+			return 1;
+		}
+		dest->nodes[node].child = child;
+		dest->nodes[node].nchild = 0;
+		return trie_node(dest, child, arena, off32, off64, lo, hi, depth + USHRT_MAX);
+	} else if(trie_label(dest, node, first + depth, end - depth)) {
+		return 1;
+	}
+	
+	/* count branches */
+	nchild = 0;
+	for(i = lo; i < hi; i = j) {
+		j = i + 1;
+		while(j < hi && trie_entry(j)[end] == trie_entry(i)[end]) {
+			++j;
+		}
+		if(trie_entry(i)[end]) {
+			++nchild;
+		} else {
+			dest->nodes[node].term = 1;
+		}
+	}
+	if(!nchild) {
+		return 0;
+	} else if(!(child = trie_newnodes(dest, nchild))) {
+		return 1;
+	}
+	dest->nodes[node].child = child;
+	dest->nodes[node].nchild = nchild - 1;
+	
+	/* add branches */
+	for(i = lo; i < hi; i = j) {
+		j = i + 1;
+		while(j < hi && trie_entry(j)[end] == trie_entry(i)[end]) {
+			++j;
+		}
+		if(trie_entry(i)[end]) {
+			if(trie_node(dest, child++, arena, off32, off64, i, j, end)) {
+				return 1;
+			}
+		}
+	}
+	
+	return 0;
+}
+
+Trie * trie_build(char *arena, unsigned *off32, long unsigned *off64, long n) {
+	
+	unsigned char *labels;
+	Trie *dest;
+	TrieNode *nodes;
+	
+	if(!(dest = malloc(sizeof(Trie)))) {
+		return 0;
+	}
+	dest->n = 0;
+	dest->size = 1024;
+	dest->len = 0;
+	dest->labelSize = 1024;
+	dest->labels = malloc(dest->labelSize);
+	dest->nodes = malloc(dest->size * sizeof(TrieNode));
+	
+	if(!dest->labels || !dest->nodes) {
+		trie_destroy(dest);
+		return 0;
+	}
+	
+	/* root */
+	trie_newnodes(dest, 1);
+	if(n && trie_node(dest, 0, arena, off32, off64, 0, n, 0)) {
+		/* exceeds 32 bit addressing or memory */
+		trie_destroy(dest);
+		return 0;
+	}
+	
+	/* release unused space */
+	if((nodes = realloc(dest->nodes, dest->n * sizeof(TrieNode)))) {
+		dest->nodes = nodes;
+		dest->size = dest->n;
+	}
+	if((labels = realloc(dest->labels, dest->len ? dest->len : 1))) {
+		dest->labels = labels;
+		dest->labelSize = dest->len ? dest->len : 1;
+	}
+	
+	return dest;
+}
+
+static long trie_anyterm(Trie *src, unsigned node) {
+	
+	/* some target continues beyond the entry */
+	while(!src->nodes[node].term) {
+		node = src->nodes[node].child;
+	}
+	
+	return node;
+}
+
+static long trie_spaceterm(Trie *src, unsigned node) {
+	
+	unsigned child, end;
+	
+	/* entry ended, where a target continues with whitespace */
+	child = src->nodes[node].child;
+	end = child + trie_nchild(src->nodes + node);
+	while(child < end) {
+		if(isspace(src->labels[src->nodes[child].label])) {
+			return trie_anyterm(src, child);
+		}
+		++child;
+	}
+	
+	return -1;
+}
+
+long trie_grep(Trie *src, char *entry) {
+	
+	int c;
+	unsigned node, downlim, uplim, mid, last;
+	unsigned char *label, *end;
+	TrieNode *nodes;
+	
+	if(!src->n) {
+		return -1;
+	}
+	
+	nodes = src->nodes;
+	node = 0;
+	while(1) {
+		/* only the differing bytes are left to compare */
+		label = src->labels + nodes[node].label;
+		end = label + nodes[node].len;
+		while(label < end && *label == (unsigned char)(*entry)) {
+			++label;
+			++entry;
+		}
+		if(label != end) {
+			/* identifiers are equal up to whitespace */
+			return !*entry && isspace(*label) ? trie_anyterm(src, node) : -1;
+		} else if(nodes[node].term && (!*entry || isspace(*entry))) {
+			return node;
+		} else if(!nodes[node].child) {
+			return -1;
+		}
+		
+		/* get branch */
+		c = radixkey(*entry);
+		downlim = nodes[node].child;
+		uplim = downlim + trie_nchild(nodes + node);
+		last = uplim;
+		while(downlim < uplim) {
+			mid = (downlim + uplim) >> 1;
+			if(radixkey(src->labels[nodes[mid].label]) < c) {
+				downlim = mid + 1;
+			} else {
+				uplim = mid;
+			}
+		}
+		if(downlim == last || src->labels[nodes[downlim].label] != (unsigned char)(*entry)) {
+			return *entry ? -1 : trie_spaceterm(src, node);
+		}
+		node = downlim;
+	}
+}
+
+long unsigned trie_memory(Trie *src) {
+	return src->size * sizeof(TrieNode) + src->labelSize;
+}
+
+void trie_destroy(Trie *src) {
+	free(src->nodes);
+	free(src->labels);
+	free(src);
+}
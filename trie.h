@@ -0,0 +1,46 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef TRIE
+typedef struct trieNode TrieNode;
+typedef struct trie Trie;
+struct trieNode {
+	unsigned label; /* offset of edge label */
+	unsigned child; /* first child, siblings are consecutive */
+	unsigned short len;
+	unsigned char nchild; /* number of children minus one, if any */
+	unsigned char term;
+};
+struct trie {
+	unsigned n;
+	unsigned size;
+	long unsigned len;
+	long unsigned labelSize;
+	unsigned char *labels;
+	TrieNode *nodes;
+};
+#define TRIE 1
+#define trie_nchild(node) ((node)->child ? (node)->nchild + 1 : 0)
+#endif
+
+/* compressed radix trie over a sorted and deduplicated list */
+Trie * trie_build(char *arena, unsigned *off32, long unsigned *off64, long n);
+long trie_grep(Trie *src, char *entry);
+long unsigned trie_memory(Trie *src);
+void trie_destroy(Trie *src);
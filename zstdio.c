@@ -0,0 +1,375 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _GNU_SOURCE
+#include "pherror.h" /* before system headers, which raise _XOPEN_SOURCE */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "fileio.h"
+#include "zstdio.h"
+
+int zstd_check(unsigned char *buff, long len) {
+	
+	/* frame magic 0xFD2FB528, or a skippable frame 0x184D2A5? */
+	if(len < 4) {
+		return 0;
+	} else if(buff[0] == 0x28 && buff[1] == 0xB5 && buff[2] == 0x2F && buff[3] == 0xFD) {
+		return 1;
+	}
+	
+	return (buff[0] & 0xF0) == 0x50 && buff[1] == 0x2A && buff[2] == 0x4D && buff[3] == 0x18;
+}
+
+#ifdef HAVE_ZSTD
+Zstd * zstd_init(long inSize, int thread_num) {
+	
+	int i;
+	Zstd *dest;
+	
+	dest = smalloc(sizeof(Zstd));
+	dest->n = 0;
+	dest->size = ZSTD_MAXFRAMES;
+	dest->thread_num = thread_num;
+	dest->serial = 0;
+	dest->next = 0;
+	dest->avail = 0;
+	dest->inSize = inSize;
+	dest->frames = smalloc(4 * dest->size * sizeof(long));
+	dest->frameLen = dest->frames + dest->size;
+	dest->outPos = dest->frameLen + dest->size;
+	dest->outLen = dest->outPos + dest->size;
+	dest->hint = 0;
+	dest->in = smalloc(inSize);
+	dest->dest = 0;
+	dest->dstream = 0;
+	dest->threads = smalloc(thread_num * sizeof(ZstdThread));
+	for(i = 0; i < thread_num; ++i) {
+		dest->threads[i].src = dest;
+		if(!(dest->threads[i].ctx = ZSTD_createDCtx())) {
+			ERROR();
+		}
+	}
+	
+	return dest;
+}
+
+int zstd_cut(Zstd *src, long size) {
+	
+	long pos, out;
+	size_t len;
+	unsigned long long content;
+	
+	/* cut complete frames of known size, that fit size together */
+	src->n = 0;
+	pos = 0;
+	out = 0;
+	while(src->n < src->size && pos < src->avail) {
+		len = ZSTD_findFrameCompressedSize(src->in + pos, src->avail - pos);
+		if(ZSTD_isError(len)) {
+			break;
+		}
+		content = ZSTD_getFrameContentSize(src->in + pos, len);
+		if(ZSTD_CONTENTSIZE_ERROR <= content || (unsigned long long)(size - out) < content) {
+			break;
+		}
+		src->frames[src->n] = pos;
+		src->frameLen[src->n] = len;
+		src->outPos[src->n] = out;
+		src->outLen[src->n] = content;
+		++src->n;
+		pos += len;
+		out += content;
+	}
+	
+	/* frames too large, streamed or incomplete are streamed from here on */
+	if(src->n == 0 && src->avail) {
+		src->serial = 1;
+		if(!(src->dstream = ZSTD_createDStream())) {
+			ERROR();
+		}
+	}
+	
+	return src->n;
+}
+
+static void * zstd_worker(void *arg) {
+	
+	int i;
+	size_t len;
+	Zstd *src;
+	ZstdThread *thread;
+	
+	thread = arg;
+	src = thread->src;
+	while((i = __sync_fetch_and_add(&src->next, 1)) < src->n) {
+		len = ZSTD_decompressDCtx(thread->ctx, src->dest + src->outPos[i], src->outLen[i], src->in + src->frames[i], src->frameLen[i]);
+		if(ZSTD_isError(len) || len != (size_t)(src->outLen[i])) {
+			src->outLen[i] = -1;
+		}
+	}
+	
+	return NULL;
+}
+
+static long zstd_frames(Zstd *src, unsigned char *dest) {
+	
+	int i, thread_num, errcode;
+	long len, pos;
+	
+	/* decompress cut frames in parallel, they are already in place */
+	src->next = 0;
+	src->dest = dest;
+	thread_num = src->n < src->thread_num ? src->n : src->thread_num;
+	for(i = 1; i < thread_num; ++i) {
+		if((errcode = pthread_create(&src->threads[i].id, NULL, &zstd_worker, src->threads + i))) {
+			fprintf(stderr, "Error %d (%s)\n", errcode, strerror(errcode));
+			thread_num = i;
+			break;
+		}
+	}
+	zstd_worker(src->threads);
+	for(i = 1; i < thread_num; ++i) {
+		pthread_join(src->threads[i].id, NULL);
+	}
+	
+	/* drop frames from the compressed buffer */
+	len = 0;
+	pos = 0;
+	for(i = 0; i < src->n; ++i) {
+		if(src->outLen[i] < 0) {
+			fprintf(stderr, "Zstd error in frame at:\t%ld\n", src->frames[i]);
+			return -1;
+		}
+		len += src->outLen[i];
+		pos += src->frameLen[i];
+	}
+	src->avail -= pos;
+	memmove(src->in, src->in + pos, src->avail);
+	src->n = 0;
+	
+	return len;
+}
+
+long zstd_decompress(Zstd *src, unsigned char *dest, long size) {
+	
+	size_t hint;
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+	
+	if(!src->serial && zstd_cut(src, size)) {
+		return zstd_frames(src, dest);
+	} else if(!src->serial || (src->avail == 0 && src->hint == 0)) {
+		return 0;
+	}
+	
+	/* stream, until the output is full or the input is used */
+	in.src = src->in;
+	in.size = src->avail;
+	in.pos = 0;
+	out.dst = dest;
+	out.size = size;
+	out.pos = 0;
+	do {
+		hint = ZSTD_decompressStream(src->dstream, &out, &in);
+		if(ZSTD_isError(hint)) {
+			fprintf(stderr, "Zstd error:\t%s\n", ZSTD_getErrorName(hint));
+			return -1;
+		}
+		src->hint = hint;
+	} while(out.pos < out.size && in.pos < in.size);
+	src->avail -= in.pos;
+	memmove(src->in, src->in + in.pos, src->avail);
+	
+	return out.pos;
+}
+
+void zstd_destroy(Zstd *dest) {
+	
+	int i;
+	
+	for(i = 0; i < dest->thread_num; ++i) {
+		ZSTD_freeDCtx(dest->threads[i].ctx);
+	}
+	ZSTD_freeDStream(dest->dstream);
+	free(dest->frames);
+	free(dest->in);
+	free(dest->threads);
+	free(dest);
+}
+
+static void * zstd_compressor(void *arg) {
+	
+	int i;
+	size_t len;
+	ZstdWriter *dest;
+	ZstdThread *thread;
+	
+	thread = arg;
+	dest = thread->src;
+	while((i = __sync_fetch_and_add(&dest->next, 1)) < dest->n) {
+		len = ZSTD_compressCCtx(thread->ctx, dest->out + i * dest->bound, dest->bound, dest->buffer + (long) i * ZSTD_FRAMESIZE, i == dest->n - 1 ? dest->len : ZSTD_FRAMESIZE, dest->level);
+		dest->outLen[i] = ZSTD_isError(len) ? -1 : (long) len;
+	}
+	
+	return NULL;
+}
+
+static int zstd_deflate(ZstdWriter *dest) {
+	
+	int i, thread_num, errcode;
+	
+	/* compress filled frames in parallel, and write them in order */
+	dest->next = 0;
+	thread_num = dest->n < dest->workers ? dest->n : dest->workers;
+	for(i = 1; i < thread_num; ++i) {
+		if((errcode = pthread_create(&dest->threads[i].id, NULL, &zstd_compressor, dest->threads + i))) {
+			fprintf(stderr, "Error %d (%s)\n", errcode, strerror(errcode));
+			thread_num = i;
+			break;
+		}
+	}
+	zstd_compressor(dest->threads);
+	for(i = 1; i < thread_num; ++i) {
+		pthread_join(dest->threads[i].id, NULL);
+	}
+	for(i = 0; i < dest->n; ++i) {
+		if(dest->outLen[i] < 0 || fwrite(dest->out + i * dest->bound, 1, dest->outLen[i], dest->file) != (size_t)(dest->outLen[i])) {
+			return 1;
+		}
+	}
+	dest->n = 0;
+	dest->len = 0;
+	
+	return 0;
+}
+
+static ssize_t zstd_write(void *cookie, const char *buf, size_t size) {
+	
+	size_t len, left;
+	ZstdWriter *dest;
+	
+	/* fill frames, and compress them once each worker has one */
+	dest = cookie;
+	left = size;
+	while(left) {
+		if(dest->n == 0 || dest->len == ZSTD_FRAMESIZE) {
+			if(dest->n == dest->workers && zstd_deflate(dest)) {
+				return -1;
+			}
+			++dest->n;
+			dest->len = 0;
+		}
+		len = ZSTD_FRAMESIZE - dest->len;
+		len = left < len ? left : len;
+		memcpy(dest->buffer + (long)(dest->n - 1) * ZSTD_FRAMESIZE + dest->len, buf, len);
+		dest->len += len;
+		buf += len;
+		left -= len;
+	}
+	
+	return size;
+}
+
+static int zstd_close(void *cookie) {
+	
+	int i, err;
+	ZstdWriter *dest;
+	
+	/* flush last frames */
+	dest = cookie;
+	err = dest->n ? zstd_deflate(dest) : 0;
+	if(dest->file == stdout) {
+		err |= fflush(stdout);
+	} else {
+		err |= fclose(dest->file);
+	}
+	for(i = 0; i < dest->workers; ++i) {
+		ZSTD_freeCCtx(dest->threads[i].ctx);
+	}
+	free(dest->outLen);
+	free(dest->buffer);
+	free(dest->out);
+	free(dest->threads);
+	free(dest);
+	
+	return err ? EOF : 0;
+}
+
+FILE * zstd_open(FILE *file, int level, int workers) {
+	
+	int i;
+	ZstdWriter *writer;
+	
+	/* independent frames of known size on top of file */
+	writer = smalloc(sizeof(ZstdWriter));
+	writer->n = 0;
+	writer->level = level;
+	writer->workers = workers;
+	writer->next = 0;
+	writer->len = 0;
+	writer->bound = ZSTD_compressBound(ZSTD_FRAMESIZE);
+	writer->outLen = smalloc(workers * sizeof(long));
+	writer->buffer = smalloc((long) workers * ZSTD_FRAMESIZE);
+	writer->out = smalloc(workers * writer->bound);
+	writer->file = file;
+	writer->threads = smalloc(workers * sizeof(ZstdThread));
+	for(i = 0; i < workers; ++i) {
+		writer->threads[i].src = writer;
+		if(!(writer->threads[i].ctx = ZSTD_createCCtx())) {
+			ERROR();
+		}
+	}
+	
+	return fileio_writer(writer, &zstd_write, &zstd_close);
+}
+#else
+Zstd * zstd_init(long inSize, int thread_num) {
+	
+	fprintf(stderr, "Zstd input needs fqgrep built with libzstd.\n");
+	exit(1);
+	
+	return 0;
+}
+
+int zstd_cut(Zstd *src, long size) {
+	return -1;
+}
+
+long zstd_decompress(Zstd *src, unsigned char *dest, long size) {
+	return -1;
+}
+
+void zstd_destroy(Zstd *dest) {
+	free(dest);
+}
+
+FILE * zstd_open(FILE *file, int level, int workers) {
+	
+	fprintf(stderr, "Zstd output needs fqgrep built with libzstd.\n");
+	exit(1);
+	
+	return 0;
+}
+#endif
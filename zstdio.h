@@ -0,0 +1,74 @@
+/* Philip T.L.C. Clausen Oct 2026 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2026, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+
+#ifndef ZSTDIO
+typedef struct zstd Zstd;
+typedef struct zstdThread ZstdThread;
+typedef struct zstdWriter ZstdWriter;
+struct zstdThread {
+	void *src; /* Zstd or ZstdWriter */
+	void *ctx; /* ZSTD_DCtx or ZSTD_CCtx */
+	pthread_t id;
+};
+struct zstd {
+	int n; /* frames cut from "in" */
+	int size; /* max frames per refill */
+	int thread_num;
+	int serial; /* stream frames, once one cannot be cut */
+	volatile int next; /* next frame to decompress */
+	long avail; /* compressed bytes in "in" */
+	long inSize;
+	long *frames; /* offsets of frames in "in" */
+	long *frameLen;
+	long *outPos; /* frame i decompresses to dest + outPos[i] */
+	long *outLen;
+	size_t hint; /* non zero while a streamed frame is incomplete */
+	unsigned char *in;
+	unsigned char *dest;
+	void *dstream;
+	ZstdThread *threads;
+};
+struct zstdWriter {
+	int n; /* frames filled */
+	int level;
+	int workers;
+	volatile int next; /* next frame to compress */
+	long len; /* bytes in the last frame */
+	long bound; /* max size of a compressed frame */
+	long *outLen;
+	unsigned char *buffer; /* frame i at buffer + i * ZSTD_FRAMESIZE */
+	unsigned char *out;
+	FILE *file;
+	ZstdThread *threads;
+};
+#define ZSTDIO 1
+#define ZSTD_MAXFRAMES 1024
+#define ZSTD_FRAMESIZE 1048576
+#endif
+
+/* zstandard frames, independent ones are decompressed in parallel */
+int zstd_check(unsigned char *buff, long len);
+Zstd * zstd_init(long inSize, int thread_num);
+int zstd_cut(Zstd *src, long size);
+long zstd_decompress(Zstd *src, unsigned char *dest, long size);
+void zstd_destroy(Zstd *dest);
+FILE * zstd_open(FILE *file, int level, int workers);